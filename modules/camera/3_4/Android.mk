@@ -49,6 +49,7 @@ v4l2_src_files := \
   arc/jpeg_compressor.cpp \
   camera.cpp \
   capture_request.cpp \
+  conversion_pool.cpp \
   format_metadata_factory.cpp \
   metadata/boottime_state_delegate.cpp \
   metadata/enum_converter.cpp \
@@ -63,6 +64,8 @@ v4l2_src_files := \
   v4l2_wrapper.cpp \
 
 v4l2_test_files := \
+  arc/image_processor_test.cpp \
+  conversion_pool_test.cpp \
   format_metadata_factory_test.cpp \
   metadata/control_test.cpp \
   metadata/default_option_delegate_test.cpp \
@@ -83,6 +86,9 @@ v4l2_test_files := \
   metadata/v4l2_control_delegate_test.cpp \
   request_tracker_test.cpp \
   static_properties_test.cpp \
+  stream_format_test.cpp \
+  v4l2_camera_test.cpp \
+  v4l2_wrapper_test.cpp \
 
 # V4L2 Camera HAL.
 # ==============================================================================
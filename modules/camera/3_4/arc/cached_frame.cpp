@@ -17,8 +17,9 @@ using android::CameraMetadata;
 CachedFrame::CachedFrame()
     : source_frame_(nullptr),
       cropped_buffer_capacity_(0),
-      yu12_frame_(new AllocatedFrameBuffer(0)),
-      scaled_frame_(new AllocatedFrameBuffer(0)) {}
+      yu12_frame_(new AllocatedFrameBuffer(0)) {
+  conversion_buffers_.scaled_frame.reset(new AllocatedFrameBuffer(0));
+}
 
 CachedFrame::~CachedFrame() { UnsetSource(); }
 
@@ -37,6 +38,15 @@ int CachedFrame::SetSource(const FrameBuffer* frame, int rotate_degree) {
 
 void CachedFrame::UnsetSource() { source_frame_ = nullptr; }
 
+int CachedFrame::Reserve(uint32_t width, uint32_t height) {
+  size_t cache_size =
+      ImageProcessor::GetConvertedSize(V4L2_PIX_FMT_YUV420, width, height);
+  if (cache_size == 0) {
+    return -EINVAL;
+  }
+  return yu12_frame_->SetDataSize(cache_size);
+}
+
 uint8_t* CachedFrame::GetSourceBuffer() const {
   return source_frame_->GetData();
 }
@@ -66,6 +76,11 @@ size_t CachedFrame::GetConvertedSize(int fourcc) const {
 
 int CachedFrame::Convert(const CameraMetadata& metadata, FrameBuffer* out_frame,
                          bool video_hack) {
+  return Convert(metadata, out_frame, &conversion_buffers_, video_hack);
+}
+
+int CachedFrame::Convert(const CameraMetadata& metadata, FrameBuffer* out_frame,
+                         ConversionBuffers* buffers, bool video_hack) const {
   if (video_hack && out_frame->GetFourcc() == V4L2_PIX_FMT_YVU420) {
     out_frame->SetFourcc(V4L2_PIX_FMT_YUV420);
   }
@@ -78,16 +93,18 @@ int CachedFrame::Convert(const CameraMetadata& metadata, FrameBuffer* out_frame,
         out_frame->GetHeight());
     if (cache_size == 0) {
       return -EINVAL;
-    } else if (cache_size > scaled_frame_->GetBufferSize()) {
-      scaled_frame_.reset(new AllocatedFrameBuffer(cache_size));
+    } else if (!buffers->scaled_frame ||
+               cache_size > buffers->scaled_frame->GetBufferSize()) {
+      buffers->scaled_frame.reset(new AllocatedFrameBuffer(cache_size));
     }
-    scaled_frame_->SetWidth(out_frame->GetWidth());
-    scaled_frame_->SetHeight(out_frame->GetHeight());
-    ImageProcessor::Scale(*yu12_frame_.get(), scaled_frame_.get());
+    buffers->scaled_frame->SetWidth(out_frame->GetWidth());
+    buffers->scaled_frame->SetHeight(out_frame->GetHeight());
+    ImageProcessor::Scale(*yu12_frame_.get(), buffers->scaled_frame.get());
 
-    source_frame = scaled_frame_.get();
+    source_frame = buffers->scaled_frame.get();
   }
-  return ImageProcessor::ConvertFormat(metadata, *source_frame, out_frame);
+  return ImageProcessor::ConvertFormat(metadata, *source_frame, out_frame,
+                                       &buffers->jpeg_compressor);
 }
 
 int CachedFrame::ConvertToYU12() {
@@ -10,9 +10,19 @@
 
 #include <camera/CameraMetadata.h>
 #include "arc/image_processor.h"
+#include "arc/jpeg_compressor.h"
 
 namespace arc {
 
+// Buffers for converting frames to one output stream, besides the source and
+// output frames. Kept from frame to frame, they spare allocating for each.
+struct ConversionBuffers {
+  // Temporary buffer for scaled results.
+  std::unique_ptr<AllocatedFrameBuffer> scaled_frame;
+  // Compressor holding the JPEG results.
+  JpegCompressor jpeg_compressor;
+};
+
 // CachedFrame contains a source FrameBuffer and a cached, converted
 // FrameBuffer. The incoming frames would be converted to YU12, the default
 // format of libyuv, to allow convenient processing.
@@ -32,6 +42,10 @@ class CachedFrame {
   int SetSource(const FrameBuffer* frame, int rotate_degree);
   void UnsetSource();
 
+  // Allocates the YU12 cache for source frames of |width| x |height|, so that
+  // SetSource() doesn't allocate for them. Return non-zero values on errors.
+  int Reserve(uint32_t width, uint32_t height);
+
   uint8_t* GetSourceBuffer() const;
   size_t GetSourceDataSize() const;
   uint32_t GetSourceFourCC() const;
@@ -55,6 +69,13 @@ class CachedFrame {
   int Convert(const android::CameraMetadata& metadata, FrameBuffer* out_frame,
               bool video_hack = false);
 
+  // Same as above, but with |buffers| instead of the buffers of this
+  // CachedFrame; they are reallocated if too small. Several frames can be
+  // converted from the same source at once this way, each with its own
+  // |buffers|.
+  int Convert(const android::CameraMetadata& metadata, FrameBuffer* out_frame,
+              ConversionBuffers* buffers, bool video_hack = false) const;
+
  private:
   int ConvertToYU12();
   // When we have a landscape mounted camera and the current camera activity is
@@ -76,8 +97,8 @@ class CachedFrame {
   // Cache YU12 decoded results.
   std::unique_ptr<AllocatedFrameBuffer> yu12_frame_;
 
-  // Temporary buffer for scaled results.
-  std::unique_ptr<AllocatedFrameBuffer> scaled_frame_;
+  // Temporary buffers for scaled and compressed results.
+  ConversionBuffers conversion_buffers_;
 };
 
 }  // namespace arc
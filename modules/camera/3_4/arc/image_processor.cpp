@@ -56,7 +56,8 @@ static int YU12ToYV12(const void* yv12, void* yu12, int width, int height,
                       int dst_stride_y, int dst_stride_uv);
 static int YU12ToNV21(const void* yv12, void* nv21, int width, int height);
 static bool ConvertToJpeg(const CameraMetadata& metadata,
-                          const FrameBuffer& in_frame, FrameBuffer* out_frame);
+                          const FrameBuffer& in_frame, FrameBuffer* out_frame,
+                          JpegCompressor* compressor);
 static bool SetExifTags(const CameraMetadata& metadata, ExifUtils* utils);
 
 // How precise the float-to-rational conversion for EXIF tags would be.
@@ -114,7 +115,8 @@ bool ImageProcessor::SupportsConversion(uint32_t from_fourcc,
 
 int ImageProcessor::ConvertFormat(const CameraMetadata& metadata,
                                   const FrameBuffer& in_frame,
-                                  FrameBuffer* out_frame) {
+                                  FrameBuffer* out_frame,
+                                  JpegCompressor* compressor) {
   if ((in_frame.GetWidth() % 2) || (in_frame.GetHeight() % 2)) {
     LOGF(ERROR) << "Width or height is not even (" << in_frame.GetWidth()
                 << " x " << in_frame.GetHeight() << ")";
@@ -217,9 +219,9 @@ int ImageProcessor::ConvertFormat(const CameraMetadata& metadata,
         return res ? -EINVAL : 0;
       }
       case V4L2_PIX_FMT_JPEG: {
-        bool res = ConvertToJpeg(metadata, in_frame, out_frame);
+        bool res = ConvertToJpeg(metadata, in_frame, out_frame, compressor);
         LOGF_IF(ERROR, !res) << "ConvertToJpeg() returns " << res;
-        return res ? -EINVAL : 0;
+        return res ? 0 : -EINVAL;
       }
       default:
         LOGF(ERROR) << "Destination pixel format "
@@ -281,13 +283,20 @@ int ImageProcessor::Scale(const FrameBuffer& in_frame, FrameBuffer* out_frame) {
            << in_frame.GetHeight() << " to " << out_frame->GetWidth() << "x"
            << out_frame->GetHeight();
 
+  uint32_t x, y, width, height;
+  GetCenterCrop(in_frame.GetWidth(), in_frame.GetHeight(),
+                out_frame->GetWidth(), out_frame->GetHeight(), &x, &y, &width,
+                &height);
+  const uint8_t* in_y = in_frame.GetData();
+  const uint8_t* in_u = in_y + in_frame.GetWidth() * in_frame.GetHeight();
+  const uint8_t* in_v = in_u + in_frame.GetWidth() * in_frame.GetHeight() / 4;
+  size_t y_offset = y * in_frame.GetWidth() + x;
+  size_t uv_offset = y / 2 * (in_frame.GetWidth() / 2) + x / 2;
+
   int ret = libyuv::I420Scale(
-      in_frame.GetData(), in_frame.GetWidth(),
-      in_frame.GetData() + in_frame.GetWidth() * in_frame.GetHeight(),
-      in_frame.GetWidth() / 2,
-      in_frame.GetData() + in_frame.GetWidth() * in_frame.GetHeight() * 5 / 4,
-      in_frame.GetWidth() / 2, in_frame.GetWidth(), in_frame.GetHeight(),
-      out_frame->GetData(), out_frame->GetWidth(),
+      in_y + y_offset, in_frame.GetWidth(), in_u + uv_offset,
+      in_frame.GetWidth() / 2, in_v + uv_offset, in_frame.GetWidth() / 2,
+      width, height, out_frame->GetData(), out_frame->GetWidth(),
       out_frame->GetData() + out_frame->GetWidth() * out_frame->GetHeight(),
       out_frame->GetWidth() / 2,
       out_frame->GetData() +
@@ -298,6 +307,29 @@ int ImageProcessor::Scale(const FrameBuffer& in_frame, FrameBuffer* out_frame) {
   return ret;
 }
 
+void ImageProcessor::GetCenterCrop(uint32_t in_width, uint32_t in_height,
+                                   uint32_t out_width, uint32_t out_height,
+                                   uint32_t* x, uint32_t* y, uint32_t* width,
+                                   uint32_t* height) {
+  *width = in_width;
+  *height = in_height;
+  if (out_width > 0 && out_height > 0) {
+    uint64_t in_ratio = static_cast<uint64_t>(in_width) * out_height;
+    uint64_t out_ratio = static_cast<uint64_t>(out_width) * in_height;
+    if (in_ratio > out_ratio) {
+      // Wider than the output: crop the sides.
+      *width =
+          (static_cast<uint64_t>(in_height) * out_width / out_height) & ~1u;
+    } else if (in_ratio < out_ratio) {
+      // Taller than the output: crop the top and bottom.
+      *height =
+          (static_cast<uint64_t>(in_width) * out_height / out_width) & ~1u;
+    }
+  }
+  *x = ((in_width - *width) / 2) & ~1u;
+  *y = ((in_height - *height) / 2) & ~1u;
+}
+
 static int YU12ToYV12(const void* yu12, void* yv12, int width, int height,
                       int dst_stride_y, int dst_stride_uv) {
   if ((width % 2) || (height % 2)) {
@@ -349,7 +381,8 @@ static int YU12ToNV21(const void* yu12, void* nv21, int width, int height) {
 }
 
 static bool ConvertToJpeg(const CameraMetadata& metadata,
-                          const FrameBuffer& in_frame, FrameBuffer* out_frame) {
+                          const FrameBuffer& in_frame, FrameBuffer* out_frame,
+                          JpegCompressor* compressor) {
   ExifUtils utils;
   int jpeg_quality, thumbnail_jpeg_quality;
   camera_metadata_ro_entry entry;
@@ -382,18 +415,22 @@ static bool ConvertToJpeg(const CameraMetadata& metadata,
     LOGF(ERROR) << "Generating APP1 segment failed.";
     return false;
   }
-  JpegCompressor compressor;
-  if (!compressor.CompressImage(in_frame.GetData(), in_frame.GetWidth(),
-                                in_frame.GetHeight(), jpeg_quality,
-                                utils.GetApp1Buffer(), utils.GetApp1Length())) {
+  JpegCompressor local_compressor;
+  if (!compressor) {
+    compressor = &local_compressor;
+  }
+  if (!compressor->CompressImage(in_frame.GetData(), in_frame.GetWidth(),
+                                 in_frame.GetHeight(), jpeg_quality,
+                                 utils.GetApp1Buffer(),
+                                 utils.GetApp1Length())) {
     LOGF(ERROR) << "JPEG image compression failed";
     return false;
   }
-  size_t buffer_length = compressor.GetCompressedImageSize();
+  size_t buffer_length = compressor->GetCompressedImageSize();
   if (out_frame->SetDataSize(buffer_length)) {
     return false;
   }
-  memcpy(out_frame->GetData(), compressor.GetCompressedImagePtr(),
+  memcpy(out_frame->GetData(), compressor->GetCompressedImagePtr(),
          buffer_length);
   return true;
 }
@@ -16,6 +16,8 @@
 
 namespace arc {
 
+class JpegCompressor;
+
 // V4L2_PIX_FMT_YVU420(YV12) in ImageProcessor has alignment requirement.
 // The stride of Y, U, and V planes should a multiple of 16 pixels.
 struct ImageProcessor {
@@ -30,15 +32,28 @@ struct ImageProcessor {
   // Convert format from |in_frame.fourcc| to |out_frame->fourcc|. Caller should
   // fill |data|, |buffer_size|, |width|, and |height| of |out_frame|. The
   // function will fill |out_frame->data_size|. Return non-zero error code on
-  // failure; return 0 on success.
+  // failure; return 0 on success. JPEG output is compressed with |compressor|
+  // if not null, to reuse its buffer.
   static int ConvertFormat(const android::CameraMetadata& metadata,
-                           const FrameBuffer& in_frame, FrameBuffer* out_frame);
+                           const FrameBuffer& in_frame, FrameBuffer* out_frame,
+                           JpegCompressor* compressor = nullptr);
 
   // Scale image size according to |in_frame| and |out_frame|. Only support
   // V4L2_PIX_FMT_YUV420 format. Caller should fill |data|, |width|, |height|,
   // and |buffer_size| of |out_frame|. The function will fill |data_size| and
-  // |fourcc| of |out_frame|.
+  // |fourcc| of |out_frame|. If the aspect ratios differ, the center of
+  // |in_frame| is cropped to the aspect ratio of |out_frame| before scaling,
+  // so that the image isn't stretched.
   static int Scale(const FrameBuffer& in_frame, FrameBuffer* out_frame);
+
+  // Calculate the largest region at the center of an |in_width| x |in_height|
+  // frame with the aspect ratio of |out_width| x |out_height|, as its offset
+  // |x|, |y| and size |width| x |height|. All are even, so that the region
+  // starts and ends on the chroma samples of YU12 frames.
+  static void GetCenterCrop(uint32_t in_width, uint32_t in_height,
+                            uint32_t out_width, uint32_t out_height,
+                            uint32_t* x, uint32_t* y, uint32_t* width,
+                            uint32_t* height);
 };
 
 }  // namespace arc
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "arc/image_processor.h"
+
+#include <gtest/gtest.h>
+
+using testing::Test;
+
+namespace arc {
+
+class ImageProcessorTest : public Test {
+ protected:
+  void ExpectCrop(uint32_t in_width, uint32_t in_height, uint32_t out_width,
+                  uint32_t out_height, uint32_t x, uint32_t y, uint32_t width,
+                  uint32_t height) {
+    uint32_t actual_x, actual_y, actual_width, actual_height;
+    ImageProcessor::GetCenterCrop(in_width, in_height, out_width, out_height,
+                                  &actual_x, &actual_y, &actual_width,
+                                  &actual_height);
+    EXPECT_EQ(actual_x, x);
+    EXPECT_EQ(actual_y, y);
+    EXPECT_EQ(actual_width, width);
+    EXPECT_EQ(actual_height, height);
+  }
+};
+
+TEST_F(ImageProcessorTest, CenterCropSameAspectRatio) {
+  ExpectCrop(1280, 960, 640, 480, 0, 0, 1280, 960);
+  ExpectCrop(640, 480, 640, 480, 0, 0, 640, 480);
+}
+
+TEST_F(ImageProcessorTest, CenterCropSides) {
+  // 16:9 to 4:3.
+  ExpectCrop(1280, 720, 640, 480, 160, 0, 960, 720);
+  // 16:9 to 1:1.
+  ExpectCrop(1920, 1080, 320, 320, 420, 0, 1080, 1080);
+}
+
+TEST_F(ImageProcessorTest, CenterCropTopAndBottom) {
+  // 4:3 to 16:9.
+  ExpectCrop(640, 480, 320, 180, 0, 60, 640, 360);
+}
+
+TEST_F(ImageProcessorTest, CenterCropEven) {
+  // 4:3 to 11:9 crops 586.6 columns, rounded down to 586, with an offset of
+  // 27 rounded down to 26, so that the crop starts on a chroma sample.
+  ExpectCrop(640, 480, 176, 144, 26, 0, 586, 480);
+}
+
+}  // namespace arc
@@ -40,6 +40,8 @@ bool JpegCompressor::CompressImage(const void* image, int width, int height,
   return true;
 }
 
+void JpegCompressor::Reserve(size_t size) { result_buffer_.reserve(size); }
+
 const void* JpegCompressor::GetCompressedImagePtr() {
   return result_buffer_.data();
 }
@@ -101,9 +103,11 @@ bool JpegCompressor::Encode(const void* inYuv, int width, int height,
   }
 
   if (!Compress(&cinfo, static_cast<const uint8_t*>(inYuv))) {
+    jpeg_destroy_compress(&cinfo);
     return false;
   }
   jpeg_finish_compress(&cinfo);
+  jpeg_destroy_compress(&cinfo);
   return true;
 }
 
@@ -33,6 +33,10 @@ class JpegCompressor {
   bool CompressImage(const void* image, int width, int height, int quality,
                      const void* app1Buffer, unsigned int app1Size);
 
+  // Reserves |size| bytes for the compressed image, so that compressing images
+  // up to that size doesn't allocate.
+  void Reserve(size_t size);
+
   // Returns the compressed JPEG buffer pointer. This method must be called only
   // after calling CompressImage().
   const void* GetCompressedImagePtr();
@@ -425,6 +425,11 @@ int Camera::flush()
     // thread, this function should behave nicely concurrently with that too.
     android::Mutex::Autolock tl(mInFlightTrackerLock);
 
+    // Call down into the device flushing first. Once it returns, the device
+    // no longer writes to the output buffers of the requests, so they can be
+    // handed back to the framework.
+    int res = flushBuffers();
+
     std::set<std::shared_ptr<CaptureRequest>> requests;
     mInFlightTracker->Clear(&requests);
     for (auto& request : requests) {
@@ -434,9 +439,7 @@ int Camera::flush()
     }
 
     ALOGV("%s:%d: Flushed %zu requests.", __func__, mId, requests.size());
-
-    // Call down into the device flushing.
-    return flushBuffers();
+    return res;
 }
 
 int Camera::preprocessCaptureBuffer(camera3_stream_buffer_t *buffer)
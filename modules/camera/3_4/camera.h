@@ -29,6 +29,10 @@
 #include "request_tracker.h"
 #include "static_properties.h"
 
+namespace v4l2_camera_hal {
+class V4L2CameraTest;
+}  // namespace v4l2_camera_hal
+
 namespace default_camera_hal {
 // Camera represents a physical camera on a device.
 // This is constructed when the HAL module is loaded, one per physical camera.
@@ -83,7 +87,9 @@ class Camera {
         // Enqueue a request to receive data from the camera
         virtual int enqueueRequest(
             std::shared_ptr<CaptureRequest> request) = 0;
-        // Flush in flight buffers.
+        // Flush in flight buffers. Called by flush() with the request
+        // tracker locked, before it fails the requests in flight; once it
+        // returns, their output buffers must not be written anymore.
         virtual int flushBuffers() = 0;
 
 
@@ -139,6 +145,8 @@ class Camera {
         // Track in flight requests.
         std::unique_ptr<RequestTracker> mInFlightTracker;
         android::Mutex mInFlightTrackerLock;
+
+        friend class v4l2_camera_hal::V4L2CameraTest;
 };
 }  // namespace default_camera_hal
 
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "conversion_pool.h"
+
+namespace v4l2_camera_hal {
+
+ConversionPool::ConversionPool(std::function<int(size_t index)> convert)
+    : convert_(std::move(convert)),
+      count_(0),
+      next_(0),
+      pending_(0),
+      result_(0),
+      stopping_(false) {}
+
+ConversionPool::~ConversionPool() {
+  Stop();
+}
+
+void ConversionPool::Start(size_t workers) {
+  Stop();
+  workers_.reserve(workers);
+  for (size_t i = 0; i < workers; ++i) {
+    workers_.emplace_back(&ConversionPool::WorkerLoop, this);
+  }
+}
+
+void ConversionPool::Stop() {
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    stopping_ = true;
+  }
+  frame_posted_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+  workers_.clear();
+  std::lock_guard<std::mutex> guard(lock_);
+  stopping_ = false;
+}
+
+int ConversionPool::Run(size_t count) {
+  std::unique_lock<std::mutex> lock(lock_);
+  count_ = count;
+  next_ = 0;
+  pending_ = count;
+  result_ = 0;
+  if (!workers_.empty() && count > 1) {
+    frame_posted_.notify_all();
+  }
+  RunConversions(&lock);
+  while (pending_ > 0) {
+    frame_done_.wait(lock);
+  }
+  return result_;
+}
+
+void ConversionPool::WorkerLoop() {
+  std::unique_lock<std::mutex> lock(lock_);
+  while (!stopping_) {
+    if (next_ < count_) {
+      RunConversions(&lock);
+    } else {
+      frame_posted_.wait(lock);
+    }
+  }
+}
+
+void ConversionPool::RunConversions(std::unique_lock<std::mutex>* lock) {
+  while (next_ < count_) {
+    size_t index = next_++;
+    lock->unlock();
+    int res = convert_(index);
+    lock->lock();
+    if (res && !result_) {
+      result_ = res;
+    }
+    if (--pending_ == 0) {
+      frame_done_.notify_one();
+    }
+  }
+}
+
+}  // namespace v4l2_camera_hal
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef V4L2_CAMERA_HAL_CONVERSION_POOL_H_
+#define V4L2_CAMERA_HAL_CONVERSION_POOL_H_
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <android-base/macros.h>
+
+namespace v4l2_camera_hal {
+
+// A fixed set of worker threads converting one frame into several output
+// buffers at once. The workers are started when the streams are configured,
+// so that converting a frame neither creates threads nor allocates.
+class ConversionPool {
+ public:
+  // |convert| writes output buffer |index| of the frame being converted,
+  // returning 0 or a negative error code. It is called from the workers and
+  // from the thread calling Run().
+  explicit ConversionPool(std::function<int(size_t index)> convert);
+  ~ConversionPool();
+
+  // Start |workers| threads, after joining the ones started before.
+  // Neither Start() nor Stop() may be called during Run().
+  void Start(size_t workers);
+  // Join the workers. Run() then converts on the calling thread only.
+  void Stop();
+  // Call |convert_| for each index below |count|, on the workers and on the
+  // calling thread, and return once all are done. Returns the first error of
+  // a conversion, or 0. Only one thread may call Run() at a time.
+  int Run(size_t count);
+
+ private:
+  void WorkerLoop();
+  // Take and convert outputs of the current frame until none is left.
+  // Called with |lock| held, which is released while converting.
+  void RunConversions(std::unique_lock<std::mutex>* lock);
+
+  const std::function<int(size_t index)> convert_;
+  std::vector<std::thread> workers_;
+
+  // Guards the state below.
+  std::mutex lock_;
+  std::condition_variable frame_posted_;
+  std::condition_variable frame_done_;
+  // The outputs of the current frame, the next one to convert, and the
+  // number of conversions not finished yet.
+  size_t count_;
+  size_t next_;
+  size_t pending_;
+  int result_;
+  bool stopping_;
+
+  DISALLOW_COPY_AND_ASSIGN(ConversionPool);
+};
+
+}  // namespace v4l2_camera_hal
+
+#endif  // V4L2_CAMERA_HAL_CONVERSION_POOL_H_
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "conversion_pool.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+using testing::Test;
+
+namespace v4l2_camera_hal {
+
+static constexpr size_t kOutputs = 4;
+
+class ConversionPoolTest : public Test {
+ protected:
+  ConversionPoolTest()
+      : pool_([this](size_t index) { return Convert(index); }) {}
+
+  void SetUp() {
+    for (auto& count : converted_) {
+      count = 0;
+    }
+  }
+
+  // Record the conversion, and fail output |failing_| if set.
+  int Convert(size_t index) {
+    ++converted_[index];
+    if (index == failing_) {
+      return -EIO;
+    }
+    if (barrier_) {
+      return WaitAtBarrier();
+    }
+    return 0;
+  }
+
+  // Wait until |kOutputs| conversions are running at once. Returns -ETIMEDOUT
+  // if they aren't, i.e. if the outputs are not converted in parallel.
+  int WaitAtBarrier() {
+    std::unique_lock<std::mutex> lock(barrier_lock_);
+    if (++arrived_ == kOutputs) {
+      all_arrived_.notify_all();
+      return 0;
+    }
+    bool all = all_arrived_.wait_for(lock, std::chrono::seconds(5),
+                                     [this] { return arrived_ == kOutputs; });
+    return all ? 0 : -ETIMEDOUT;
+  }
+
+  ConversionPool pool_;
+  std::atomic<int> converted_[kOutputs];
+  size_t failing_ = kOutputs;
+  bool barrier_ = false;
+  std::mutex barrier_lock_;
+  std::condition_variable all_arrived_;
+  size_t arrived_ = 0;
+};
+
+TEST_F(ConversionPoolTest, ConvertsEveryOutputOnce) {
+  pool_.Start(kOutputs - 1);
+  for (int frame = 1; frame <= 100; ++frame) {
+    ASSERT_EQ(pool_.Run(kOutputs), 0);
+    for (size_t i = 0; i < kOutputs; ++i) {
+      ASSERT_EQ(converted_[i], frame);
+    }
+  }
+}
+
+TEST_F(ConversionPoolTest, ConvertsFewerOutputs) {
+  // A request may have buffers for only some of the streams.
+  pool_.Start(kOutputs - 1);
+  ASSERT_EQ(pool_.Run(1), 0);
+  EXPECT_EQ(converted_[0], 1);
+  EXPECT_EQ(converted_[1], 0);
+}
+
+TEST_F(ConversionPoolTest, ConvertsInParallel) {
+  pool_.Start(kOutputs - 1);
+  barrier_ = true;
+  EXPECT_EQ(pool_.Run(kOutputs), 0);
+}
+
+TEST_F(ConversionPoolTest, ReturnsError) {
+  pool_.Start(kOutputs - 1);
+  failing_ = 2;
+  EXPECT_EQ(pool_.Run(kOutputs), -EIO);
+  // The other outputs are still written.
+  for (size_t i = 0; i < kOutputs; ++i) {
+    EXPECT_EQ(converted_[i], 1);
+  }
+  failing_ = kOutputs;
+  EXPECT_EQ(pool_.Run(kOutputs), 0);
+}
+
+TEST_F(ConversionPoolTest, ConvertsWithoutWorkers) {
+  ASSERT_EQ(pool_.Run(kOutputs), 0);
+  pool_.Start(kOutputs - 1);
+  pool_.Stop();
+  ASSERT_EQ(pool_.Run(kOutputs), 0);
+  for (size_t i = 0; i < kOutputs; ++i) {
+    EXPECT_EQ(converted_[i], 2);
+  }
+}
+
+TEST_F(ConversionPoolTest, RestartsWorkers) {
+  // Reconfiguring joins the workers and starts the new number of them.
+  pool_.Start(1);
+  ASSERT_EQ(pool_.Run(kOutputs), 0);
+  pool_.Start(kOutputs - 1);
+  barrier_ = true;
+  EXPECT_EQ(pool_.Run(kOutputs), 0);
+}
+
+}  // namespace v4l2_camera_hal
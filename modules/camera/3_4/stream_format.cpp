@@ -218,4 +218,18 @@ SupportedFormats StreamFormat::GetQualifiedFormats(
   return qualified_formats;
 }
 
+camera3_stream_t* StreamFormat::FindLargestStream(
+    const camera3_stream_configuration_t& config) {
+  camera3_stream_t* largest = nullptr;
+  for (uint32_t i = 0; i < config.num_streams; ++i) {
+    camera3_stream_t* stream = config.streams[i];
+    if (!largest ||
+        static_cast<uint64_t>(stream->width) * stream->height >
+            static_cast<uint64_t>(largest->width) * largest->height) {
+      largest = stream;
+    }
+  }
+  return largest;
+}
+
 }  // namespace v4l2_camera_hal
@@ -19,6 +19,7 @@
 
 #include <cstring>
 
+#include <hardware/camera3.h>
 #include <linux/videodev2.h>
 #include "arc/common_types.h"
 
@@ -70,6 +71,16 @@ class StreamFormat {
   static arc::SupportedFormats GetQualifiedFormats(
       const arc::SupportedFormats& supported_formats);
 
+  // The stream to capture when the frames of every stream of |config| are
+  // converted from the frames of one: the one with the most pixels. The first
+  // of equal ones wins. A stream as wide as the widest one and as tall as the
+  // tallest one has the most pixels, so it is picked if there is one, and the
+  // others are only scaled down. Otherwise, the others are cropped to their
+  // aspect ratio from it, and may be scaled up in one dimension, e.g. 1600x1200
+  // from the 1440x1080 center of 1920x1080.
+  static camera3_stream_t* FindLargestStream(
+      const camera3_stream_configuration_t& config);
+
  private:
   uint32_t type_;
   uint32_t v4l2_pixel_format_;
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "stream_format.h"
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using testing::Test;
+
+namespace v4l2_camera_hal {
+
+class StreamFormatTest : public Test {
+ protected:
+  camera3_stream_t* FindLargest(std::vector<camera3_stream_t*> streams) {
+    camera3_stream_configuration_t config{
+        static_cast<uint32_t>(streams.size()), streams.data(), 0, nullptr};
+    return StreamFormat::FindLargestStream(config);
+  }
+
+  static camera3_stream_t Stream(uint32_t width, uint32_t height) {
+    camera3_stream_t stream = {};
+    stream.width = width;
+    stream.height = height;
+    return stream;
+  }
+};
+
+TEST_F(StreamFormatTest, FindLargestStreamSingle) {
+  camera3_stream_t stream = Stream(640, 480);
+  EXPECT_EQ(FindLargest({&stream}), &stream);
+}
+
+TEST_F(StreamFormatTest, FindLargestStreamAnywhere) {
+  camera3_stream_t small = Stream(320, 240);
+  camera3_stream_t medium = Stream(640, 480);
+  camera3_stream_t large = Stream(1280, 720);
+  EXPECT_EQ(FindLargest({&large, &small, &medium}), &large);
+  EXPECT_EQ(FindLargest({&small, &large, &medium}), &large);
+  EXPECT_EQ(FindLargest({&small, &medium, &large}), &large);
+}
+
+TEST_F(StreamFormatTest, FindLargestStreamByArea) {
+  // Neither the widest nor the tallest stream has the most pixels.
+  camera3_stream_t wide = Stream(1920, 100);
+  camera3_stream_t tall = Stream(100, 1920);
+  camera3_stream_t largest = Stream(640, 480);
+  EXPECT_EQ(FindLargest({&wide, &tall, &largest}), &largest);
+}
+
+TEST_F(StreamFormatTest, FindLargestStreamCovering) {
+  // A stream as wide and as tall as every other one is picked.
+  camera3_stream_t wide = Stream(1280, 720);
+  camera3_stream_t tall = Stream(960, 960);
+  camera3_stream_t covering = Stream(1280, 960);
+  EXPECT_EQ(FindLargest({&wide, &tall, &covering}), &covering);
+}
+
+TEST_F(StreamFormatTest, FindLargestStreamNotCovering) {
+  // No stream is both the widest and the tallest, so the one with the most
+  // pixels is picked, and 1600x1200 is scaled up from its 1440x1080 center.
+  camera3_stream_t wide = Stream(1920, 1080);
+  camera3_stream_t tall = Stream(1600, 1200);
+  EXPECT_EQ(FindLargest({&tall, &wide}), &wide);
+  EXPECT_EQ(FindLargest({&wide, &tall}), &wide);
+}
+
+TEST_F(StreamFormatTest, FindLargestStreamFirstOfEqual) {
+  camera3_stream_t first = Stream(640, 480);
+  camera3_stream_t second = Stream(480, 640);
+  EXPECT_EQ(FindLargest({&first, &second}), &first);
+}
+
+TEST_F(StreamFormatTest, FindLargestStreamNoOverflow) {
+  // 65536 x 65536 overflows 32 bits.
+  camera3_stream_t huge = Stream(65536, 65536);
+  camera3_stream_t small = Stream(640, 480);
+  EXPECT_EQ(FindLargest({&small, &huge}), &huge);
+}
+
+}  // namespace v4l2_camera_hal
@@ -62,10 +62,14 @@ V4L2Camera::V4L2Camera(int id,
     : default_camera_hal::Camera(id),
       device_(std::move(v4l2_wrapper)),
       metadata_(std::move(metadata)),
+      stream_off_count_(0),
+      converting_(false),
       buffer_enqueuer_(new FunctionThread(
           std::bind(&V4L2Camera::enqueueRequestBuffers, this))),
       buffer_dequeuer_(new FunctionThread(
           std::bind(&V4L2Camera::dequeueRequestBuffers, this))),
+      buffer_converter_(new FunctionThread(
+          std::bind(&V4L2Camera::convertRequestBuffers, this))),
       max_input_streams_(0),
       max_output_streams_({{0, 0, 0}}) {
   HAL_LOG_ENTER();
@@ -112,7 +116,32 @@ void V4L2Camera::disconnect() {
 
 int V4L2Camera::flushBuffers() {
   HAL_LOG_ENTER();
-  return device_->StreamOff();
+  int res;
+  {
+    std::lock_guard<std::mutex> guard(in_flight_lock_);
+    res = device_->StreamOff();
+    if (!res) {
+      // Turning the stream off returned every buffer from the device.
+      in_flight_buffer_count_ = 0;
+      ++stream_off_count_;
+    }
+
+    // Camera::flush() fails the requests of the dequeued buffers once this
+    // returns, handing their output buffers back, so drop the buffers still
+    // waiting and wait for the one being converted. Holding |in_flight_lock_|
+    // keeps the dequeue thread from queueing more.
+    std::unique_lock<std::mutex> lock(convert_queue_lock_);
+    while (!convert_queue_.empty()) {
+      device_->ReleaseRequest(convert_queue_.front().index);
+      convert_queue_.pop();
+    }
+    while (converting_) {
+      conversion_done_.wait(lock);
+    }
+  }
+  // Stop the dequeue thread from waiting on the device.
+  device_->WakeWaiters();
+  return res;
 }
 
 int V4L2Camera::initStaticInfo(android::CameraMetadata* out) {
@@ -160,7 +189,8 @@ void V4L2Camera::initDeviceInfo(camera_info_t* info) {
 int V4L2Camera::initDevice() {
   HAL_LOG_ENTER();
 
-  // Start the buffer enqueue/dequeue threads if they're not already running.
+  // Start the buffer enqueue/dequeue/convert threads if they're not already
+  // running.
   if (!buffer_enqueuer_->isRunning()) {
     android::status_t res = buffer_enqueuer_->run("Enqueue buffers");
     if (res != android::OK) {
@@ -175,6 +205,13 @@ int V4L2Camera::initDevice() {
       return -ENODEV;
     }
   }
+  if (!buffer_converter_->isRunning()) {
+    android::status_t res = buffer_converter_->run("Convert buffers");
+    if (res != android::OK) {
+      HAL_LOGE("Failed to start buffer convert thread: %d", res);
+      return -ENODEV;
+    }
+  }
 
   return 0;
 }
@@ -184,7 +221,7 @@ int V4L2Camera::enqueueRequest(
   HAL_LOG_ENTER();
 
   // Assume request validated before calling this function.
-  // (For now, always exactly 1 output buffer, no inputs).
+  // (At least 1 output buffer, no inputs).
   {
     std::lock_guard<std::mutex> guard(request_queue_lock_);
     request_queue_.push(request);
@@ -213,7 +250,7 @@ bool V4L2Camera::enqueueRequestBuffers() {
       dequeueRequest();
 
   // Assume request validated before being added to the queue
-  // (For now, always exactly 1 output buffer, no inputs).
+  // (At least 1 output buffer, no inputs).
 
   // Setting and getting settings are best effort here,
   // since there's no way to know through V4L2 exactly what
@@ -266,31 +303,99 @@ bool V4L2Camera::enqueueRequestBuffers() {
 }
 
 bool V4L2Camera::dequeueRequestBuffers() {
+  // Wait until the device has buffers to fill.
+  uint32_t stream_off_count;
+  {
+    std::unique_lock<std::mutex> lock(in_flight_lock_);
+    while (in_flight_buffer_count_ == 0) {
+      buffers_in_flight_.wait(lock);
+    }
+    stream_off_count = stream_off_count_;
+  }
+
+  // Block until one of them is filled, or until a flush or disconnect
+  // wakes this thread up to check the count again.
+  int res = device_->WaitForBuffer();
+  if (res == -EINTR) {
+    return true;
+  } else if (res) {
+    // The device won't fill the buffers it has. Waiting on it again would
+    // only fail again, so fail their requests instead.
+    HAL_LOGE("Device failed to wait for buffer: %d", res);
+    abortRequestBuffers(stream_off_count);
+    return true;
+  }
+
   // Dequeue a buffer.
-  std::shared_ptr<default_camera_hal::CaptureRequest> request;
-  int res;
+  DequeuedBuffer dequeued;
+  std::unique_lock<std::mutex> lock(in_flight_lock_);
+  res = device_->DequeueRequest(&dequeued.request, &dequeued.index);
+  if (res) {
+    // EAGAIN is possible if the stream was turned off after the wait.
+    if (res != -EAGAIN) {
+      HAL_LOGW("Device failed to dequeue buffer: %d", res);
+    }
+    return true;
+  }
+  in_flight_buffer_count_--;
+
+  // Hand the buffer over for conversion, so that the next one can be
+  // dequeued as soon as the device has filled it. This is done before
+  // releasing |in_flight_lock_|, so that a flush finds it in the queue.
+  std::lock_guard<std::mutex> guard(convert_queue_lock_);
+  convert_queue_.push(std::move(dequeued));
+  buffers_dequeued_.notify_one();
+  return true;
+}
 
+void V4L2Camera::abortRequestBuffers(uint32_t stream_off_count) {
+  std::vector<std::shared_ptr<default_camera_hal::CaptureRequest>> requests;
   {
-    std::unique_lock<std::mutex> lock(in_flight_lock_);
-    res = device_->DequeueRequest(&request);
-    if (!res) {
-      if (request) {
-        completeRequest(request, res);
-        in_flight_buffer_count_--;
-      }
-      return true;
+    std::lock_guard<std::mutex> guard(in_flight_lock_);
+    // A flush or reconfiguration that turned the stream off since the wait
+    // began also fails the wait; the buffers queued since are fine.
+    if (stream_off_count != stream_off_count_) {
+      return;
     }
+    device_->AbortRequests(&requests);
+    in_flight_buffer_count_ = 0;
+    ++stream_off_count_;
   }
+  // With no buffers in flight, the next dequeue waits for a new request
+  // rather than on the device.
+  for (auto& request : requests) {
+    completeRequest(request, -ENODEV);
+  }
+}
 
-  if (res == -EAGAIN) {
-    // EAGAIN just means nothing to dequeue right now.
-    // Wait until something is available before looping again.
-    std::unique_lock<std::mutex> lock(in_flight_lock_);
-    while (in_flight_buffer_count_ == 0) {
-      buffers_in_flight_.wait(lock);
+bool V4L2Camera::convertRequestBuffers() {
+  // Get a dequeued buffer (blocks this thread until one is available).
+  // A single thread converts, so results complete in capture order.
+  DequeuedBuffer dequeued;
+  {
+    std::unique_lock<std::mutex> lock(convert_queue_lock_);
+    while (convert_queue_.empty()) {
+      buffers_dequeued_.wait(lock);
     }
-  } else {
-    HAL_LOGW("Device failed to dequeue buffer: %d", res);
+    dequeued = std::move(convert_queue_.front());
+    convert_queue_.pop();
+    converting_ = true;
+  }
+
+  int res = device_->ConvertRequest(dequeued.index);
+  if (res) {
+    HAL_LOGE("Device failed to convert buffer %u: %d", dequeued.index, res);
+  }
+  // The output buffers are written; a flush may return now. Completing the
+  // request comes after, as a flush holds the request tracker lock that
+  // completing takes.
+  {
+    std::lock_guard<std::mutex> guard(convert_queue_lock_);
+    converting_ = false;
+  }
+  conversion_done_.notify_all();
+  if (dequeued.request) {
+    completeRequest(dequeued.request, res);
   }
   return true;
 }
@@ -323,37 +428,14 @@ int V4L2Camera::setupStreams(camera3_stream_configuration_t* stream_config) {
   in_flight_buffer_count_ = 0;
 
   // stream_config should have been validated; assume at least 1 stream.
-  camera3_stream_t* stream = stream_config->streams[0];
+  // V4L2 captures a single stream, so capture the largest one; frames for
+  // the others are converted from it, cropped to their aspect ratio and
+  // scaled (see StreamFormat::FindLargestStream()).
+  camera3_stream_t* stream = StreamFormat::FindLargestStream(*stream_config);
   int format = stream->format;
   uint32_t width = stream->width;
   uint32_t height = stream->height;
 
-  if (stream_config->num_streams > 1) {
-    // TODO(b/29939583):  V4L2 doesn't actually support more than 1
-    // stream at a time. If not all streams are the same format
-    // and size, error. Note that this means the HAL is not spec-compliant.
-    // Technically, this error should be thrown during validation, but
-    // since it isn't a spec-valid error validation isn't set up to check it.
-    for (uint32_t i = 1; i < stream_config->num_streams; ++i) {
-      stream = stream_config->streams[i];
-      if (stream->format != format || stream->width != width ||
-          stream->height != height) {
-        HAL_LOGE(
-            "V4L2 only supports 1 stream configuration at a time "
-            "(stream 0 is format %d, width %u, height %u, "
-            "stream %d is format %d, width %u, height %u).",
-            format,
-            width,
-            height,
-            i,
-            stream->format,
-            stream->width,
-            stream->height);
-        return -EINVAL;
-      }
-    }
-  }
-
   // Ensure the stream is off.
   int res = device_->StreamOff();
   if (res) {
@@ -363,7 +445,8 @@ int V4L2Camera::setupStreams(camera3_stream_configuration_t* stream_config) {
 
   StreamFormat stream_format(format, width, height);
   uint32_t max_buffers = 0;
-  res = device_->SetFormat(stream_format, &max_buffers);
+  res = device_->SetFormat(
+      stream_format, stream_config->num_streams > 1, &max_buffers);
   if (res) {
     HAL_LOGE("Failed to set device to correct format for stream: %d.", res);
     return -ENODEV;
@@ -412,6 +495,16 @@ int V4L2Camera::setupStreams(camera3_stream_configuration_t* stream_config) {
     stream->data_space = HAL_DATASPACE_V0_JFIF;
   }
 
+  // Allocate what converting frames to the streams needs up front.
+  std::vector<camera3_stream_t*> streams(
+      stream_config->streams,
+      stream_config->streams + stream_config->num_streams);
+  res = device_->SetUpConversions(streams);
+  if (res) {
+    HAL_LOGE("Failed to set up conversions for streams: %d.", res);
+    return -ENODEV;
+  }
+
   return 0;
 }
 
@@ -88,6 +88,18 @@ class V4L2Camera : public default_camera_hal::Camera {
   bool enqueueRequestBuffers();
   // Retreive buffers from the device.
   bool dequeueRequestBuffers();
+  // Convert retrieved buffers into their requests' output buffers.
+  bool convertRequestBuffers();
+  // Turn the stream off after the device failed, and fail the requests of
+  // the buffers in flight, unless the stream was turned off since
+  // |stream_off_count|.
+  void abortRequestBuffers(uint32_t stream_off_count);
+
+  // A buffer retrieved from the device, waiting for conversion.
+  struct DequeuedBuffer {
+    uint32_t index;
+    std::shared_ptr<default_camera_hal::CaptureRequest> request;
+  };
 
   // V4L2 helper.
   std::shared_ptr<V4L2Wrapper> device_;
@@ -98,15 +110,28 @@ class V4L2Camera : public default_camera_hal::Camera {
       request_queue_;
   std::mutex in_flight_lock_;
   uint32_t in_flight_buffer_count_;
+  // Times the stream was turned off by a flush or a device failure, guarded
+  // by |in_flight_lock_|.
+  uint32_t stream_off_count_;
+  std::mutex convert_queue_lock_;
+  std::queue<DequeuedBuffer> convert_queue_;
+  // Whether the converter thread is writing the output buffers of a request,
+  // guarded by |convert_queue_lock_|. A flush waits for it to finish.
+  bool converting_;
   // Threads require holding an Android strong pointer.
   android::sp<android::Thread> buffer_enqueuer_;
   android::sp<android::Thread> buffer_dequeuer_;
+  android::sp<android::Thread> buffer_converter_;
   std::condition_variable requests_available_;
   std::condition_variable buffers_in_flight_;
+  std::condition_variable buffers_dequeued_;
+  std::condition_variable conversion_done_;
 
   int32_t max_input_streams_;
   std::array<int, 3> max_output_streams_;  // {raw, non-stalling, stalling}.
 
+  friend class V4L2CameraTest;
+
   DISALLOW_COPY_AND_ASSIGN(V4L2Camera);
 };
 
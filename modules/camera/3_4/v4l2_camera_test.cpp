@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "v4l2_camera.h"
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "v4l2_wrapper_mock.h"
+
+using default_camera_hal::CaptureRequest;
+using testing::Invoke;
+using testing::Return;
+using testing::Test;
+
+namespace v4l2_camera_hal {
+
+class V4L2CameraTest : public Test {
+ protected:
+  void SetUp() {
+    device_ = std::make_shared<V4L2WrapperMock>();
+    camera_.reset(new V4L2Camera(
+        0, device_, std::make_unique<Metadata>(PartialMetadataSet())));
+    callbacks_.process_capture_result = ProcessCaptureResult;
+    callbacks_.notify = Notify;
+    callbacks_.test = this;
+    camera_->mCallbackOps = &callbacks_;
+
+    stream_.max_buffers = 4;
+    camera3_stream_t* streams[] = {&stream_};
+    camera3_stream_configuration_t config{1, streams, 0, nullptr};
+    camera_->mInFlightTracker->SetStreamConfiguration(config);
+  }
+
+  // Track a request for |frame|, as processCaptureRequest() would.
+  std::shared_ptr<CaptureRequest> AddRequest(uint32_t frame) {
+    auto request = std::make_shared<CaptureRequest>();
+    request->frame_number = frame;
+    request->output_buffers.push_back({&stream_, nullptr, 0, -1, -1});
+    EXPECT_TRUE(camera_->mInFlightTracker->Add(request));
+    return request;
+  }
+
+  // Hand dequeued buffer |index| of |request| over for conversion, as the
+  // dequeue thread would.
+  void Dequeued(uint32_t index, std::shared_ptr<CaptureRequest> request) {
+    std::lock_guard<std::mutex> guard(camera_->convert_queue_lock_);
+    camera_->convert_queue_.push({index, request});
+  }
+
+  // One pass of the converter thread.
+  void ConvertNext() { camera_->convertRequestBuffers(); }
+
+  // A result sent to the framework, and whether the conversion of its frame
+  // had finished by then.
+  struct Result {
+    uint32_t frame_number;
+    bool converted;
+  };
+
+  std::vector<Result> Results() {
+    std::lock_guard<std::mutex> guard(results_lock_);
+    return results_;
+  }
+
+  std::shared_ptr<V4L2WrapperMock> device_;
+  std::unique_ptr<V4L2Camera> camera_;
+  camera3_stream_t stream_ = {};
+  std::atomic<bool> converted_{false};
+
+ private:
+  struct Callbacks : public camera3_callback_ops_t {
+    V4L2CameraTest* test;
+  };
+
+  static void ProcessCaptureResult(const camera3_callback_ops_t* ops,
+                                   const camera3_capture_result_t* result) {
+    V4L2CameraTest* test = static_cast<const Callbacks*>(ops)->test;
+    std::lock_guard<std::mutex> guard(test->results_lock_);
+    test->results_.push_back({result->frame_number, test->converted_});
+  }
+
+  static void Notify(const camera3_callback_ops_t*,
+                     const camera3_notify_msg_t*) {}
+
+  Callbacks callbacks_ = {};
+  std::mutex results_lock_;
+  std::vector<Result> results_;
+};
+
+TEST_F(V4L2CameraTest, FlushWaitsForConversion) {
+  std::promise<void> converting;
+  std::promise<void> unblock;
+  std::future<void> unblocked = unblock.get_future();
+  EXPECT_CALL(*device_, ConvertRequest(0))
+      .WillOnce(Invoke([&](uint32_t) {
+        converting.set_value();
+        unblocked.wait();
+        converted_ = true;
+        return 0;
+      }));
+  EXPECT_CALL(*device_, StreamOff()).WillOnce(Return(0));
+
+  Dequeued(0, AddRequest(1));
+  std::thread converter([this] { ConvertNext(); });
+  converting.get_future().wait();
+
+  // The output buffers are being written, so the flush must not hand them
+  // back to the framework yet.
+  std::future<int> flush =
+      std::async(std::launch::async, [this] { return camera_->flush(); });
+  EXPECT_EQ(flush.wait_for(std::chrono::milliseconds(50)),
+            std::future_status::timeout);
+  EXPECT_TRUE(Results().empty());
+
+  unblock.set_value();
+  EXPECT_EQ(flush.get(), 0);
+  converter.join();
+
+  // The request is completed once, after its conversion.
+  std::vector<Result> results = Results();
+  ASSERT_EQ(results.size(), 1u);
+  EXPECT_EQ(results[0].frame_number, 1u);
+  EXPECT_TRUE(results[0].converted);
+}
+
+}  // namespace v4l2_camera_hal
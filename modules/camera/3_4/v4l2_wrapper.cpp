@@ -24,18 +24,33 @@
 #include <limits>
 
 #include <android-base/unique_fd.h>
+#include <cutils/properties.h>
 #include <linux/videodev2.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include "arc/cached_frame.h"
+#include "arc/image_processor.h"
 
 namespace v4l2_camera_hal {
 
 using arc::AllocatedFrameBuffer;
 using arc::SupportedFormat;
 using arc::SupportedFormats;
+using arc::V4L2FrameBuffer;
 using default_camera_hal::CaptureRequest;
 
+// Set to let the device write straight into gralloc buffers when no format
+// conversion is needed. Only for platforms whose gralloc buffers are dma-bufs
+// laid out the way V4L2 describes the frame (no extra stride or padding).
+const char kDmabufImportProperty[] = "ro.vendor.camera.v4l2.dmabuf_import";
+
+// Device buffers to request for a format. A buffer is held from when it is
+// dequeued until its frame is converted, so with more than one the device
+// fills the next frame meanwhile; the driver may grant fewer.
+const uint32_t kNumBuffers = 4;
+
 const int32_t kStandardSizes[][2] = {
   {4096, 2160}, // 4KDCI (for USB camera)
   {3840, 2160}, // 4KUHD (for USB camera)
@@ -51,11 +66,24 @@ const int32_t kStandardSizes[][2] = {
 };
 
 V4L2Wrapper* V4L2Wrapper::NewV4L2Wrapper(const std::string device_path) {
-  return new V4L2Wrapper(device_path);
+  std::unique_ptr<V4L2Wrapper> wrapper(new V4L2Wrapper(device_path));
+  if (wrapper->wake_fd_.get() < 0) {
+    HAL_LOGE("Failed to create wake event for %s.", device_path.c_str());
+    return nullptr;
+  }
+  return wrapper.release();
 }
 
 V4L2Wrapper::V4L2Wrapper(const std::string device_path)
-    : device_path_(std::move(device_path)), connection_count_(0) {}
+    : device_path_(std::move(device_path)),
+      wake_fd_(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)),
+      dmabuf_import_(property_get_bool(kDmabufImportProperty, false)),
+      memory_(V4L2_MEMORY_USERPTR),
+      converting_frame_(nullptr),
+      converting_source_(nullptr),
+      converting_request_(nullptr),
+      conversion_pool_([this](size_t index) { return ConvertOutput(index); }),
+      connection_count_(0) {}
 
 V4L2Wrapper::~V4L2Wrapper() {}
 
@@ -114,6 +142,8 @@ void V4L2Wrapper::Disconnect() {
     return;
   }
 
+  // Don't leave a dequeue thread polling the fd about to be closed.
+  WakeWaiters();
   device_fd_.reset(-1);  // Includes close().
   format_.reset();
   {
@@ -132,6 +162,10 @@ int V4L2Wrapper::IoctlLocked(unsigned long request, T data) {
     HAL_LOGE("Device %s not connected.", device_path_.c_str());
     return -ENODEV;
   }
+  return DeviceIoctl(request, data);
+}
+
+int V4L2Wrapper::DeviceIoctl(unsigned long request, void* data) {
   return TEMP_FAILURE_RETRY(ioctl(device_fd_.get(), request, data));
 }
 
@@ -166,13 +200,40 @@ int V4L2Wrapper::StreamOff() {
     HAL_LOGE("STREAMOFF fails: %s", strerror(errno));
     return -ENODEV;
   }
+  ReleaseQueuedBuffers(nullptr);
+  HAL_LOGV("Stream turned off.");
+  return 0;
+}
+
+int V4L2Wrapper::AbortRequests(
+    std::vector<std::shared_ptr<CaptureRequest>>* requests) {
+  int res = 0;
+  if (format_) {
+    int32_t type = format_->type();
+    if (IoctlLocked(VIDIOC_STREAMOFF, &type) < 0) {
+      HAL_LOGE("STREAMOFF fails: %s", strerror(errno));
+      res = -ENODEV;
+    }
+  }
+  // A failed device won't fill its queued buffers either way.
+  ReleaseQueuedBuffers(requests);
+  return res;
+}
+
+void V4L2Wrapper::ReleaseQueuedBuffers(
+    std::vector<std::shared_ptr<CaptureRequest>>* requests) {
   std::lock_guard<std::mutex> lock(buffer_queue_lock_);
   for (auto& buffer : buffers_) {
+    // Dequeued buffers are still being read by ConvertRequest().
+    if (buffer.dequeued) {
+      continue;
+    }
+    if (requests && buffer.request) {
+      requests->push_back(std::move(buffer.request));
+    }
     buffer.active = false;
     buffer.request.reset();
   }
-  HAL_LOGV("Stream turned off.");
-  return 0;
 }
 
 int V4L2Wrapper::QueryControl(uint32_t control_id,
@@ -489,10 +550,12 @@ int V4L2Wrapper::GetFormatFrameDurationRange(
 }
 
 int V4L2Wrapper::SetFormat(const StreamFormat& desired_format,
+                           bool fan_out,
                            uint32_t* result_max_buffers) {
   HAL_LOG_ENTER();
 
-  if (format_ && desired_format == *format_) {
+  if (format_ && desired_format == *format_ &&
+      !(fan_out && memory_ == V4L2_MEMORY_DMABUF)) {
     HAL_LOGV("Already in correct format, skipping format setting.");
     *result_max_buffers = buffers_.size();
     return 0;
@@ -545,21 +608,51 @@ int V4L2Wrapper::SetFormat(const StreamFormat& desired_format,
   // Keep track of our new format.
   format_.reset(new StreamFormat(new_format));
 
-  // Format changed, request new buffers.
-  int res = RequestBuffers(1);
+  // Format changed, request new buffers, of the first memory type the device
+  // supports. With DMABUF the frames land in the output buffers, but that is
+  // only possible when they need no conversion and go to a single stream.
+  // MMAP buffers are the device's
+  // own, which every driver supports and which avoids pinning user pages on
+  // every QBUF; USERPTR is kept for drivers that can't export them.
+  std::vector<uint32_t> memory_types;
+  if (!fan_out && desired_format == resolved_format && dmabuf_import_) {
+    memory_types.push_back(V4L2_MEMORY_DMABUF);
+  }
+  memory_types.push_back(V4L2_MEMORY_MMAP);
+  memory_types.push_back(V4L2_MEMORY_USERPTR);
+  int res = -ENODEV;
+  for (uint32_t memory : memory_types) {
+    memory_ = memory;
+    res = RequestBuffers(kNumBuffers);
+    if (!res) {
+      break;
+    }
+    HAL_LOGV("Buffers of memory type %u unavailable.", memory);
+  }
   if (res) {
     HAL_LOGE("Requesting buffers for new format failed.");
     return res;
   }
+  HAL_LOGV("Using %zu buffers of memory type %u.", buffers_.size(), memory_);
   *result_max_buffers = buffers_.size();
   return 0;
 }
 
 int V4L2Wrapper::RequestBuffers(uint32_t num_requested) {
+  {
+    // Release frame buffers of the previous request. Mapped or exported MMAP
+    // buffers are in use as far as the device is concerned, so REQBUFS
+    // couldn't free them.
+    std::lock_guard<std::mutex> guard(buffer_queue_lock_);
+    for (auto& buffer : buffers_) {
+      buffer.camera_buffer.reset();
+    }
+  }
+
   v4l2_requestbuffers req_buffers;
   memset(&req_buffers, 0, sizeof(req_buffers));
   req_buffers.type = format_->type();
-  req_buffers.memory = V4L2_MEMORY_USERPTR;
+  req_buffers.memory = memory_;
   req_buffers.count = num_requested;
 
   int res = IoctlLocked(VIDIOC_REQBUFS, &req_buffers);
@@ -575,6 +668,68 @@ int V4L2Wrapper::RequestBuffers(uint32_t num_requested) {
     return -ENODEV;
   }
   buffers_.resize(req_buffers.count);
+
+  for (uint32_t i = 0; i < req_buffers.count; ++i) {
+    res = SetUpBuffer(i);
+    if (res) {
+      RequestBuffers(0);
+      return res;
+    }
+  }
+  return 0;
+}
+
+int V4L2Wrapper::SetUpBuffer(uint32_t index) {
+  v4l2_buffer device_buffer;
+  memset(&device_buffer, 0, sizeof(device_buffer));
+  device_buffer.type = format_->type();
+  device_buffer.memory = memory_;
+  device_buffer.index = index;
+  if (IoctlLocked(VIDIOC_QUERYBUF, &device_buffer) < 0) {
+    HAL_LOGE("QUERYBUF fails: %s", strerror(errno));
+    return -ENODEV;
+  }
+
+  std::shared_ptr<arc::FrameBuffer> camera_buffer;
+  switch (memory_) {
+    case V4L2_MEMORY_USERPTR: {
+      // A heap buffer the device fills through its user pointer.
+      auto allocated =
+          std::make_shared<AllocatedFrameBuffer>(device_buffer.length);
+      allocated->SetWidth(format_->width());
+      allocated->SetHeight(format_->height());
+      camera_buffer = allocated;
+      break;
+    }
+    case V4L2_MEMORY_MMAP: {
+      // Export the device buffer as a dma-buf and map it for reading.
+      v4l2_exportbuffer export_buffer;
+      memset(&export_buffer, 0, sizeof(export_buffer));
+      export_buffer.type = format_->type();
+      export_buffer.index = index;
+      export_buffer.flags = O_RDONLY | O_CLOEXEC;
+      if (IoctlLocked(VIDIOC_EXPBUF, &export_buffer) < 0) {
+        HAL_LOGE("EXPBUF fails: %s", strerror(errno));
+        return -ENODEV;
+      }
+      camera_buffer = std::make_shared<V4L2FrameBuffer>(
+          base::ScopedFD(export_buffer.fd), device_buffer.length,
+          format_->width(), format_->height(), format_->v4l2_pixel_format());
+      if (camera_buffer->Map()) {
+        HAL_LOGE("Failed to map device buffer %u.", index);
+        return -ENODEV;
+      }
+      break;
+    }
+    default:
+      // The device fills the output buffer of each request.
+      return 0;
+  }
+  camera_buffer->SetFourcc(format_->v4l2_pixel_format());
+  camera_buffer->SetDataSize(device_buffer.length);
+
+  std::lock_guard<std::mutex> guard(buffer_queue_lock_);
+  buffers_[index].camera_buffer = camera_buffer;
   return 0;
 }
 
@@ -621,21 +776,28 @@ int V4L2Wrapper::EnqueueRequest(
     return -ENODEV;
   }
 
-  // Setup our request context and fill in the user pointer field.
+  // Setup our request context and point the device at the memory to fill.
+  // MMAP buffers need nothing, the device fills its own.
   RequestContext* request_context;
-  void* data;
   {
     std::lock_guard<std::mutex> guard(buffer_queue_lock_);
     request_context = &buffers_[index];
-    request_context->camera_buffer->SetDataSize(device_buffer.length);
-    request_context->camera_buffer->Reset();
-    request_context->camera_buffer->SetFourcc(format_->v4l2_pixel_format());
-    request_context->camera_buffer->SetWidth(format_->width());
-    request_context->camera_buffer->SetHeight(format_->height());
     request_context->request = request;
-    data = request_context->camera_buffer->GetData();
+    if (memory_ == V4L2_MEMORY_USERPTR) {
+      device_buffer.m.userptr = reinterpret_cast<unsigned long>(
+          request_context->camera_buffer->GetData());
+    }
+  }
+  if (memory_ == V4L2_MEMORY_DMABUF) {
+    buffer_handle_t handle = *request->output_buffers[0].buffer;
+    if (handle->numFds < 1) {
+      HAL_LOGE("Output buffer has no dma-buf to import.");
+      std::lock_guard<std::mutex> guard(buffer_queue_lock_);
+      request_context->request.reset();
+      return -EINVAL;
+    }
+    device_buffer.m.fd = handle->data[0];
   }
-  device_buffer.m.userptr = reinterpret_cast<unsigned long>(data);
 
   // Pass the buffer to the camera.
   if (IoctlLocked(VIDIOC_QBUF, &device_buffer) < 0) {
@@ -650,7 +812,8 @@ int V4L2Wrapper::EnqueueRequest(
   return 0;
 }
 
-int V4L2Wrapper::DequeueRequest(std::shared_ptr<CaptureRequest>* request) {
+int V4L2Wrapper::DequeueRequest(std::shared_ptr<CaptureRequest>* request,
+                                uint32_t* index) {
   if (!format_) {
     HAL_LOGV(
         "Format not set, so stream can't be on, "
@@ -661,7 +824,7 @@ int V4L2Wrapper::DequeueRequest(std::shared_ptr<CaptureRequest>* request) {
   v4l2_buffer buffer;
   memset(&buffer, 0, sizeof(buffer));
   buffer.type = format_->type();
-  buffer.memory = V4L2_MEMORY_USERPTR;
+  buffer.memory = memory_;
   int res = IoctlLocked(VIDIOC_DQBUF, &buffer);
   if (res) {
     if (errno == EAGAIN) {
@@ -676,49 +839,190 @@ int V4L2Wrapper::DequeueRequest(std::shared_ptr<CaptureRequest>* request) {
 
   std::lock_guard<std::mutex> guard(buffer_queue_lock_);
   RequestContext* request_context = &buffers_[buffer.index];
-
-  // Lock the camera stream buffer for painting.
-  const camera3_stream_buffer_t* stream_buffer =
-      &request_context->request->output_buffers[0];
-  uint32_t fourcc =
-      StreamFormat::HalToV4L2PixelFormat(stream_buffer->stream->format);
-
+  request_context->dequeued = true;
+  if (request_context->camera_buffer && buffer.bytesused > 0) {
+    // Compressed frames fill less than the whole buffer.
+    request_context->camera_buffer->SetDataSize(buffer.bytesused);
+  }
   if (request) {
     *request = request_context->request;
   }
+  *index = buffer.index;
+  return 0;
+}
+
+// Whether the frame in |camera_buffer| has to be converted for |stream|,
+// rather than copied as is.
+static bool NeedsConversion(const arc::FrameBuffer& camera_buffer,
+                            const camera3_stream_t& stream) {
+  return camera_buffer.GetFourcc() !=
+             StreamFormat::HalToV4L2PixelFormat(stream.format) ||
+         camera_buffer.GetWidth() != stream.width ||
+         camera_buffer.GetHeight() != stream.height;
+}
+
+int V4L2Wrapper::ConvertRequest(uint32_t index) {
+  std::shared_ptr<arc::FrameBuffer> camera_buffer;
+  std::shared_ptr<CaptureRequest> request;
+  {
+    std::lock_guard<std::mutex> guard(buffer_queue_lock_);
+    if (index >= buffers_.size() || !buffers_[index].dequeued) {
+      HAL_LOGE("Buffer %u was not dequeued.", index);
+      return -EINVAL;
+    }
+    camera_buffer = buffers_[index].camera_buffer;
+    request = buffers_[index].request;
+  }
+
+  // The buffer is ours until it is released below: EnqueueRequest() only picks
+  // buffers that are not active, and StreamOff() skips dequeued ones.
+  // Without a camera buffer (DMABUF memory), the device has already written
+  // the frame to the output buffer.
+  int res = 0;
+  if (camera_buffer) {
+    res = ConvertFrames(camera_buffer.get(), *request);
+  }
+
+  // Mark the buffer as not in flight.
+  int release_res = ReleaseRequest(index);
+  return res ? res : release_res;
+}
+
+int V4L2Wrapper::ReleaseRequest(uint32_t index) {
+  std::lock_guard<std::mutex> guard(buffer_queue_lock_);
+  if (index >= buffers_.size() || !buffers_[index].dequeued) {
+    HAL_LOGE("Buffer %u was not dequeued.", index);
+    return -EINVAL;
+  }
+  buffers_[index].request.reset();
+  buffers_[index].dequeued = false;
+  buffers_[index].active = false;
+  return 0;
+}
+
+int V4L2Wrapper::ConvertFrames(const arc::FrameBuffer* camera_buffer,
+                               const CaptureRequest& request) {
+  std::lock_guard<std::mutex> guard(conversion_lock_);
+
+  size_t count = request.output_buffers.size();
+  if (count > converting_buffers_.size()) {
+    HAL_LOGE("Request has %zu output buffers, only %zu streams are set up.",
+             count, converting_buffers_.size());
+    return -EINVAL;
+  }
+  // Each output buffer uses the conversion buffers of its own stream, set up
+  // with the streams; looking them up doesn't allocate.
+  for (size_t i = 0; i < count; ++i) {
+    const camera3_stream_t* stream = request.output_buffers[i].stream;
+    auto buffers = conversion_buffers_.find(stream);
+    if (buffers == conversion_buffers_.end()) {
+      HAL_LOGE("Stream %p was not set up for conversion.", stream);
+      return -EINVAL;
+    }
+    converting_buffers_[i] = &buffers->second;
+  }
+
+  // Decode the frame to YU12 once, for every output buffer whose stream
+  // needs a conversion.
+  bool decode = std::any_of(
+      request.output_buffers.begin(), request.output_buffers.end(),
+      [camera_buffer](const camera3_stream_buffer_t& stream_buffer) {
+        return NeedsConversion(*camera_buffer, *stream_buffer.stream);
+      });
+  if (decode) {
+    int res = cached_frame_.SetSource(camera_buffer, 0);
+    if (res) {
+      HAL_LOGE("Failed to decode frame: %d", res);
+      cached_frame_.UnsetSource();
+      return res;
+    }
+  }
+
+  // Write the output buffers in parallel, on the workers and this thread.
+  converting_frame_ = camera_buffer;
+  converting_source_ = decode ? &cached_frame_ : nullptr;
+  converting_request_ = &request;
+  int res = conversion_pool_.Run(count);
+  converting_request_ = nullptr;
+  cached_frame_.UnsetSource();
+  return res;
+}
+
+int V4L2Wrapper::ConvertOutput(size_t index) {
+  return ConvertFrame(converting_frame_, converting_source_,
+                      converting_buffers_[index],
+                      converting_request_->output_buffers[index],
+                      converting_request_->settings);
+}
+
+int V4L2Wrapper::ConvertFrame(const arc::FrameBuffer* camera_buffer,
+                              const arc::CachedFrame* cached_frame,
+                              arc::ConversionBuffers* buffers,
+                              const camera3_stream_buffer_t& stream_buffer,
+                              const android::CameraMetadata& settings) {
+  uint32_t fourcc =
+      StreamFormat::HalToV4L2PixelFormat(stream_buffer.stream->format);
 
   // Note that the device buffer length is passed to the output frame. If the
   // GrallocFrameBuffer does not have support for the transformation to
   // |fourcc|, it will assume that the amount of data to lock is based on
-  // |buffer.length|, otherwise it will use the ImageProcessor::ConvertedSize.
+  // the device buffer length, otherwise it will use the
+  // ImageProcessor::ConvertedSize.
   arc::GrallocFrameBuffer output_frame(
-      *stream_buffer->buffer, stream_buffer->stream->width,
-      stream_buffer->stream->height, fourcc, buffer.length,
-      stream_buffer->stream->usage);
-  res = output_frame.Map();
-  if (res) {
+      *stream_buffer.buffer, stream_buffer.stream->width,
+      stream_buffer.stream->height, fourcc, camera_buffer->GetBufferSize(),
+      stream_buffer.stream->usage);
+  if (output_frame.Map()) {
     HAL_LOGE("Failed to map output frame.");
-    request_context->request.reset();
     return -EINVAL;
   }
-  if (request_context->camera_buffer->GetFourcc() == fourcc &&
-      request_context->camera_buffer->GetWidth() ==
-          stream_buffer->stream->width &&
-      request_context->camera_buffer->GetHeight() ==
-          stream_buffer->stream->height) {
+  if (!NeedsConversion(*camera_buffer, *stream_buffer.stream)) {
     // If no format conversion needs to be applied, directly copy the data over.
-    memcpy(output_frame.GetData(), request_context->camera_buffer->GetData(),
-           request_context->camera_buffer->GetDataSize());
-  } else {
-    // Perform the format conversion.
-    arc::CachedFrame cached_frame;
-    cached_frame.SetSource(request_context->camera_buffer.get(), 0);
-    cached_frame.Convert(request_context->request->settings, &output_frame);
+    memcpy(output_frame.GetData(), camera_buffer->GetData(),
+           camera_buffer->GetDataSize());
+    return 0;
   }
+  // Perform the format conversion.
+  return cached_frame->Convert(settings, &output_frame, buffers);
+}
 
-  request_context->request.reset();
-  // Mark the buffer as not in flight.
-  request_context->active = false;
+int V4L2Wrapper::SetUpConversions(
+    const std::vector<camera3_stream_t*>& streams) {
+  if (!format_) {
+    HAL_LOGE("Stream format must be set before setting up conversions.");
+    return -EINVAL;
+  }
+
+  std::lock_guard<std::mutex> guard(conversion_lock_);
+  // Join the workers of the previous configuration.
+  conversion_pool_.Stop();
+  int res = cached_frame_.Reserve(format_->width(), format_->height());
+  if (res) {
+    HAL_LOGE("Failed to allocate YU12 frame: %d", res);
+    return res;
+  }
+
+  conversion_buffers_.clear();
+  for (const camera3_stream_t* stream : streams) {
+    arc::ConversionBuffers* buffers = &conversion_buffers_[stream];
+    if (stream->width != format_->width() ||
+        stream->height != format_->height()) {
+      buffers->scaled_frame.reset(
+          new arc::AllocatedFrameBuffer(arc::ImageProcessor::GetConvertedSize(
+              V4L2_PIX_FMT_YUV420, stream->width, stream->height)));
+    }
+    if (StreamFormat::HalToV4L2PixelFormat(stream->format) ==
+        V4L2_PIX_FMT_JPEG) {
+      // Compressed images are expected to be smaller than their YU12 source.
+      buffers->jpeg_compressor.Reserve(arc::ImageProcessor::GetConvertedSize(
+          V4L2_PIX_FMT_YUV420, stream->width, stream->height));
+    }
+  }
+  converting_buffers_.assign(streams.size(), nullptr);
+  // The thread converting a frame writes one output buffer itself.
+  if (!streams.empty()) {
+    conversion_pool_.Start(streams.size() - 1);
+  }
   return 0;
 }
 
@@ -733,4 +1037,43 @@ int V4L2Wrapper::GetInFlightBufferCount() {
   return count;
 }
 
+int V4L2Wrapper::WaitForBuffer() {
+  int device_fd;
+  {
+    std::lock_guard<std::mutex> lock(device_lock_);
+    if (!connected()) {
+      HAL_LOGE("Device %s not connected.", device_path_.c_str());
+      return -ENODEV;
+    }
+    device_fd = device_fd_.get();
+  }
+
+  // The device signals POLLIN when a filled buffer can be dequeued,
+  // and POLLERR while it isn't streaming or has no buffers queued.
+  pollfd fds[] = {{device_fd, POLLIN, 0}, {wake_fd_.get(), POLLIN, 0}};
+  int res = TEMP_FAILURE_RETRY(poll(fds, 2, -1));
+  if (res < 0) {
+    HAL_LOGE("Failed to poll device: %s", strerror(errno));
+    return -ENODEV;
+  }
+
+  if (fds[1].revents & POLLIN) {
+    // Consume the wake event, so the next wait blocks again.
+    eventfd_t value;
+    eventfd_read(wake_fd_.get(), &value);
+    return -EINTR;
+  }
+  if (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+    HAL_LOGV("Device %s can't be polled for buffers.", device_path_.c_str());
+    return -EIO;
+  }
+  return 0;
+}
+
+void V4L2Wrapper::WakeWaiters() {
+  if (eventfd_write(wake_fd_.get(), 1)) {
+    HAL_LOGE("Failed to wake waiters: %s", strerror(errno));
+  }
+}
+
 }  // namespace v4l2_camera_hal
@@ -18,6 +18,7 @@
 #define V4L2_CAMERA_HAL_V4L2_WRAPPER_H_
 
 #include <array>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <set>
@@ -25,10 +26,12 @@
 #include <vector>
 
 #include <android-base/unique_fd.h>
+#include "arc/cached_frame.h"
 #include "arc/common_types.h"
 #include "arc/frame_buffer.h"
 #include "capture_request.h"
 #include "common.h"
+#include "conversion_pool.h"
 #include "stream_format.h"
 
 namespace v4l2_camera_hal {
@@ -61,6 +64,12 @@ class V4L2Wrapper {
   // Turn the stream on or off.
   virtual int StreamOn();
   virtual int StreamOff();
+  // Turn the stream off after the device failed, and move the requests of
+  // the buffers still queued on it, which it will never fill, into
+  // |requests|. They are released even if the stream can't be turned off.
+  virtual int AbortRequests(
+      std::vector<std::shared_ptr<default_camera_hal::CaptureRequest>>*
+          requests);
   // Manage controls.
   virtual int QueryControl(uint32_t control_id, v4l2_query_ext_ctrl* result);
   virtual int GetControl(uint32_t control_id, int32_t* value);
@@ -78,14 +87,37 @@ class V4L2Wrapper {
       uint32_t v4l2_format,
       const std::array<int32_t, 2>& size,
       std::array<int64_t, 2>* duration_range);
+  // |fan_out| is set when frames are written to more than one output stream,
+  // which rules out the device writing to an output buffer itself.
   virtual int SetFormat(const StreamFormat& desired_format,
+                        bool fan_out,
                         uint32_t* result_max_buffers);
   // Manage buffers.
   virtual int EnqueueRequest(
       std::shared_ptr<default_camera_hal::CaptureRequest> request);
+  // Dequeue a filled buffer from the device. The buffer stays in flight, and
+  // its request incomplete, until ConvertRequest() is called with |index|.
   virtual int DequeueRequest(
-      std::shared_ptr<default_camera_hal::CaptureRequest>* request);
+      std::shared_ptr<default_camera_hal::CaptureRequest>* request,
+      uint32_t* index);
+  // Convert the frame in dequeued buffer |index| into every output buffer of
+  // its request, then release the buffer for the next EnqueueRequest(). Safe
+  // to call from another thread than the one dequeueing; the conversion is
+  // done without holding any lock the enqueue and dequeue paths need.
+  virtual int ConvertRequest(uint32_t index);
+  // Release dequeued buffer |index| for the next EnqueueRequest() without
+  // converting its frame, e.g. when its request was flushed.
+  virtual int ReleaseRequest(uint32_t index);
   virtual int GetInFlightBufferCount();
+  // Allocate the buffers converting frames to |streams| needs, once the format
+  // is set, so that capturing doesn't allocate them frame after frame.
+  virtual int SetUpConversions(const std::vector<camera3_stream_t*>& streams);
+  // Block until the device has a filled buffer for DequeueRequest(), or until
+  // WakeWaiters() is called. Returns 0 when a buffer is ready, -EINTR when
+  // woken, and a negative error code if the device can't be waited on.
+  virtual int WaitForBuffer();
+  // Wake a thread blocked in WaitForBuffer(), e.g. to flush or disconnect.
+  virtual void WakeWaiters();
 
  private:
   // Constructor is private to allow failing on bad input.
@@ -99,8 +131,32 @@ class V4L2Wrapper {
   // Perform an ioctl call in a thread-safe fashion.
   template <typename T>
   int IoctlLocked(unsigned long request, T data);
-  // Request/release userspace buffer mode via VIDIOC_REQBUFS.
+  // Perform an ioctl call on the device fd. Virtual so that tests can stand
+  // in for the driver.
+  virtual int DeviceIoctl(unsigned long request, void* data);
+  // Request/release buffers of memory type |memory_| via VIDIOC_REQBUFS.
   int RequestBuffers(uint32_t num_buffers);
+  // Release the buffers that aren't dequeued, as turning the stream off
+  // returns them from the device. Their requests go into |requests| if given.
+  void ReleaseQueuedBuffers(
+      std::vector<std::shared_ptr<default_camera_hal::CaptureRequest>>*
+          requests);
+  // Set up the frame buffer the device fills for buffer |index|.
+  int SetUpBuffer(uint32_t index);
+  // Write the frame in |camera_buffer| to every output buffer of |request|.
+  int ConvertFrames(const arc::FrameBuffer* camera_buffer,
+                    const default_camera_hal::CaptureRequest& request);
+  // Write the frame in |camera_buffer| to |stream_buffer|, converting it to
+  // the stream's format if needed, from |cached_frame| holding the frame
+  // decoded to YU12 and with the stream's |buffers|.
+  int ConvertFrame(const arc::FrameBuffer* camera_buffer,
+                   const arc::CachedFrame* cached_frame,
+                   arc::ConversionBuffers* buffers,
+                   const camera3_stream_buffer_t& stream_buffer,
+                   const android::CameraMetadata& settings);
+  // Write output buffer |index| of the frame ConvertFrames() is converting.
+  // Run by |conversion_pool_|.
+  int ConvertOutput(size_t index);
 
   inline bool connected() { return device_fd_.get() >= 0; }
 
@@ -111,14 +167,35 @@ class V4L2Wrapper {
   const std::string device_path_;
   // The opened device fd.
   android::base::unique_fd device_fd_;
+  // Event fd signaled by WakeWaiters() to interrupt WaitForBuffer().
+  android::base::unique_fd wake_fd_;
   // The underlying gralloc module.
   // std::unique_ptr<V4L2Gralloc> gralloc_;
   // Whether or not the device supports the extended control query.
   bool extended_query_supported_;
+  // Whether output buffers may be imported as DMABUF device buffers.
+  bool dmabuf_import_;
   // The format this device is set up for.
   std::unique_ptr<StreamFormat> format_;
+  // The memory type of the device buffers (V4L2_MEMORY_*).
+  uint32_t memory_;
   // Lock protecting use of the buffer tracker.
   std::mutex buffer_queue_lock_;
+  // Lock protecting use of the conversion buffers.
+  std::mutex conversion_lock_;
+  // The frame being converted, decoded to YU12.
+  arc::CachedFrame cached_frame_;
+  // Buffers for converting frames to each stream.
+  std::map<const camera3_stream_t*, arc::ConversionBuffers> conversion_buffers_;
+  // The frame ConvertFrames() is converting, and the conversion buffers of
+  // each of its output buffers, with room for as many as there are streams.
+  const arc::FrameBuffer* converting_frame_;
+  const arc::CachedFrame* converting_source_;
+  const default_camera_hal::CaptureRequest* converting_request_;
+  std::vector<arc::ConversionBuffers*> converting_buffers_;
+  // Workers writing the output buffers of a frame in parallel, one for each
+  // stream beyond the first, started by SetUpConversions().
+  ConversionPool conversion_pool_;
   // Lock protecting use of the device.
   std::mutex device_lock_;
   // Lock protecting connecting/disconnecting the device.
@@ -133,13 +210,18 @@ class V4L2Wrapper {
   class RequestContext {
    public:
     RequestContext()
-        : active(false),
-          camera_buffer(std::make_shared<arc::AllocatedFrameBuffer>(0)){};
+        : active(false), dequeued(false){};
     ~RequestContext(){};
     // Indicates whether this request context is in use.
     bool active;
-    // Buffer handles of the context.
-    std::shared_ptr<arc::AllocatedFrameBuffer> camera_buffer;
+    // Indicates whether the buffer was dequeued and waits for conversion.
+    // Stopping the stream leaves such buffers to ConvertRequest().
+    bool dequeued;
+    // Buffer handles of the context. |camera_buffer| is the buffer the device
+    // fills: a heap buffer with USERPTR memory, the mapped device buffer with
+    // MMAP memory, and none with DMABUF memory, where the device fills the
+    // output buffer of |request| directly.
+    std::shared_ptr<arc::FrameBuffer> camera_buffer;
     std::shared_ptr<default_camera_hal::CaptureRequest> request;
   };
 
@@ -43,12 +43,32 @@ class V4L2WrapperMock : public V4L2Wrapper {
                int(uint32_t,
                    const std::array<int32_t, 2>&,
                    std::array<int64_t, 2>*));
-  MOCK_METHOD2(SetFormat, int(const StreamFormat& desired_format,
+  MOCK_METHOD3(SetFormat, int(const StreamFormat& desired_format,
+                              bool fan_out,
                               uint32_t* result_max_buffers));
   MOCK_METHOD2(EnqueueBuffer,
                int(const camera3_stream_buffer_t* camera_buffer,
                    uint32_t* enqueued_index));
   MOCK_METHOD1(DequeueBuffer, int(uint32_t* dequeued_index));
+  MOCK_METHOD1(ConvertRequest, int(uint32_t index));
+  MOCK_METHOD2(DeviceIoctl, int(unsigned long request, void* data));
+
+  // Stand in for the device fd, which WaitForBuffer() polls; e.g. the read end
+  // of a pipe, readable when a "buffer" has been written to it.
+  void SetDeviceFd(int fd) { device_fd_.reset(fd); }
+
+  // Set the formats the device captures, as if read from it when connecting.
+  void SetSupportedFormats(const arc::SupportedFormats& formats) {
+    supported_formats_ = formats;
+    qualified_formats_ = formats;
+  }
+  void SetDmabufImport(bool dmabuf_import) { dmabuf_import_ = dmabuf_import; }
+  uint32_t memory() const { return memory_; }
+  // The frame buffer the device fills for buffer |index|.
+  std::shared_ptr<arc::FrameBuffer> CameraBuffer(uint32_t index) {
+    std::lock_guard<std::mutex> guard(buffer_queue_lock_);
+    return buffers_[index].camera_buffer;
+  }
 };
 
 }  // namespace v4l2_camera_hal
@@ -0,0 +1,365 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "v4l2_wrapper_mock.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <future>
+#include <map>
+#include <set>
+#include <vector>
+
+#include <cutils/native_handle.h>
+#include <gtest/gtest.h>
+
+using testing::_;
+using testing::Invoke;
+using testing::Test;
+
+namespace v4l2_camera_hal {
+
+class V4L2WrapperTest : public Test {
+ protected:
+  void SetUp() {
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+    device_.SetDeviceFd(fds[0]);
+    device_writer_.reset(fds[1]);
+  }
+
+  // Make the mocked device fd readable, as a filled buffer would.
+  void FillBuffer() {
+    char frame = 0;
+    ASSERT_EQ(write(device_writer_.get(), &frame, 1), 1);
+  }
+
+  V4L2WrapperMock device_;
+  android::base::unique_fd device_writer_;
+};
+
+TEST_F(V4L2WrapperTest, WaitForFilledBuffer) {
+  FillBuffer();
+  EXPECT_EQ(device_.WaitForBuffer(), 0);
+}
+
+TEST_F(V4L2WrapperTest, WaitBlocksUntilBufferFilled) {
+  std::future<int> wait = std::async(
+      std::launch::async, [this] { return device_.WaitForBuffer(); });
+  EXPECT_EQ(wait.wait_for(std::chrono::milliseconds(50)),
+            std::future_status::timeout);
+  FillBuffer();
+  EXPECT_EQ(wait.get(), 0);
+}
+
+TEST_F(V4L2WrapperTest, WakeWaiters) {
+  std::future<int> wait = std::async(
+      std::launch::async, [this] { return device_.WaitForBuffer(); });
+  EXPECT_EQ(wait.wait_for(std::chrono::milliseconds(50)),
+            std::future_status::timeout);
+  device_.WakeWaiters();
+  EXPECT_EQ(wait.get(), -EINTR);
+
+  // The wake up is consumed, so the next wait is for a buffer again.
+  FillBuffer();
+  EXPECT_EQ(device_.WaitForBuffer(), 0);
+}
+
+TEST_F(V4L2WrapperTest, WakeBeforeWait) {
+  // A wake up sent before the wait, e.g. by a flush racing the dequeue thread,
+  // is not lost.
+  device_.WakeWaiters();
+  EXPECT_EQ(device_.WaitForBuffer(), -EINTR);
+}
+
+TEST_F(V4L2WrapperTest, WaitOnFailedDevice) {
+  device_writer_.reset();
+  EXPECT_EQ(device_.WaitForBuffer(), -EIO);
+}
+
+TEST_F(V4L2WrapperTest, WaitDisconnected) {
+  device_.SetDeviceFd(-1);
+  EXPECT_EQ(device_.WaitForBuffer(), -ENODEV);
+}
+
+// Stands in for a V4L2 driver in the buffer ioctls. It offers up to
+// |max_count| buffers of the memory types in |memory_types|, exports MMAP
+// buffers as memfds if |expbuf_supported|, and writes |frame| into a queued
+// buffer when it is dequeued.
+class FakeDriver {
+ public:
+  int Ioctl(unsigned long request, void* data) {
+    switch (request) {
+      case VIDIOC_S_FMT: {
+        v4l2_format* format = static_cast<v4l2_format*>(data);
+        format->fmt.pix.bytesperline = format->fmt.pix.width * 2;
+        format->fmt.pix.sizeimage = frame.size();
+        return 0;
+      }
+      case VIDIOC_REQBUFS:
+        return RequestBuffers(static_cast<v4l2_requestbuffers*>(data));
+      case VIDIOC_QUERYBUF: {
+        v4l2_buffer* buffer = static_cast<v4l2_buffer*>(data);
+        if (buffer->index >= count) {
+          return Fail(EINVAL);
+        }
+        buffer->memory = memory;
+        buffer->length = frame.size();
+        return 0;
+      }
+      case VIDIOC_EXPBUF:
+        return ExportBuffer(static_cast<v4l2_exportbuffer*>(data));
+      case VIDIOC_QBUF: {
+        v4l2_buffer* buffer = static_cast<v4l2_buffer*>(data);
+        if (buffer->index >= count || buffer->memory != memory ||
+            (memory == V4L2_MEMORY_USERPTR && !buffer->m.userptr) ||
+            (memory == V4L2_MEMORY_DMABUF && buffer->m.fd < 0)) {
+          return Fail(EINVAL);
+        }
+        queued.push_back(*buffer);
+        return 0;
+      }
+      case VIDIOC_DQBUF:
+        return DequeueBuffer(static_cast<v4l2_buffer*>(data));
+      case VIDIOC_STREAMON:
+      case VIDIOC_STREAMOFF:
+        return 0;
+      default:
+        return Fail(ENOTTY);
+    }
+  }
+
+  std::set<uint32_t> memory_types;
+  uint32_t max_count = 32;
+  bool expbuf_supported = true;
+  std::vector<uint8_t> frame = std::vector<uint8_t>(16, 0x5a);
+  // The memory type and number of the buffers requested last.
+  uint32_t memory = 0;
+  uint32_t count = 0;
+  std::deque<v4l2_buffer> queued;
+
+ private:
+  static int Fail(int error) {
+    errno = error;
+    return -1;
+  }
+
+  int RequestBuffers(v4l2_requestbuffers* request) {
+    if (!memory_types.count(request->memory)) {
+      return Fail(EINVAL);
+    }
+    memory = request->memory;
+    count = std::min(request->count, max_count);
+    request->count = count;
+    queued.clear();
+    exported_.clear();
+    return 0;
+  }
+
+  int ExportBuffer(v4l2_exportbuffer* request) {
+    if (!expbuf_supported || memory != V4L2_MEMORY_MMAP ||
+        request->index >= count) {
+      return Fail(EINVAL);
+    }
+    int fd = memfd_create("v4l2_buffer", MFD_CLOEXEC);
+    if (fd < 0 || ftruncate(fd, frame.size())) {
+      return -1;
+    }
+    // The wrapper owns the exported fd; keep another to write frames.
+    exported_[request->index].reset(dup(fd));
+    request->fd = fd;
+    return 0;
+  }
+
+  int DequeueBuffer(v4l2_buffer* buffer) {
+    if (queued.empty()) {
+      return Fail(EAGAIN);
+    }
+    v4l2_buffer filled = queued.front();
+    queued.pop_front();
+    switch (memory) {
+      case V4L2_MEMORY_USERPTR:
+        memcpy(reinterpret_cast<void*>(filled.m.userptr), frame.data(),
+               frame.size());
+        break;
+      case V4L2_MEMORY_MMAP:
+        pwrite(exported_[filled.index].get(), frame.data(), frame.size(), 0);
+        break;
+      case V4L2_MEMORY_DMABUF:
+        pwrite(filled.m.fd, frame.data(), frame.size(), 0);
+        break;
+    }
+    buffer->index = filled.index;
+    buffer->bytesused = frame.size();
+    return 0;
+  }
+
+  std::map<uint32_t, android::base::unique_fd> exported_;
+};
+
+class V4L2WrapperBufferTest : public V4L2WrapperTest {
+ protected:
+  void SetUp() {
+    V4L2WrapperTest::SetUp();
+    EXPECT_CALL(device_, DeviceIoctl(_, _))
+        .WillRepeatedly(Invoke(&driver_, &FakeDriver::Ioctl));
+    device_.SetSupportedFormats({format_});
+  }
+
+  // Set the format through the wrapper itself, not its mock.
+  int SetFormat(bool fan_out) {
+    uint32_t max_buffers = 0;
+    return SetFormat(fan_out, &max_buffers);
+  }
+  int SetFormat(bool fan_out, uint32_t* max_buffers) {
+    return device_.V4L2Wrapper::SetFormat(StreamFormat(format_), fan_out,
+                                          max_buffers);
+  }
+
+  // Dequeue the next filled buffer, which must hold |request|, as |index|.
+  void Dequeue(std::shared_ptr<default_camera_hal::CaptureRequest> request,
+               uint32_t index) {
+    std::shared_ptr<default_camera_hal::CaptureRequest> dequeued;
+    uint32_t dequeued_index = index + 1;
+    ASSERT_EQ(device_.DequeueRequest(&dequeued, &dequeued_index), 0);
+    EXPECT_EQ(dequeued, request);
+    EXPECT_EQ(dequeued_index, index);
+  }
+
+  // Capture a frame into buffer 0 as a request, and release it.
+  void Capture(std::shared_ptr<default_camera_hal::CaptureRequest> request) {
+    ASSERT_EQ(device_.EnqueueRequest(request), 0);
+    EXPECT_EQ(device_.GetInFlightBufferCount(), 1);
+    uint32_t index = 0;
+    Dequeue(request, index);
+
+    std::shared_ptr<arc::FrameBuffer> camera_buffer = device_.CameraBuffer(0);
+    if (camera_buffer) {
+      ASSERT_EQ(camera_buffer->GetDataSize(), driver_.frame.size());
+      EXPECT_EQ(memcmp(camera_buffer->GetData(), driver_.frame.data(),
+                       driver_.frame.size()),
+                0);
+    }
+
+    EXPECT_EQ(device_.ReleaseRequest(index), 0);
+    EXPECT_EQ(device_.GetInFlightBufferCount(), 0);
+    // A released buffer is not dequeued anymore.
+    EXPECT_EQ(device_.ReleaseRequest(index), -EINVAL);
+  }
+
+  FakeDriver driver_;
+  const arc::SupportedFormat format_{4, 2, V4L2_PIX_FMT_YUYV, {30.0f}};
+};
+
+TEST_F(V4L2WrapperBufferTest, CaptureToMmapBuffers) {
+  driver_.memory_types = {V4L2_MEMORY_MMAP, V4L2_MEMORY_USERPTR};
+  ASSERT_EQ(SetFormat(true), 0);
+  EXPECT_EQ(device_.memory(), static_cast<uint32_t>(V4L2_MEMORY_MMAP));
+  ASSERT_NE(device_.CameraBuffer(0), nullptr);
+  Capture(std::make_shared<default_camera_hal::CaptureRequest>());
+}
+
+TEST_F(V4L2WrapperBufferTest, CaptureToUserptrBuffers) {
+  driver_.memory_types = {V4L2_MEMORY_USERPTR};
+  ASSERT_EQ(SetFormat(true), 0);
+  EXPECT_EQ(device_.memory(), static_cast<uint32_t>(V4L2_MEMORY_USERPTR));
+  ASSERT_NE(device_.CameraBuffer(0), nullptr);
+  Capture(std::make_shared<default_camera_hal::CaptureRequest>());
+}
+
+TEST_F(V4L2WrapperBufferTest, UserptrWithoutExpbuf) {
+  // MMAP buffers that can't be exported are no use, so fall back to USERPTR.
+  driver_.memory_types = {V4L2_MEMORY_MMAP, V4L2_MEMORY_USERPTR};
+  driver_.expbuf_supported = false;
+  ASSERT_EQ(SetFormat(true), 0);
+  EXPECT_EQ(device_.memory(), static_cast<uint32_t>(V4L2_MEMORY_USERPTR));
+  Capture(std::make_shared<default_camera_hal::CaptureRequest>());
+}
+
+TEST_F(V4L2WrapperBufferTest, CaptureToImportedDmabuf) {
+  driver_.memory_types = {V4L2_MEMORY_DMABUF, V4L2_MEMORY_MMAP,
+                          V4L2_MEMORY_USERPTR};
+  device_.SetDmabufImport(true);
+  ASSERT_EQ(SetFormat(false), 0);
+  EXPECT_EQ(device_.memory(), static_cast<uint32_t>(V4L2_MEMORY_DMABUF));
+  // The device writes straight into the output buffers.
+  EXPECT_EQ(device_.CameraBuffer(0), nullptr);
+
+  android::base::unique_fd output_fd(memfd_create("output", MFD_CLOEXEC));
+  ASSERT_GE(output_fd.get(), 0);
+  ASSERT_EQ(ftruncate(output_fd.get(), driver_.frame.size()), 0);
+  native_handle_t* handle = native_handle_create(1, 0);
+  handle->data[0] = output_fd.get();
+  buffer_handle_t buffer = handle;
+  camera3_stream_t stream = {};
+  auto request = std::make_shared<default_camera_hal::CaptureRequest>();
+  request->output_buffers.push_back({&stream, &buffer, 0, -1, -1});
+
+  Capture(request);
+  std::vector<uint8_t> output(driver_.frame.size());
+  ASSERT_EQ(pread(output_fd.get(), output.data(), output.size(), 0),
+            static_cast<ssize_t>(output.size()));
+  EXPECT_EQ(output, driver_.frame);
+  native_handle_delete(handle);
+}
+
+TEST_F(V4L2WrapperBufferTest, QueueWhileConverting) {
+  driver_.memory_types = {V4L2_MEMORY_MMAP};
+  uint32_t max_buffers = 0;
+  ASSERT_EQ(SetFormat(true, &max_buffers), 0);
+  EXPECT_GE(max_buffers, 2u);
+  EXPECT_EQ(max_buffers, driver_.count);
+
+  auto first = std::make_shared<default_camera_hal::CaptureRequest>();
+  auto second = std::make_shared<default_camera_hal::CaptureRequest>();
+  ASSERT_EQ(device_.EnqueueRequest(first), 0);
+  Dequeue(first, 0);
+
+  // Buffer 0 is held until ConvertRequest() releases it. Meanwhile the next
+  // request goes to another buffer, for the device to fill.
+  ASSERT_EQ(device_.EnqueueRequest(second), 0);
+  ASSERT_EQ(driver_.queued.size(), 1u);
+  EXPECT_EQ(driver_.queued.front().index, 1u);
+  EXPECT_EQ(device_.GetInFlightBufferCount(), 2);
+  Dequeue(second, 1);
+
+  EXPECT_EQ(device_.ReleaseRequest(0), 0);
+  EXPECT_EQ(device_.ReleaseRequest(1), 0);
+  EXPECT_EQ(device_.GetInFlightBufferCount(), 0);
+}
+
+TEST_F(V4L2WrapperBufferTest, MaxBuffersGranted) {
+  // The driver may grant fewer buffers than requested; report those.
+  driver_.memory_types = {V4L2_MEMORY_MMAP};
+  driver_.max_count = 2;
+  uint32_t max_buffers = 0;
+  ASSERT_EQ(SetFormat(true, &max_buffers), 0);
+  EXPECT_EQ(max_buffers, 2u);
+}
+
+TEST_F(V4L2WrapperBufferTest, NoDmabufForFanOut) {
+  // Frames for several streams can't all land in one output buffer.
+  driver_.memory_types = {V4L2_MEMORY_DMABUF, V4L2_MEMORY_MMAP};
+  device_.SetDmabufImport(true);
+  ASSERT_EQ(SetFormat(true), 0);
+  EXPECT_EQ(device_.memory(), static_cast<uint32_t>(V4L2_MEMORY_MMAP));
+}
+
+}  // namespace v4l2_camera_hal
@@ -32,7 +32,11 @@ LOCAL_CFLAGS := -Wall -Werror -DLOG_TAG=\"MultiHal\"
 
 LOCAL_SRC_FILES := \
     multihal.cpp \
+    DirectChannel.cpp \
+    SensorEventMerger.cpp \
     SensorEventQueue.cpp \
+    SubHalCommandQueue.cpp \
+    SubHalLoader.cpp \
 
 LOCAL_HEADER_LIBRARIES := \
     libhardware_headers \
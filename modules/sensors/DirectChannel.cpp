@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "DirectChannel.h"
+
+#include <log/log.h>
+#include <cutils/native_handle.h>
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+// Nominal rates of the direct report rate levels, in Hz.
+static const int RATE_NORMAL_HZ = 50;
+static const int RATE_FAST_HZ = 200;
+static const int RATE_VERY_FAST_HZ = 800;
+
+DirectChannel::DirectChannel(const struct sensors_direct_mem_t* mem) :
+        mError(0),
+        mBase(MAP_FAILED),
+        mSize(0),
+        mRecordCount(0),
+        mNextRecord(0),
+        mCounter(1) {
+    if (mem->type != SENSOR_DIRECT_MEM_TYPE_ASHMEM ||
+            mem->format != SENSOR_DIRECT_FMT_SENSORS_EVENT) {
+        ALOGE("Unsupported direct channel memory type %d, format %d", mem->type, mem->format);
+        mError = -EINVAL;
+        return;
+    }
+    if (mem->handle == NULL || mem->handle->numFds < 1 || mem->size < sizeof(sensors_event_t)) {
+        ALOGE("Invalid direct channel memory, size %zu", mem->size);
+        mError = -EINVAL;
+        return;
+    }
+    mBase = mmap(NULL, mem->size, PROT_READ | PROT_WRITE, MAP_SHARED, mem->handle->data[0], 0);
+    if (mBase == MAP_FAILED) {
+        ALOGE("mmap() of direct channel memory failed: %s", strerror(errno));
+        mError = -errno;
+        return;
+    }
+    mSize = mem->size;
+    mRecordCount = mem->size / sizeof(sensors_event_t);
+    // The memory must be initialized by the time register_direct_channel() returns.
+    memset(mBase, 0, mSize);
+}
+
+DirectChannel::~DirectChannel() {
+    if (mBase != MAP_FAILED) {
+        munmap(mBase, mSize);
+    }
+}
+
+int64_t DirectChannel::getRatePeriodNs(int rate_level) {
+    switch (rate_level) {
+    case SENSOR_DIRECT_RATE_NORMAL:
+        return 1000000000LL / RATE_NORMAL_HZ;
+    case SENSOR_DIRECT_RATE_FAST:
+        return 1000000000LL / RATE_FAST_HZ;
+    case SENSOR_DIRECT_RATE_VERY_FAST:
+        return 1000000000LL / RATE_VERY_FAST_HZ;
+    default:
+        return 0;
+    }
+}
+
+int DirectChannel::config(int sensor_handle, int rate_level) {
+    if (rate_level == SENSOR_DIRECT_RATE_STOP) {
+        mReports.erase(sensor_handle);
+        return 0;
+    }
+    int64_t period_ns = getRatePeriodNs(rate_level);
+    if (period_ns == 0) {
+        return -EINVAL;
+    }
+    Report& report = mReports[sensor_handle];
+    if (report.period_ns == 0) {
+        report.next_timestamp = INT64_MIN;
+    }
+    report.period_ns = period_ns;
+    return sensor_handle;
+}
+
+int64_t DirectChannel::getPeriodNs(int sensor_handle) const {
+    auto it = mReports.find(sensor_handle);
+    return it == mReports.end() ? 0 : it->second.period_ns;
+}
+
+void DirectChannel::write(const sensors_event_t* event) {
+    auto it = mReports.find(event->sensor);
+    if (it == mReports.end()) {
+        return;
+    }
+    Report& report = it->second;
+    // Sensors run at their own grid, which rarely lines up with the rate level, so allow an
+    // eighth of a period of jitter rather than skipping every other sample.
+    if (report.next_timestamp != INT64_MIN &&
+            event->timestamp < report.next_timestamp - report.period_ns / 8) {
+        return;
+    }
+    // Keep to the rate on average, but after a gap start again from this event, rather than
+    // catching up with a burst.
+    if (report.next_timestamp == INT64_MIN ||
+            event->timestamp - report.next_timestamp >= report.period_ns) {
+        report.next_timestamp = event->timestamp + report.period_ns;
+    } else {
+        report.next_timestamp += report.period_ns;
+    }
+
+    sensors_event_t* record = (sensors_event_t*)mBase + mNextRecord;
+    // Everything after the counter first, so that the counter store publishes the record.
+    memcpy(&record->timestamp, &event->timestamp,
+            sizeof(sensors_event_t) - offsetof(sensors_event_t, timestamp));
+    record->version = sizeof(sensors_event_t);
+    record->sensor = event->sensor;
+    record->type = event->type;
+    __atomic_store_n((uint32_t*)&record->reserved0, mCounter, __ATOMIC_RELEASE);
+
+    mCounter = mCounter == UINT32_MAX ? 1 : mCounter + 1;
+    mNextRecord = (mNextRecord + 1) % mRecordCount;
+}
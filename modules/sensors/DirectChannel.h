@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DIRECTCHANNEL_H_
+#define DIRECTCHANNEL_H_
+
+#include <hardware/sensors.h>
+
+#include <map>
+
+/*
+ * A direct report channel owned by the multihal, in the SENSOR_DIRECT_FMT_SENSORS_EVENT format.
+ *
+ * The shared memory is a ring of sensors_event_t sized records, rewritten from the start once
+ * full. In each record, version holds the record size, sensor the report token returned by
+ * config(), and reserved0 an atomic counter that starts at 1, grows by one with every record
+ * written to the channel and skips 0 when it wraps. The counter is stored last, with release
+ * semantics, so a reader that sees it change also sees the rest of the record.
+ *
+ * Events are sampled down to the rate level of each sensor, on a grid of one rate period
+ * started by the first event written, so that a sensor running faster than the rate level is
+ * written at that rate on average.
+ *
+ * Only ashmem memory is supported. Not thread safe: the caller serializes all calls.
+ */
+class DirectChannel {
+public:
+    // Maps mem and clears it. Check getError() before use.
+    explicit DirectChannel(const struct sensors_direct_mem_t* mem);
+    ~DirectChannel();
+
+    // 0 if the channel is usable, or a negative errno.
+    int getError() const { return mError; }
+
+    // Starts, changes the rate of, or with SENSOR_DIRECT_RATE_STOP stops reports of the sensor
+    // with this global handle. Returns the report token, the handle itself, when started, 0 when
+    // stopped, or -EINVAL for an unknown rate level.
+    int config(int sensor_handle, int rate_level);
+
+    // Stops reports of every sensor.
+    void stopAll() { mReports.clear(); }
+
+    // Returns the sampling period of the sensor in this channel, or 0 if it is not reported.
+    int64_t getPeriodNs(int sensor_handle) const;
+
+    // Returns true if any sensor is reported in this channel.
+    bool isActive() const { return !mReports.empty(); }
+
+    // Writes the event, whose sensor field is a global handle, if that sensor is reported in
+    // this channel and due for a sample.
+    void write(const sensors_event_t* event);
+
+    // Nominal sampling period of a rate level, or 0 for SENSOR_DIRECT_RATE_STOP and unknown
+    // levels.
+    static int64_t getRatePeriodNs(int rate_level);
+
+private:
+    struct Report {
+        int64_t period_ns;
+        // Timestamp from which the next event is due, or INT64_MIN if none was written yet.
+        int64_t next_timestamp;
+    };
+
+    int mError;
+    void* mBase;
+    size_t mSize;
+    int mRecordCount;
+    int mNextRecord;
+    uint32_t mCounter;
+    std::map<int, Report> mReports;
+};
+
+#endif // DIRECTCHANNEL_H_
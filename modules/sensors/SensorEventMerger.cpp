@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+
+#include <hardware/sensors.h>
+#include "SensorEventMerger.h"
+
+namespace {
+
+// std heap functions build a max-heap, so "less" means "newer".
+struct NewerThan {
+    template <typename T>
+    bool operator()(const T& a, const T& b) const {
+        if (a.timestamp != b.timestamp) {
+            return a.timestamp > b.timestamp;
+        }
+        return a.index > b.index;
+    }
+};
+
+} // namespace
+
+SensorEventMerger::SensorEventMerger() : mQueues(NULL) {
+}
+
+void SensorEventMerger::start(const std::vector<SensorEventQueue*>& queues) {
+    mQueues = &queues;
+    mHeap.clear();
+    mHeap.reserve(queues.size());
+    for (int i = 0; i < (int)queues.size(); i++) {
+        sensors_event_t* event = queues[i]->peek();
+        if (event != NULL) {
+            mHeap.push_back({event->timestamp, i});
+        }
+    }
+    std::make_heap(mHeap.begin(), mHeap.end(), NewerThan());
+}
+
+int SensorEventMerger::next() {
+    if (mHeap.empty()) {
+        return -1;
+    }
+    std::pop_heap(mHeap.begin(), mHeap.end(), NewerThan());
+    int index = mHeap.back().index;
+    mHeap.pop_back();
+    return index;
+}
+
+void SensorEventMerger::advance(int index) {
+    sensors_event_t* event = (*mQueues)[index]->peek();
+    if (event != NULL) {
+        mHeap.push_back({event->timestamp, index});
+        std::push_heap(mHeap.begin(), mHeap.end(), NewerThan());
+    }
+}
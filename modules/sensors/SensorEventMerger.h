@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SENSOREVENTMERGER_H_
+#define SENSOREVENTMERGER_H_
+
+#include <hardware/sensors.h>
+
+#include <vector>
+
+#include "SensorEventQueue.h"
+
+/*
+ * K-way merge over the heads of several SensorEventQueues, keyed on sensors_event_t::timestamp.
+ * Each queue is already in order, so a min-heap of the queue heads yields a stream that is
+ * monotonic across all queues for as long as the merge runs.
+ *
+ * Usage, from the queues' reader thread:
+ *     merger.start(queues);
+ *     int index;
+ *     while ((index = merger.next()) >= 0) {
+ *         ... consume queues[index]->peek() ...
+ *         queues[index]->dequeue();
+ *         merger.advance(index);
+ *     }
+ *
+ * Events that arrive in a queue after it was found empty are left for the next start().
+ * Ties go to the lower queue index, so the order is deterministic.
+ */
+class SensorEventMerger {
+    struct Head {
+        int64_t timestamp;
+        int index;
+    };
+
+    const std::vector<SensorEventQueue*>* mQueues;
+    // Min-heap of queue heads. Kept between merges so that steady state does not allocate.
+    std::vector<Head> mHeap;
+
+public:
+    SensorEventMerger();
+
+    // Begins a merge over the current heads of queues.
+    void start(const std::vector<SensorEventQueue*>& queues);
+
+    // Returns the index of the queue whose head has the oldest timestamp, or -1 if every queue
+    // was empty. The caller must dequeue that head and then call advance().
+    int next();
+
+    // Re-inserts the queue at index if it still has a readable record.
+    void advance(int index);
+};
+
+#endif // SENSOREVENTMERGER_H_
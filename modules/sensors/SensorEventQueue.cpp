@@ -23,12 +23,11 @@
 #include <hardware/sensors.h>
 #include "SensorEventQueue.h"
 
-SensorEventQueue::SensorEventQueue(int capacity) {
-    mCapacity = capacity;
-
-    mStart = 0;
-    mSize = 0;
+SensorEventQueue::SensorEventQueue(int capacity, OverflowPolicy overflowPolicy)
+        : mCapacity(capacity), mOverflowPolicy(overflowPolicy), mWriteCount(0), mReadCount(0),
+          mReaderStart(0), mWriterWaiting(false) {
     mData = new sensors_event_t[mCapacity];
+    pthread_mutex_init(&mSpaceAvailableMutex, NULL);
     pthread_cond_init(&mSpaceAvailableCondition, NULL);
 }
 
@@ -36,15 +35,23 @@ SensorEventQueue::~SensorEventQueue() {
     delete[] mData;
     mData = NULL;
     pthread_cond_destroy(&mSpaceAvailableCondition);
+    pthread_mutex_destroy(&mSpaceAvailableMutex);
+}
+
+uint64_t SensorEventQueue::readCount(std::memory_order order) {
+    return mReadCount.load(order) & ~READ_PINNED;
 }
 
 int SensorEventQueue::getWritableRegion(int requestedLength, sensors_event_t** out) {
-    if (mSize == mCapacity || requestedLength <= 0) {
+    uint64_t writeCount = mWriteCount.load(std::memory_order_relaxed);
+    int size = (int)(writeCount - readCount(std::memory_order_acquire));
+    if (size == mCapacity || requestedLength <= 0) {
         *out = NULL;
         return 0;
     }
     // Start writing after the last readable record.
-    int firstWritable = (mStart + mSize) % mCapacity;
+    int firstWritable = (int)(writeCount % mCapacity);
+    int start = (int)((writeCount - size) % mCapacity);
 
     int lastWritable = firstWritable + requestedLength - 1;
 
@@ -53,41 +60,140 @@ int SensorEventQueue::getWritableRegion(int requestedLength, sensors_event_t** o
         lastWritable = mCapacity - 1;
     }
     // Don't go into the readable region.
-    if (firstWritable < mStart && lastWritable >= mStart) {
-        lastWritable = mStart - 1;
+    if (firstWritable < start && lastWritable >= start) {
+        lastWritable = start - 1;
     }
     *out = &mData[firstWritable];
     return lastWritable - firstWritable + 1;
 }
 
 void SensorEventQueue::markAsWritten(int count) {
-    mSize += count;
+    mWriteCount.fetch_add(count, std::memory_order_release);
 }
 
 int SensorEventQueue::getSize() {
-    return mSize;
+    uint64_t read = readCount(std::memory_order_acquire);
+    return (int)(mWriteCount.load(std::memory_order_acquire) - read);
 }
 
 sensors_event_t* SensorEventQueue::peek() {
-    if (mSize == 0) return NULL;
-    return &mData[mStart];
+    mReaderStart = readCount(std::memory_order_acquire);
+    if (mReaderStart == mWriteCount.load(std::memory_order_acquire)) return NULL;
+    return &mData[mReaderStart % mCapacity];
+}
+
+int SensorEventQueue::getReadableRegion(int requestedLength, sensors_event_t** out, bool pin) {
+    if (pin && mOverflowPolicy == DROP_OLDEST) {
+        // Once the bit is set, the writer's compare-and-swap in dropOldest() can no longer
+        // succeed, so the read count seen here stays put until dequeue().
+        mReaderStart = mReadCount.fetch_or(READ_PINNED, std::memory_order_acq_rel) & ~READ_PINNED;
+    } else {
+        mReaderStart = readCount(std::memory_order_acquire);
+    }
+    int size = (int)(mWriteCount.load(std::memory_order_acquire) - mReaderStart);
+    if (size == 0 || requestedLength <= 0) {
+        *out = NULL;
+        return 0;
+    }
+    int start = (int)(mReaderStart % mCapacity);
+    *out = &mData[start];
+    return std::min(std::min(size, requestedLength), mCapacity - start);
 }
 
 void SensorEventQueue::dequeue() {
-    if (mSize == 0) return;
-    if (mSize == mCapacity) {
+    dequeue(1);
+}
+
+int SensorEventQueue::dequeue(int count) {
+    if (count <= 0) return 0;
+    int dropped = 0;
+    if (mOverflowPolicy == DROP_OLDEST) {
+        uint64_t target = mReaderStart + count;
+        // The writer may have moved the read count past records the reader was looking at.
+        // This also clears READ_PINNED.
+        uint64_t current = mReadCount.load(std::memory_order_relaxed);
+        while (true) {
+            uint64_t read = current & ~READ_PINNED;
+            dropped = (int)std::min(read - mReaderStart, target - mReaderStart);
+            uint64_t next = std::max(read, std::min(target, mWriteCount.load(
+                    std::memory_order_acquire)));
+            if (mReadCount.compare_exchange_weak(current, next, std::memory_order_acq_rel)) {
+                break;
+            }
+        }
+    } else {
+        // Only the reader stores the read count, so there is nothing to race with.
+        uint64_t read = mReadCount.load(std::memory_order_relaxed);
+        uint64_t next = std::min(read + count, mWriteCount.load(std::memory_order_acquire));
+        if (next == read) return 0;
+        mReadCount.store(next, std::memory_order_release);
+    }
+
+    // Pairs with the fence in waitForSpace(): either the writer sees the slots we just freed, or
+    // we see that it is about to sleep and wake it up.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    // Only the first dequeue after the writer went to sleep pays for the wakeup.
+    if (mWriterWaiting.load(std::memory_order_relaxed)) {
+        pthread_mutex_lock(&mSpaceAvailableMutex);
+        mWriterWaiting.store(false, std::memory_order_relaxed);
         pthread_cond_broadcast(&mSpaceAvailableCondition);
+        pthread_mutex_unlock(&mSpaceAvailableMutex);
     }
-    mSize--;
-    mStart = (mStart + 1) % mCapacity;
+    return dropped;
 }
 
 // returns true if it waited, or false if it was a no-op.
 bool SensorEventQueue::waitForSpace(pthread_mutex_t* mutex) {
-    bool waited = false;
-    while (mSize == mCapacity) {
-        waited = true;
-        pthread_cond_wait(&mSpaceAvailableCondition, mutex);
+    if (getSize() < mCapacity) {
+        return false;
+    }
+    // With the caller's lock, dequeue() runs under it too, so it cannot miss the flag below.
+    pthread_mutex_t* lock = mutex != NULL ? mutex : &mSpaceAvailableMutex;
+    if (mutex == NULL) {
+        pthread_mutex_lock(lock);
+    }
+    while (true) {
+        mWriterWaiting.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (getSize() < mCapacity) {
+            break;
+        }
+        pthread_cond_wait(&mSpaceAvailableCondition, lock);
+    }
+    mWriterWaiting.store(false, std::memory_order_relaxed);
+    if (mutex == NULL) {
+        pthread_mutex_unlock(lock);
+    }
+    return true;
+}
+
+int SensorEventQueue::dropOldest(int maxCount, int* droppedHandles) {
+    if (mOverflowPolicy != DROP_OLDEST) {
+        return 0;
+    }
+    uint64_t write = mWriteCount.load(std::memory_order_relaxed);
+    uint64_t current = mReadCount.load(std::memory_order_acquire);
+    while (true) {
+        if (current & READ_PINNED) {
+            return 0;
+        }
+        // Records the reader has not dequeued yet are never modified by it, so they can be
+        // inspected before claiming them.
+        int count = 0;
+        while (count < maxCount && current + count < write) {
+            const sensors_event_t& event = mData[(current + count) % mCapacity];
+            if (event.type == SENSOR_TYPE_META_DATA) {
+                break;
+            }
+            droppedHandles[count++] = event.sensor;
+        }
+        if (count == 0) {
+            return 0;
+        }
+        // acq_rel keeps the writer's later stores into the freed slots after the claim.
+        if (mReadCount.compare_exchange_weak(current, current + count,
+                std::memory_order_acq_rel)) {
+            return count;
+        }
     }
-    return waited;
 }
@@ -20,6 +20,8 @@
 #include <hardware/sensors.h>
 #include <pthread.h>
 
+#include <atomic>
+
 /*
  * Fixed-size circular queue, with an API developed around the sensor HAL poll() method.
  * Poll() takes a pointer to a buffer, which is written by poll() before it returns.
@@ -27,50 +29,119 @@
  * write to, instead of using an intermediate buffer and a memcpy.
  *
  * Thread safety:
- * Reading can be done safely after grabbing the mutex lock, while poll() writing in a separate
- * thread without a mutex lock. But there can only be one writer at a time.
+ * The queue is lock-free for exactly one writer thread and one reader thread. The writer owns
+ * getWritableRegion(), markAsWritten(), waitForSpace() and dropOldest(); the reader owns peek(),
+ * getReadableRegion() and dequeue(). getSize() and getCapacity() may be called from either.
+ * No external lock is needed. A caller may still serialize both sides on a lock of its own, in
+ * which case the writer passes that lock to waitForSpace() to sleep on it.
+ *
+ * Overflow:
+ * By default a full queue blocks the writer in waitForSpace() until the reader catches up.
+ * A queue created with DROP_OLDEST also lets the writer discard the oldest records with
+ * dropOldest() instead, so that it can keep draining its driver. The reader can then lose
+ * records it has already looked at: dequeue() reports how many, so that copies of them, which
+ * may be torn, can be discarded.
  */
 class SensorEventQueue {
-    int mCapacity;
-    int mStart; // start of readable region
-    int mSize; // number of readable items
+public:
+    enum OverflowPolicy {
+        BLOCK,
+        DROP_OLDEST,
+    };
+
+private:
+    static const int CACHE_LINE_SIZE = 64;
+    // Set in mReadCount while the reader holds a pinned region, which dropOldest() must not touch.
+    static const uint64_t READ_PINNED = 1ULL << 63;
+
+    const int mCapacity;
+    const OverflowPolicy mOverflowPolicy;
     sensors_event_t* mData;
+
+    // Total number of records ever written and read. The readable region starts at
+    // mReadCount % mCapacity and holds mWriteCount - mReadCount records. mWriteCount is only
+    // stored by the writer. mReadCount is only stored by the reader, unless the writer drops
+    // records, in which case both sides use compare-and-swap. They live on separate cache lines
+    // so that the writer and the reader do not bounce the same line on every event.
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> mWriteCount;
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> mReadCount;
+    // Reader only: the read count at the last peek() or getReadableRegion().
+    uint64_t mReaderStart;
+
+    // Slow path only: used when the writer finds the queue full.
+    alignas(CACHE_LINE_SIZE) std::atomic<bool> mWriterWaiting;
+    pthread_mutex_t mSpaceAvailableMutex;
     pthread_cond_t mSpaceAvailableCondition;
 
+    uint64_t readCount(std::memory_order order);
+
 public:
-    explicit SensorEventQueue(int capacity);
+    explicit SensorEventQueue(int capacity, OverflowPolicy overflowPolicy = BLOCK);
     ~SensorEventQueue();
 
+    int getCapacity() const { return mCapacity; }
+    OverflowPolicy getPolicy() const { return mOverflowPolicy; }
+
     // Returns length of region, between zero and min(capacity, requestedLength). If there is any
     // writable space, it will return a region of at least one. Because it must return
     // a pointer to a contiguous region, it may return smaller regions as we approach the end of
     // the data array.
-    // Only call while holding the lock.
+    // Only call from the writer thread.
     // The region is not marked internally in any way. Subsequent calls may return overlapping
     // regions. This class expects there to be exactly one writer at a time.
     int getWritableRegion(int requestedLength, sensors_event_t** out);
 
     // After writing to the region returned by getWritableRegion(), call this to indicate how
-    // many records were actually written.
+    // many records were actually written. This publishes the records to the reader.
     // This increases size() by count.
-    // Only call while holding the lock.
+    // Only call from the writer thread.
     void markAsWritten(int count);
 
     // Gets the number of readable records.
-    // Only call while holding the lock.
     int getSize();
 
     // Returns pointer to the first readable record, or NULL if size() is zero.
-    // Only call this while holding the lock.
+    // Only call from the reader thread.
     sensors_event_t* peek();
 
+    // Returns length of the contiguous readable region starting at the first readable record,
+    // between zero and min(size(), requestedLength). As with getWritableRegion(), the region
+    // stops at the end of the data array, so a second call may be needed after a wrap.
+    // If pin is set, dropOldest() leaves the region alone until the next dequeue(), so the
+    // reader may keep using it in place.
+    // Only call from the reader thread.
+    int getReadableRegion(int requestedLength, sensors_event_t** out, bool pin = false);
+
     // This will decrease the size by one, freeing up the oldest readable event's slot for writing.
-    // Only call while holding the lock.
+    // Only call from the reader thread.
     void dequeue();
 
+    // Same as dequeue(), for the oldest count records, or all of them if size() is smaller.
+    // Wakes a writer blocked in waitForSpace() at most once.
+    // For DROP_OLDEST queues, count is relative to the last peek() or getReadableRegion(), and
+    // the return value is how many of those count records the writer dropped in the meantime.
+    // Those come first, and any copy of them must be discarded. Always zero for BLOCK queues.
+    // Only call from the reader thread.
+    int dequeue(int count);
+
     // Blocks until space is available. No-op if there is already space.
     // Returns true if it had to wait.
-    bool waitForSpace(pthread_mutex_t* mutex);
+    // If mutex is not NULL, the caller holds it and the reader only dequeues while holding it.
+    // It is released while waiting, as with pthread_cond_wait().
+    // Only call from the writer thread.
+    bool waitForSpace(pthread_mutex_t* mutex = NULL);
+
+    // Returns true once the writer is about to block in waitForSpace(), until the next dequeue
+    // wakes it up. A dequeue after this returns true is bound to make waitForSpace() return true.
+    bool isWriterWaiting() const { return mWriterWaiting.load(std::memory_order_seq_cst); }
+
+    // DROP_OLDEST queues only: discards up to maxCount of the oldest records to make space,
+    // stopping before the first meta-data event, since flush completions must not be lost.
+    // The sensor handles of the dropped records are written to droppedHandles.
+    // Returns the number of records dropped, which is zero if the oldest record is a meta-data
+    // event or the reader has pinned it. The writer should then waitForSpace().
+    // Only call from the writer thread.
+    int dropOldest(int maxCount, int* droppedHandles);
 };
 
 #endif // SENSOREVENTQUEUE_H_
@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SubHalCommandQueue.h"
+
+#include <log/log.h>
+
+#include <errno.h>
+
+SubHalCommandQueue::SubHalCommandQueue(sensors_poll_device_1_t* device,
+        multihal_sub_hal_stats* stats) :
+        mDevice(device),
+        mStats(stats) {
+    pthread_mutex_init(&mMutex, NULL);
+    pthread_cond_init(&mCommandQueued, NULL);
+    pthread_cond_init(&mCommandDone, NULL);
+
+    pthread_create(&mThread, NULL, threadLoop, this);
+}
+
+SubHalCommandQueue::~SubHalCommandQueue() {
+    Command command = {};
+    command.type = EXIT;
+    pthread_mutex_lock(&mMutex);
+    mCommands.push_back(&command);
+    pthread_cond_signal(&mCommandQueued);
+    pthread_mutex_unlock(&mMutex);
+    pthread_join(mThread, NULL);
+
+    pthread_cond_destroy(&mCommandDone);
+    pthread_cond_destroy(&mCommandQueued);
+    pthread_mutex_destroy(&mMutex);
+}
+
+int SubHalCommandQueue::activate(int handle, int enabled) {
+    Command command = {};
+    command.type = ACTIVATE;
+    command.handle = handle;
+    command.enabled = enabled;
+    return call(&command);
+}
+
+void SubHalCommandQueue::setDelay(int handle, int64_t period_ns) {
+    Command command = {};
+    command.type = SET_DELAY;
+    command.handle = handle;
+    command.period_ns = period_ns;
+    post(command);
+}
+
+void SubHalCommandQueue::batch(int handle, int flags, int64_t period_ns, int64_t timeout) {
+    Command command = {};
+    command.type = BATCH;
+    command.handle = handle;
+    command.flags = flags;
+    command.period_ns = period_ns;
+    command.timeout = timeout;
+    post(command);
+}
+
+int SubHalCommandQueue::flush(int handle) {
+    Command command = {};
+    command.type = FLUSH;
+    command.handle = handle;
+    return call(&command);
+}
+
+void SubHalCommandQueue::drain() {
+    Command command = {};
+    command.type = BARRIER;
+    call(&command);
+}
+
+void SubHalCommandQueue::post(const Command& command) {
+    pthread_mutex_lock(&mMutex);
+    // Find the newest waiting command for the same sensor. Replacing it is only equivalent to
+    // running both if it is of the same kind, and nobody waits for its result.
+    for (auto it = mCommands.rbegin(); it != mCommands.rend(); ++it) {
+        Command* queued = *it;
+        if (queued->type == BARRIER || queued->type == EXIT) {
+            break;
+        }
+        if (queued->handle != command.handle) {
+            continue;
+        }
+        if (queued->type == command.type) {
+            // The statistics are only written by the worker thread, which counts this when it
+            // runs the command.
+            int coalesced = queued->coalesced + 1;
+            *queued = command;
+            queued->coalesced = coalesced;
+            pthread_mutex_unlock(&mMutex);
+            return;
+        }
+        break;
+    }
+    mCommands.push_back(new Command(command));
+    pthread_cond_signal(&mCommandQueued);
+    pthread_mutex_unlock(&mMutex);
+}
+
+int SubHalCommandQueue::call(Command* command) {
+    pthread_mutex_lock(&mMutex);
+    command->done = false;
+    mCommands.push_back(command);
+    pthread_cond_signal(&mCommandQueued);
+    while (!command->done) {
+        pthread_cond_wait(&mCommandDone, &mMutex);
+    }
+    pthread_mutex_unlock(&mMutex);
+    return command->result;
+}
+
+int SubHalCommandQueue::run(const Command& command) {
+    switch (command.type) {
+    case ACTIVATE:
+        return mDevice->activate((sensors_poll_device_t*)mDevice, command.handle,
+                command.enabled);
+    case SET_DELAY:
+        return mDevice->setDelay((sensors_poll_device_t*)mDevice, command.handle,
+                command.period_ns);
+    case BATCH:
+        return mDevice->batch(mDevice, command.handle, command.flags, command.period_ns,
+                command.timeout);
+    case FLUSH:
+        return mDevice->flush(mDevice, command.handle);
+    case BARRIER:
+    case EXIT:
+        return 0;
+    }
+    return -EINVAL;
+}
+
+void* SubHalCommandQueue::threadLoop(void* ptr) {
+    SubHalCommandQueue* queue = (SubHalCommandQueue*)ptr;
+    pthread_mutex_lock(&queue->mMutex);
+    while (1) {
+        while (queue->mCommands.empty()) {
+            pthread_cond_wait(&queue->mCommandQueued, &queue->mMutex);
+        }
+        Command* command = queue->mCommands.front();
+        queue->mCommands.pop_front();
+        if (command->type == EXIT) {
+            break;
+        }
+        // Commands that nobody waits for were allocated by post(), and are owned by this thread
+        // once dequeued.
+        bool waited = command->type == ACTIVATE || command->type == FLUSH ||
+                command->type == BARRIER;
+
+        pthread_mutex_unlock(&queue->mMutex);
+        int result = queue->run(*command);
+        pthread_mutex_lock(&queue->mMutex);
+
+        if (waited) {
+            command->result = result;
+            command->done = true;
+            pthread_cond_broadcast(&queue->mCommandDone);
+        } else {
+            if (command->coalesced > 0) {
+                queue->mStats->commands_coalesced.fetch_add(command->coalesced,
+                        std::memory_order_relaxed);
+            }
+            if (result < 0) {
+                ALOGE("%s of handle %d failed asynchronously: %d",
+                        command->type == BATCH ? "batch" : "setDelay", command->handle, result);
+                queue->mStats->command_errors.fetch_add(1, std::memory_order_relaxed);
+            }
+            delete command;
+        }
+    }
+    pthread_mutex_unlock(&queue->mMutex);
+    return NULL;
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SUBHALCOMMANDQUEUE_H_
+#define SUBHALCOMMANDQUEUE_H_
+
+#include <hardware/sensors.h>
+#include <pthread.h>
+
+#include <deque>
+
+#include "multihal.h"
+
+/*
+ * Runs the configuration calls of one sub-HAL on a thread of its own, in submission order, so
+ * that a sub-HAL that is slow to configure only delays its own sensors.
+ *
+ * batch() and setDelay() return as soon as the command is queued. If a batch() or setDelay()
+ * for the same sensor is still waiting, with no other command for that sensor queued after it,
+ * the new parameters replace the waiting ones: only the last rate asked for is applied. Their
+ * errors can only be logged, and counted in the sub-HAL statistics.
+ *
+ * activate() and flush() wait for every command queued before them to run, then return the
+ * sub-HAL's result. The flush-complete event therefore always follows the configuration it
+ * flushes, and still arrives through the sub-HAL's event queue, tagged with its local handle.
+ *
+ * All handles are local to the sub-HAL. Destroying the queue runs the commands queued so far,
+ * then stops the worker thread.
+ */
+class SubHalCommandQueue {
+public:
+    SubHalCommandQueue(sensors_poll_device_1_t* device, multihal_sub_hal_stats* stats);
+    ~SubHalCommandQueue();
+
+    int activate(int handle, int enabled);
+    void setDelay(int handle, int64_t period_ns);
+    void batch(int handle, int flags, int64_t period_ns, int64_t timeout);
+    int flush(int handle);
+
+    // Blocks until every queued command has run.
+    void drain();
+
+private:
+    enum CommandType {
+        ACTIVATE,
+        SET_DELAY,
+        BATCH,
+        FLUSH,
+        // Runs nothing. Used by drain() to wait for the commands ahead of it.
+        BARRIER,
+        // Stops the worker thread. Queued by the destructor.
+        EXIT,
+    };
+
+    struct Command {
+        CommandType type;
+        int handle;
+        int enabled;
+        int flags;
+        int64_t period_ns;
+        int64_t timeout;
+        // Number of commands this one replaced, counted in the statistics when it runs.
+        int coalesced;
+        // Only set for commands whose caller waits for the result.
+        bool done;
+        int result;
+    };
+
+    sensors_poll_device_1_t* mDevice;
+    multihal_sub_hal_stats* mStats;
+
+    pthread_mutex_t mMutex;
+    // Signalled when a command is queued.
+    pthread_cond_t mCommandQueued;
+    // Signalled when a waited-for command has run.
+    pthread_cond_t mCommandDone;
+    std::deque<Command*> mCommands;
+    pthread_t mThread;
+
+    static void* threadLoop(void* ptr);
+    int run(const Command& command);
+    // Queues a command whose caller does not wait, replacing a waiting one if possible.
+    void post(const Command& command);
+    // Queues a command and blocks until it has run.
+    int call(Command* command);
+};
+
+#endif // SUBHALCOMMANDQUEUE_H_
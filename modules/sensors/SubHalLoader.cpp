@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SubHalLoader.h"
+
+#include <log/log.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+
+#include <dlfcn.h>
+
+// Runs task(0) .. task(count - 1) on up to max_threads threads, including the calling one.
+static void run_in_parallel(int count, int max_threads, const std::function<void(int)>& task) {
+    std::atomic<int> next(0);
+    auto worker = [&]() {
+        int i;
+        while ((i = next.fetch_add(1)) < count) {
+            task(i);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int i = 1; i < std::min(count, max_threads); i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+void load_sub_hal_modules(const std::vector<std::string>& so_paths, int max_threads,
+        std::vector<hw_module_t*>* modules, std::vector<void*>* so_handles) {
+    std::vector<hw_module_t*> loaded_modules(so_paths.size(), nullptr);
+    std::vector<void*> loaded_handles(so_paths.size(), nullptr);
+    const char* sym = HAL_MODULE_INFO_SYM_AS_STR;
+
+    // dlerror() state is per thread, so each task can clear and read its own.
+    run_in_parallel(so_paths.size(), max_threads, [&](int i) {
+        const char* path = so_paths[i].c_str();
+        dlerror(); // clear any old errors
+        void* lib_handle = dlopen(path, RTLD_LAZY);
+        if (lib_handle == NULL) {
+            ALOGW("dlerror(): %s", dlerror());
+            return;
+        }
+        ALOGI("Loaded library from %s", path);
+        ALOGV("Opening symbol \"%s\"", sym);
+        // clear old errors
+        dlerror();
+        struct hw_module_t* module = (hw_module_t*) dlsym(lib_handle, sym);
+        const char* error;
+        if ((error = dlerror()) != NULL) {
+            ALOGW("Error calling dlsym: %s", error);
+        } else if (module == NULL) {
+            ALOGW("module == NULL");
+        } else {
+            ALOGV("Loaded symbols from \"%s\"", sym);
+            loaded_modules[i] = module;
+            loaded_handles[i] = lib_handle;
+            lib_handle = nullptr;
+        }
+        if (lib_handle != nullptr) {
+            dlclose(lib_handle);
+        }
+    });
+
+    for (size_t i = 0; i < so_paths.size(); i++) {
+        if (loaded_modules[i] != nullptr) {
+            modules->push_back(loaded_modules[i]);
+            so_handles->push_back(loaded_handles[i]);
+        }
+    }
+}
+
+void get_sub_hal_sensor_lists(const std::vector<hw_module_t*>& modules, int max_threads,
+        std::vector<const sensor_t*>* lists, std::vector<int>* counts) {
+    lists->assign(modules.size(), nullptr);
+    counts->assign(modules.size(), 0);
+    run_in_parallel(modules.size(), max_threads, [&](int i) {
+        struct sensors_module_t* module = (struct sensors_module_t*) modules[i];
+        (*counts)[i] = module->get_sensors_list(module, &(*lists)[i]);
+        ALOGV("module %d has %d sensors", i, (*counts)[i]);
+    });
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SUBHALLOADER_H_
+#define SUBHALLOADER_H_
+
+#include <hardware/hardware.h>
+#include <hardware/sensors.h>
+
+#include <string>
+#include <vector>
+
+/*
+ * Startup helpers for the multihal. Sub-HAL libraries often do slow work in their constructors
+ * and in get_sensors_list(), so both steps run on up to max_threads threads at once. Results are
+ * always reported in input order, so the global handles the multihal derives from them do not
+ * depend on which thread finished first.
+ */
+
+// Dlopens every path in so_paths and looks up its HAL_MODULE_INFO_SYM. Libraries that load are
+// appended to modules, and their dlopen() handles to so_handles, in so_paths order. Libraries
+// that fail to load are logged and skipped.
+void load_sub_hal_modules(const std::vector<std::string>& so_paths, int max_threads,
+        std::vector<hw_module_t*>* modules, std::vector<void*>* so_handles);
+
+// Calls get_sensors_list() on every module. (*lists)[i] and (*counts)[i] hold the result for
+// modules[i].
+void get_sub_hal_sensor_lists(const std::vector<hw_module_t*>& modules, int max_threads,
+        std::vector<const sensor_t*>* lists, std::vector<int>* counts);
+
+#endif // SUBHALLOADER_H_
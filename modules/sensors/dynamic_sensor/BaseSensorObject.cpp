@@ -54,6 +54,12 @@ void BaseSensorObject::generateEvent(const sensors_event_t &e) {
     }
 }
 
+void BaseSensorObject::generateEvents(const sensors_event_t *e, size_t count) {
+    if (mCallback) {
+        mCallback->submitEvents(SP_THIS, e, count);
+    }
+}
+
 } // namespace SensorHalExt
 } // namespace android
 
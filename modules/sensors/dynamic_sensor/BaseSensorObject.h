@@ -18,6 +18,7 @@
 #define ANDROID_SENSORHAL_BASE_SENSOR_OBJECT_H
 
 #include "Utils.h"
+#include <cstddef>
 #include <cstdint>
 
 struct sensor_t;
@@ -56,6 +57,7 @@ public:
 protected:
     // utility function for sub-class
     void generateEvent(const sensors_event_t &e);
+    void generateEvents(const sensors_event_t *e, size_t count);
 private:
     SensorEventCallback* mCallback;
 };
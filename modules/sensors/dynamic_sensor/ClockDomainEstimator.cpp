@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ClockDomainEstimator.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+namespace android {
+namespace SensorHalExt {
+
+ClockDomainEstimator::ClockDomainEstimator()
+        : mBuckets(kWindowBuckets), mLastStampNs(INT64_MIN) {
+    reset();
+}
+
+void ClockDomainEstimator::reset() {
+    mNextBucket = 0;
+    mBucketCount = 0;
+    mCurrent = {0, 0};
+    mCurrentStartNs = 0;
+    mLastDeviceNs = 0;
+    mHasEstimate = false;
+    mDeviceBaseNs = 0;
+    mHostBaseNs = 0;
+    mRate = 1.0;
+}
+
+int64_t ClockDomainEstimator::toHostTime(int64_t deviceNs) const {
+    return mHostBaseNs + std::llround(mRate * static_cast<double>(deviceNs - mDeviceBaseNs));
+}
+
+int64_t ClockDomainEstimator::stampSample(int64_t deviceNs, int64_t hostNs) {
+    addSample(deviceNs, hostNs);
+    int64_t stampNs = std::min(toHostTime(deviceNs), hostNs);
+    if (mLastStampNs != INT64_MIN && stampNs <= mLastStampNs) {
+        stampNs = mLastStampNs + 1;
+    }
+    mLastStampNs = stampNs;
+    return stampNs;
+}
+
+void ClockDomainEstimator::addSample(int64_t deviceNs, int64_t hostNs) {
+    if (mHasEstimate && (deviceNs < mLastDeviceNs
+            || std::llabs(hostNs - toHostTime(deviceNs)) > kResetNs)) {
+        reset();
+    }
+    mLastDeviceNs = deviceNs;
+
+    if (!mHasEstimate) {
+        mCurrent = {deviceNs, hostNs};
+        mCurrentStartNs = deviceNs;
+        mDeviceBaseNs = deviceNs;
+        mHostBaseNs = hostNs;
+        mRate = 1.0;
+        mHasEstimate = true;
+        return;
+    }
+
+    if (deviceNs - mCurrentStartNs >= kBucketNs) {
+        mBuckets[mNextBucket] = mCurrent;
+        mNextBucket = (mNextBucket + 1) % kWindowBuckets;
+        mBucketCount = std::min(mBucketCount + 1, kWindowBuckets);
+        fit();
+        mCurrent = {deviceNs, hostNs};
+        mCurrentStartNs = deviceNs;
+    } else if (hostNs - toHostTime(deviceNs)
+            < mCurrent.hostNs - toHostTime(mCurrent.deviceNs)) {
+        mCurrent = {deviceNs, hostNs};
+    }
+
+    // keep the line on or below every sample until the next fit
+    int64_t residual = hostNs - toHostTime(deviceNs);
+    if (residual < 0) {
+        mHostBaseNs += residual;
+    }
+}
+
+void ClockDomainEstimator::fit() {
+    // relative to the last closed bucket, so that the sums stay small. The open bucket is left
+    // out, as its best sample may still be a late one.
+    const Sample ref = mBuckets[(mNextBucket + kWindowBuckets - 1) % kWindowBuckets];
+    auto x = [&ref](const Sample &s) { return static_cast<double>(s.deviceNs - ref.deviceNs); };
+    auto y = [&ref](const Sample &s) { return static_cast<double>(s.hostNs - ref.hostNs); };
+
+    double rate = 1.0;
+    if (mBucketCount >= kMinFitBuckets) {
+        double meanX = 0;
+        double meanY = 0;
+        for (size_t i = 0; i < mBucketCount; ++i) {
+            meanX += x(mBuckets[i]);
+            meanY += y(mBuckets[i]);
+        }
+        meanX /= mBucketCount;
+        meanY /= mBucketCount;
+
+        double sxx = 0;
+        double sxy = 0;
+        for (size_t i = 0; i < mBucketCount; ++i) {
+            double dx = x(mBuckets[i]) - meanX;
+            sxx += dx * dx;
+            sxy += dx * (y(mBuckets[i]) - meanY);
+        }
+        if (sxx > 0) {
+            rate = std::min(std::max(sxy / sxx, 1.0 - kMaxDrift), 1.0 + kMaxDrift);
+        }
+    }
+
+    double minResidual = 0;     // residual of ref
+    for (size_t i = 0; i < mBucketCount; ++i) {
+        minResidual = std::min(minResidual, y(mBuckets[i]) - rate * x(mBuckets[i]));
+    }
+
+    mRate = rate;
+    mDeviceBaseNs = ref.deviceNs;
+    mHostBaseNs = ref.hostNs + std::llround(minResidual);
+}
+
+} // namespace SensorHalExt
+} // namespace android
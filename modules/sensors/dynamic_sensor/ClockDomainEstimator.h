@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSORHAL_EXT_CLOCK_DOMAIN_ESTIMATOR_H
+#define ANDROID_SENSORHAL_EXT_CLOCK_DOMAIN_ESTIMATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace android {
+namespace SensorHalExt {
+
+// Maps the clock of a device, such as the timestamps of HID sensor reports, to the host clock,
+// from pairs of device time and the host time at which it was received.
+//
+// Receive times are late by a transport delay that varies from report to report, and batching
+// of reads adds to it. The device time axis is cut into buckets of kBucketNs, and each bucket
+// keeps its sample with the smallest delay. The rate of the device clock relative to the host
+// clock is the least squares slope of the last buckets, so that drift is tracked, and the
+// offset puts the line on the lower envelope of the samples: a mapped time is never later than
+// the time the sample was received, and is late only by the smallest delay seen.
+//
+// A device time that goes backwards, or a sample that does not fit the estimate within
+// kResetNs, starts the estimate over, as when the device clock was reset.
+//
+// Lowering the line for a sample, or a new fit, can move the mapping of later device times back
+// by more than the time between two reports. stampSample() therefore keeps the times it returns
+// strictly increasing, across resets too, as the events of a sensor must be.
+//
+// Not thread safe.
+class ClockDomainEstimator {
+public:
+    static constexpr int64_t kBucketNs = 500000000LL;     // 500 ms
+    static constexpr size_t kWindowBuckets = 64;          // 32 s
+    static constexpr size_t kMinFitBuckets = 4;
+    static constexpr double kMaxDrift = 500e-6;           // 500 ppm
+    static constexpr int64_t kResetNs = 1000000000LL;     // 1 s
+
+    ClockDomainEstimator();
+
+    // add a sample: device time deviceNs was received at host time hostNs
+    void addSample(int64_t deviceNs, int64_t hostNs);
+
+    // host time of device time deviceNs; only valid once a sample was added
+    int64_t toHostTime(int64_t deviceNs) const;
+
+    // add a sample and return the event timestamp for it: its host time, no later than hostNs,
+    // and at least 1 ns after the last time returned
+    int64_t stampSample(int64_t deviceNs, int64_t hostNs);
+
+    bool hasEstimate() const { return mHasEstimate; }
+
+    // host ns per device ns
+    double getRate() const { return mRate; }
+
+    void reset();
+
+private:
+    struct Sample {
+        int64_t deviceNs;
+        int64_t hostNs;
+    };
+
+    // fit rate and offset to the closed buckets. The open bucket is left out, as its best sample
+    // may still be a late one.
+    void fit();
+
+    std::vector<Sample> mBuckets;   // ring of closed buckets
+    size_t mNextBucket;
+    size_t mBucketCount;
+
+    Sample mCurrent;                // best sample of the open bucket
+    int64_t mCurrentStartNs;        // device time the open bucket started at
+    int64_t mLastDeviceNs;
+
+    // host = mHostBaseNs + mRate * (device - mDeviceBaseNs)
+    bool mHasEstimate;
+    int64_t mDeviceBaseNs;
+    int64_t mHostBaseNs;
+    double mRate;
+
+    int64_t mLastStampNs;           // last time returned by stampSample(), kept by reset()
+};
+
+} // namespace SensorHalExt
+} // namespace android
+
+#endif // ANDROID_SENSORHAL_EXT_CLOCK_DOMAIN_ESTIMATOR_H
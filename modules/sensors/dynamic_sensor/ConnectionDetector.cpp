@@ -130,11 +130,17 @@ FileConnectionDetector::FileConnectionDetector (
 }
 
 FileConnectionDetector::~FileConnectionDetector() {
+    if (mInotifyFd > 0) {
+        stop();
+        ::close(mInotifyFd);
+    }
+}
+
+void FileConnectionDetector::stop() {
     if (mInotifyFd > 0) {
         requestExit();
         mLooper->wake();
         join();
-        ::close(mInotifyFd);
     }
 }
 
@@ -216,7 +222,8 @@ bool FileConnectionDetector::threadLoop() {
     while(!Thread::exitPending()) {
         int ret = mLooper->pollOnce(-1);
 
-        if (ret != Looper::POLL_WAKE && ret != POLL_IDENT) {
+        // POLL_CALLBACK: callbacks of fds added by the daemon were run
+        if (ret != Looper::POLL_WAKE && ret != Looper::POLL_CALLBACK && ret != POLL_IDENT) {
             ALOGE("Unexpected value %d from pollOnce, quit", ret);
             requestExit();
             break;
@@ -57,11 +57,19 @@ private:
 
 // Detect file change under path and notify sensor daemon of connection and disconnection event when
 // file is created in or removed from the directory, respectively.
+//
+// The thread polls a looper, which is Looper::getForThread() in onConnectionChange(). The daemon
+// may add the fds of its devices to it with a callback, so that one thread serves detection and
+// input of every device.
 class FileConnectionDetector : public ConnectionDetector, public Thread {
 public:
     FileConnectionDetector(
             BaseDynamicSensorDaemon *d, const std::string &path, const std::string &regex);
     virtual ~FileConnectionDetector();
+
+    // make the thread exit and wait for it, after which no callback of the looper runs. Do not
+    // call from the thread itself.
+    void stop();
 private:
     static constexpr int POLL_IDENT = 1;
     // implement virtual of Thread
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "DigestCache.h"
+
+namespace android {
+namespace SensorHalExt {
+
+DigestCache::DigestCache(size_t maxEntries, HashFunction hash)
+        : mMaxEntries(maxEntries), mHash(hash) {
+}
+
+bool DigestCache::get(const std::vector<uint8_t> &descriptor,
+                      const std::vector<unsigned int> &usages,
+                      HidUtil::HidParser::DigestVector *digest) {
+    uint64_t hash = mHash(descriptor, usages);
+    std::lock_guard<std::mutex> l(mLock);
+    auto i = mEntries.find(hash);
+    if (i == mEntries.end()
+            || i->second.descriptor != descriptor || i->second.usages != usages) {
+        return false;
+    }
+    *digest = i->second.digest;
+    return true;
+}
+
+void DigestCache::put(const std::vector<uint8_t> &descriptor,
+                      const std::vector<unsigned int> &usages,
+                      const HidUtil::HidParser::DigestVector &digest) {
+    if (mMaxEntries == 0) {
+        return;
+    }
+    uint64_t hash = mHash(descriptor, usages);
+    std::lock_guard<std::mutex> l(mLock);
+    if (mEntries.find(hash) == mEntries.end()) {
+        if (mOrder.size() == mMaxEntries) {
+            mEntries.erase(mOrder.front());
+            mOrder.pop_front();
+        }
+        mOrder.push_back(hash);
+    }
+    mEntries[hash] = {descriptor, usages, digest};
+}
+
+uint64_t DigestCache::fnv1a(const std::vector<uint8_t> &descriptor,
+                            const std::vector<unsigned int> &usages) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    auto add = [&hash](uint8_t byte) {
+        hash = (hash ^ byte) * 0x100000001b3ULL;
+    };
+    for (uint8_t byte : descriptor) {
+        add(byte);
+    }
+    for (unsigned int usage : usages) {
+        for (size_t i = 0; i < sizeof(usage); ++i) {
+            add(static_cast<uint8_t>(usage >> (8 * i)));
+        }
+    }
+    return hash;
+}
+
+} // namespace SensorHalExt
+} // namespace android
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ANDROID_SENSORHAL_EXT_DIGEST_CACHE_H
+#define ANDROID_SENSORHAL_EXT_DIGEST_CACHE_H
+
+#include <HidParser.h>
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace android {
+namespace SensorHalExt {
+
+// Digests of report descriptors parsed in this process, keyed by a hash of the descriptor and the
+// usage set, so that a device that reconnects, or another one of the same model, is not parsed
+// again. Keys are compared in full on a hit, as a hash collision must not mix up devices. Holds
+// up to maxEntries digests, and evicts the oldest one to make room. A cache of 0 entries holds
+// nothing. Thread safe.
+class DigestCache {
+public:
+    typedef uint64_t (*HashFunction)(const std::vector<uint8_t> &descriptor,
+                                     const std::vector<unsigned int> &usages);
+
+    static constexpr size_t kMaxEntries = 16;
+
+    // hash is only replaced by tests, to force collisions
+    explicit DigestCache(size_t maxEntries = kMaxEntries, HashFunction hash = fnv1a);
+
+    // copy the digest of descriptor for usages, the sorted usage set, into digest. Returns false
+    // if it is not cached.
+    bool get(const std::vector<uint8_t> &descriptor, const std::vector<unsigned int> &usages,
+             HidUtil::HidParser::DigestVector *digest);
+
+    void put(const std::vector<uint8_t> &descriptor, const std::vector<unsigned int> &usages,
+             const HidUtil::HidParser::DigestVector &digest);
+
+    // 64 bit FNV-1a of the descriptor bytes and the usages
+    static uint64_t fnv1a(const std::vector<uint8_t> &descriptor,
+                          const std::vector<unsigned int> &usages);
+
+private:
+    struct Entry {
+        std::vector<uint8_t> descriptor;
+        std::vector<unsigned int> usages;
+        HidUtil::HidParser::DigestVector digest;
+    };
+
+    const size_t mMaxEntries;
+    const HashFunction mHash;
+
+    std::mutex mLock;
+    std::unordered_map<uint64_t, Entry> mEntries;
+    std::deque<uint64_t> mOrder;    // oldest first, for eviction
+};
+
+} // namespace SensorHalExt
+} // namespace android
+
+#endif // ANDROID_SENSORHAL_EXT_DIGEST_CACHE_H
@@ -23,6 +23,7 @@
 #include <utils/Log.h>
 #include <utils/SystemClock.h>
 
+#include <algorithm>
 #include <cassert>
 
 namespace android {
@@ -123,7 +124,6 @@ int DynamicSensorManager::flush(int handle) {
 
 int DynamicSensorManager::poll(sensors_event_t * data, int count) {
     assert(mCallback == nullptr);
-    std::lock_guard<std::mutex> lk(mFifoLock);
     return mFifo.read(data, count);
 }
 
@@ -176,6 +176,11 @@ void DynamicSensorManager::unregisterSensor(sp<BaseSensorObject> sensor) {
 }
 
 int DynamicSensorManager::submitEvent(sp<BaseSensorObject> source, const sensors_event_t &e) {
+    return submitEvents(source, &e, 1);
+}
+
+int DynamicSensorManager::submitEvents(
+        sp<BaseSensorObject> source, const sensors_event_t *e, size_t count) {
     int handle;
     if (source == nullptr) {
         handle = mHandleRange.first;
@@ -189,37 +194,52 @@ int DynamicSensorManager::submitEvent(sp<BaseSensorObject> source, const sensors
         handle = i->second;
     }
 
-    // making a copy of events, prepare for editing
-    sensors_event_t event = e;
-    event.version = sizeof(event);
-
-    // special case of flush complete
-    if (event.type == SENSOR_TYPE_META_DATA) {
-        event.sensor = 0;
-        event.meta_data.sensor = handle;
-    } else {
-        event.sensor = handle;
-    }
-
-    // set timestamp if it is default value
-    if (event.timestamp == TIMESTAMP_AUTO_FILL) {
-        event.timestamp = elapsedRealtimeNano();
-    }
-
-    if (mCallback) {
-        // extention mode, calling callback directly
-        int ret;
-
-        ret = mCallback->submitEvent(nullptr, event);
-        if (ret < 0) {
-            ALOGE("DynamicSensorManager callback failed, ret: %d", ret);
+    // one timestamp for all events of the batch that still need one. Sources that batch events
+    // of reports read at different times stamp them themselves, as HidRawSensorDevice does.
+    int64_t now = 0;
+    sensors_event_t events[kSubmitBatchSize];
+    while (count > 0) {
+        size_t n = std::min(count, kSubmitBatchSize);
+        for (size_t i = 0; i < n; ++i) {
+            // making a copy of events, prepare for editing
+            sensors_event_t &event = events[i];
+            event = e[i];
+            event.version = sizeof(event);
+
+            // special case of flush complete
+            if (event.type == SENSOR_TYPE_META_DATA) {
+                event.sensor = 0;
+                event.meta_data.sensor = handle;
+            } else {
+                event.sensor = handle;
+            }
+
+            // set timestamp if it is default value
+            if (event.timestamp == TIMESTAMP_AUTO_FILL) {
+                if (now == 0) {
+                    now = elapsedRealtimeNano();
+                }
+                event.timestamp = now;
+            }
         }
-    } else {
-        // standalone mode, add event to internal buffer for poll() to pick up
-        std::lock_guard<std::mutex> lk(mFifoLock);
-        if (mFifo.write(&event, 1) < 0) {
-            ALOGE("DynamicSensorManager fifo full");
+
+        if (mCallback) {
+            // extention mode, calling callback directly
+            int ret;
+
+            ret = mCallback->submitEvents(nullptr, events, n);
+            if (ret < 0) {
+                ALOGE("DynamicSensorManager callback failed, ret: %d", ret);
+            }
+        } else {
+            // standalone mode, add events to internal buffer for poll() to pick up
+            ssize_t written = mFifo.write(events, n);
+            if (written < static_cast<ssize_t>(n)) {
+                ALOGE("DynamicSensorManager fifo full, %zd events dropped", n - written);
+            }
         }
+        e += n;
+        count -= n;
     }
     return 0;
 }
@@ -20,6 +20,7 @@
 #include "SensorEventCallback.h"
 #include "RingBuffer.h"
 #include <hardware/sensors.h>
+#include <media/stagefright/foundation/ABase.h>
 #include <utils/RefBase.h>
 
 #include <mutex>
@@ -63,6 +64,8 @@ public:
 
     // SensorEventCallback
     virtual int submitEvent(sp<BaseSensorObject>, const sensors_event_t &e) override;
+    virtual int submitEvents(
+            sp<BaseSensorObject>, const sensors_event_t *e, size_t count) override;
 
     // get meta sensor struct
     const sensor_t& getDynamicMetaSensor() const;
@@ -115,9 +118,11 @@ private:
     // immutable pointer to event callback, used in extention mode.
     SensorEventCallback * const mCallback;
 
-    // RingBuffer used in standalone mode
+    // RingBuffer used in standalone mode, written by sensor threads without locking and read by
+    // poll()
     static constexpr size_t kFifoSize = 4096; //4K events
-    mutable std::mutex mFifoLock;
+    // events prepared on the stack and passed on at once by submitEvents()
+    static constexpr size_t kSubmitBatchSize = 32;
     RingBuffer mFifo;
 
     // mapping between handle and SensorObjects
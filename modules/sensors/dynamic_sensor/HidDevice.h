@@ -17,6 +17,7 @@
 #ifndef ANDROID_SENSORHAL_EXT_HID_DEVICE_H
 #define ANDROID_SENSORHAL_EXT_HID_DEVICE_H
 #include "Utils.h"
+#include <cstring>
 #include <string>
 #include <vector>
 #include <unordered_set>
@@ -50,6 +51,27 @@ public:
 
     // receive from default input endpoint
     virtual bool receiveReport(uint8_t *id, std::vector<uint8_t> *data) = 0;
+
+    // Variants of getFeature(), setFeature() and sendReport() on caller buffers, where size is
+    // the byte size of the report without id. Devices override these to avoid allocation; the
+    // defaults go through the vector versions.
+    virtual bool readFeature(uint8_t id, uint8_t *out, size_t size) {
+        std::vector<uint8_t> buffer;
+        if (!getFeature(id, &buffer) || buffer.size() != size) {
+            return false;
+        }
+        memcpy(out, buffer.data(), size);
+        return true;
+    }
+
+    virtual bool writeFeature(uint8_t id, const uint8_t *in, size_t size) {
+        return setFeature(id, std::vector<uint8_t>(in, in + size));
+    }
+
+    virtual bool writeReport(uint8_t id, const uint8_t *data, size_t size) {
+        std::vector<uint8_t> buffer(data, data + size);
+        return sendReport(id, buffer);
+    }
 };
 
 } // namespace SensorHalExt
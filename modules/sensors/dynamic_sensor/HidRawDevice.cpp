@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 #include "HidRawDevice.h"
+#include "DigestCache.h"
 #include "HidLog.h"
 #include "Utils.h"
 
@@ -21,9 +22,13 @@
 #include <linux/input.h>
 #include <linux/hidraw.h>
 #include <linux/hiddev.h>  // HID_STRING_SIZE
+#include <poll.h>
 #include <sys/ioctl.h>
 #include <unistd.h>
+#include <utils/SystemClock.h>
 
+#include <algorithm>
+#include <deque>
 #include <set>
 
 namespace android {
@@ -31,11 +36,16 @@ namespace SensorHalExt {
 
 using HidUtil::HidItem;
 
+namespace {
+DigestCache gDigestCache;
+} // anonymous namespace
+
 HidRawDevice::HidRawDevice(
         const std::string &devName, const std::unordered_set<unsigned int> &usageSet)
         : mDevFd(-1), mMultiIdDevice(false), mValid(false) {
     // open device
-    mDevFd = ::open(devName.c_str(), O_RDWR); // read write?
+    // non-blocking, so that readReports() can read until there is nothing left
+    mDevFd = ::open(devName.c_str(), O_RDWR | O_NONBLOCK); // read write?
     if (mDevFd < 0) {
         LOG_E << "Error in open device node: " << errno << " (" << ::strerror(errno) << ")"
               << LOG_ENDL;
@@ -80,6 +90,17 @@ HidRawDevice::HidRawDevice(
     } else { // reportIdSet.size() == 1
         mMultiIdDevice = !(reportIdSet.find(0) != reportIdSet.end());
     }
+
+    // so that getting and setting features and sending output allocate nothing
+    for (auto const &entry : mReportTypeIdMap) {
+        if (entry.first.first == HidParser::REPORT_TYPE_INPUT) {
+            continue;
+        }
+        std::unique_ptr<IoBuffer> buffer(new IoBuffer);
+        buffer->data.resize(entry.second->getByteSize() + 1); // report id byte
+        buffer->data[0] = static_cast<uint8_t>(entry.first.second);
+        mIoBuffers.emplace(entry.first, std::move(buffer));
+    }
     mValid = true;
 }
 
@@ -163,6 +184,14 @@ bool HidRawDevice::generateDigest(const std::unordered_set<unsigned int> &usage)
         return false;
     }
 
+    // sorted, as the order of an unordered_set is not part of the key
+    std::vector<unsigned int> usages(usage.begin(), usage.end());
+    std::sort(usages.begin(), usages.end());
+    if (gDigestCache.get(mDeviceInfo.descriptor, usages, &mDigestVector)) {
+        LOG_V << "HidRawDevice::generateDigest: digest of descriptor found in cache" << LOG_ENDL;
+        return mDigestVector.size() > 0;
+    }
+
     std::vector<HidItem> tokens = HidItem::tokenize(mDeviceInfo.descriptor);
     HidParser parser;
     if (!parser.parse(tokens)) {
@@ -171,6 +200,7 @@ bool HidRawDevice::generateDigest(const std::unordered_set<unsigned int> &usage)
 
     parser.filterTree();
     mDigestVector = parser.generateDigest(usage);
+    gDigestCache.put(mDeviceInfo.descriptor, usages, mDigestVector);
 
     return mDigestVector.size() > 0;
 }
@@ -179,116 +209,138 @@ bool HidRawDevice::isValid() {
     return mValid;
 }
 
-bool HidRawDevice::getFeature(uint8_t id, std::vector<uint8_t> *out) {
-    if (mDevFd < 0) {
-        return false;
-    }
+HidRawDevice::IoBuffer *HidRawDevice::getIoBuffer(unsigned int type, unsigned int id) {
+    auto i = mIoBuffers.find(std::make_pair(type, id));
+    return i == mIoBuffers.end() ? nullptr : i->second.get();
+}
 
+bool HidRawDevice::getFeature(uint8_t id, std::vector<uint8_t> *out) {
     if (out == nullptr) {
         return false;
     }
 
     const HidParser::ReportPacket *packet = getReportPacket(HidParser::REPORT_TYPE_FEATURE, id);
     if (packet == nullptr) {
-        LOG_E << "HidRawDevice::getFeature: unknown feature " << id << LOG_ENDL;
+        LOG_E << "HidRawDevice::getFeature: unknown feature " << static_cast<int>(id) << LOG_ENDL;
+        return false;
+    }
+
+    out->resize(packet->getByteSize());
+    return readFeature(id, out->data(), out->size());
+}
+
+bool HidRawDevice::setFeature(uint8_t id, const std::vector<uint8_t> &in) {
+    return writeFeature(id, in.data(), in.size());
+}
+
+bool HidRawDevice::sendReport(uint8_t id, std::vector<uint8_t> &data) {
+    return writeReport(id, data.data(), data.size());
+}
+
+bool HidRawDevice::readFeature(uint8_t id, uint8_t *out, size_t size) {
+    if (mDevFd < 0 || out == nullptr) {
         return false;
     }
 
-    size_t size = packet->getByteSize() + 1; // report id size
+    IoBuffer *buffer = getIoBuffer(HidParser::REPORT_TYPE_FEATURE, id);
+    if (buffer == nullptr) {
+        LOG_E << "HidRawDevice::readFeature: unknown feature " << static_cast<int>(id) << LOG_ENDL;
+        return false;
+    }
 
-    std::lock_guard<std::mutex> l(mIoBufferLock);
-    if (mIoBuffer.size() < size) {
-        mIoBuffer.resize(size);
+    if (size + 1 != buffer->data.size()) {
+        LOG_E << "HidRawDevice::readFeature: feature " << static_cast<int>(id)
+              << " size mismatch, need " << buffer->data.size() - 1 << " bytes, have " << size
+              << " bytes" << LOG_ENDL;
+        return false;
     }
-    mIoBuffer[0] = id;
-    int res = ::ioctl(mDevFd, HIDIOCGFEATURE(size), mIoBuffer.data());
+
+    std::lock_guard<std::mutex> l(buffer->lock);
+    uint8_t *raw = buffer->data.data();
+    raw[0] = id;
+    int res = ::ioctl(mDevFd, HIDIOCGFEATURE(size + 1), raw);
     if (res < 0) {
-        LOG_E << "HidRawDevice::getFeature: feature " << static_cast<int>(id)
-              << " ioctl returns " << res << " (" << ::strerror(res) << ")" << LOG_ENDL;
+        LOG_E << "HidRawDevice::readFeature: feature " << static_cast<int>(id)
+              << " ioctl returns " << res << " (" << ::strerror(errno) << ")" << LOG_ENDL;
         return false;
     }
 
-    if (static_cast<size_t>(res) != size) {
-        LOG_E << "HidRawDevice::getFeature: get feature " << static_cast<int>(id)
-              << " returned " << res << " bytes, does not match expected " << size << LOG_ENDL;
+    if (static_cast<size_t>(res) != size + 1) {
+        LOG_E << "HidRawDevice::readFeature: get feature " << static_cast<int>(id)
+              << " returned " << res << " bytes, does not match expected " << size + 1
+              << LOG_ENDL;
         return false;
     }
-    if (mIoBuffer.front() != id) {
-        LOG_E << "HidRawDevice::getFeature: get feature " << static_cast<int>(id)
-              << " result has header " << mIoBuffer.front() << LOG_ENDL;
+    if (raw[0] != id) {
+        LOG_E << "HidRawDevice::readFeature: get feature " << static_cast<int>(id)
+              << " result has header " << static_cast<int>(raw[0]) << LOG_ENDL;
     }
-    out->resize(size - 1);
-    std::copy(mIoBuffer.begin() + 1, mIoBuffer.begin() + size, out->begin());
+    memcpy(out, raw + 1, size);
     return true;
 }
 
-bool HidRawDevice::setFeature(uint8_t id, const std::vector<uint8_t> &in) {
-    if (mDevFd < 0) {
+bool HidRawDevice::writeFeature(uint8_t id, const uint8_t *in, size_t size) {
+    if (mDevFd < 0 || in == nullptr) {
         return false;
     }
 
-    const HidParser::ReportPacket *packet = getReportPacket(HidParser::REPORT_TYPE_FEATURE, id);
-    if (packet == nullptr) {
-        LOG_E << "HidRawDevice::setFeature: Unknown feature " << id << LOG_ENDL;
+    IoBuffer *buffer = getIoBuffer(HidParser::REPORT_TYPE_FEATURE, id);
+    if (buffer == nullptr) {
+        LOG_E << "HidRawDevice::writeFeature: unknown feature " << static_cast<int>(id)
+              << LOG_ENDL;
         return false;
     }
 
-    size_t size = packet->getByteSize();
-    if (size != in.size()) {
-        LOG_E << "HidRawDevice::setFeature: set feature " << id << " size mismatch, need "
-              << size << " bytes, have " << in.size() << " bytes" << LOG_ENDL;
+    if (size + 1 != buffer->data.size()) {
+        LOG_E << "HidRawDevice::writeFeature: set feature " << static_cast<int>(id)
+              << " size mismatch, need " << buffer->data.size() - 1 << " bytes, have " << size
+              << " bytes" << LOG_ENDL;
         return false;
     }
 
-    ++size; // report id byte
-    std::lock_guard<std::mutex> l(mIoBufferLock);
-    if (mIoBuffer.size() < size) {
-        mIoBuffer.resize(size);
-    }
-    mIoBuffer[0] = id;
-    std::copy(in.begin(), in.end(), &mIoBuffer[1]);
-    int res = ::ioctl(mDevFd, HIDIOCSFEATURE(size), mIoBuffer.data());
+    std::lock_guard<std::mutex> l(buffer->lock);
+    uint8_t *raw = buffer->data.data();
+    raw[0] = id;
+    memcpy(raw + 1, in, size);
+    int res = ::ioctl(mDevFd, HIDIOCSFEATURE(size + 1), raw);
     if (res < 0) {
-        LOG_E << "HidRawDevice::setFeature: feature " << id << " ioctl returns " << res
-              << " (" << ::strerror(res) << ")" << LOG_ENDL;
+        LOG_E << "HidRawDevice::writeFeature: feature " << static_cast<int>(id)
+              << " ioctl returns " << res << " (" << ::strerror(errno) << ")" << LOG_ENDL;
         return false;
     }
     return true;
 }
 
-bool HidRawDevice::sendReport(uint8_t id, std::vector<uint8_t> &data) {
-    if (mDevFd < 0) {
+bool HidRawDevice::writeReport(uint8_t id, const uint8_t *data, size_t size) {
+    if (mDevFd < 0 || data == nullptr) {
         return false;
     }
 
-    const HidParser::ReportPacket *packet = getReportPacket(HidParser::REPORT_TYPE_OUTPUT, id);
-    if (packet == nullptr) {
-        LOG_E << "HidRawDevice::sendReport: unknown output " << id << LOG_ENDL;
+    IoBuffer *buffer = getIoBuffer(HidParser::REPORT_TYPE_OUTPUT, id);
+    if (buffer == nullptr) {
+        LOG_E << "HidRawDevice::writeReport: unknown output " << static_cast<int>(id) << LOG_ENDL;
         return false;
     }
 
-    size_t size = packet->getByteSize();
-    if (size != data.size()) {
-        LOG_E << "HidRawDevice::sendReport: send report " << id << " size mismatch, need "
-              << size << " bytes, have " << data.size() << " bytes" << LOG_ENDL;
+    if (size + 1 != buffer->data.size()) {
+        LOG_E << "HidRawDevice::writeReport: send report " << static_cast<int>(id)
+              << " size mismatch, need " << buffer->data.size() - 1 << " bytes, have " << size
+              << " bytes" << LOG_ENDL;
         return false;
     }
     int res;
     if (mMultiIdDevice) {
-        std::lock_guard<std::mutex> l(mIoBufferLock);
-        ++size;
-        if (mIoBuffer.size() < size) {
-            mIoBuffer.resize(size);
-        }
-        mIoBuffer[0] = id;
-        std::copy(mIoBuffer.begin() + 1, mIoBuffer.end(), data.begin());
-        res = ::write(mDevFd, mIoBuffer.data(), size);
+        std::lock_guard<std::mutex> l(buffer->lock);
+        uint8_t *raw = buffer->data.data();
+        raw[0] = id;
+        memcpy(raw + 1, data, size);
+        res = ::write(mDevFd, raw, size + 1);
     } else {
-        res = ::write(mDevFd, data.data(), size);
+        res = ::write(mDevFd, data, size);
     }
     if (res < 0) {
-        LOG_E << "HidRawDevice::sendReport: output " << id << " write returns " << res
-              << " (" << ::strerror(res) << ")" << LOG_ENDL;
+        LOG_E << "HidRawDevice::writeReport: output " << static_cast<int>(id)
+              << " write returns " << res << " (" << ::strerror(errno) << ")" << LOG_ENDL;
         return false;
     }
     return true;
@@ -299,26 +351,90 @@ bool HidRawDevice::receiveReport(uint8_t *id, std::vector<uint8_t> *data) {
         return false;
     }
 
-    uint8_t buffer[256];
-    int res = ::read(mDevFd, buffer, 256);
+    uint8_t buffer[ReportBatch::kMaxReportSize];
+    int res;
+    do {
+        if (!waitForInput()) {
+            return false;
+        }
+        res = ::read(mDevFd, buffer, sizeof(buffer));
+    } while (res < 0 && (errno == EAGAIN || errno == EINTR));
     if (res < 0) {
         LOG_E << "HidRawDevice::receiveReport: read returns " << res
-              << " (" << ::strerror(res) << ")" << LOG_ENDL;
+              << " (" << ::strerror(errno) << ")" << LOG_ENDL;
         return false;
     }
 
+    ReportBatch::Report report;
+    if (!parseReport(buffer, res, &report)) {
+        return false;
+    }
+    data->assign(report.data, report.data + report.size);
+    *id = report.id;
+    return true;
+}
+
+bool HidRawDevice::readReports(ReportBatch *batch) {
+    batch->count = 0;
+    if (mDevFd < 0) {
+        return false;
+    }
+
+    // hidraw returns one report per read()
+    while (batch->count < ReportBatch::kMaxReports) {
+        uint8_t *raw = batch->buffer.data() + batch->count * ReportBatch::kMaxReportSize;
+        int res = ::read(mDevFd, raw, ReportBatch::kMaxReportSize);
+        if (res < 0) {
+            if (errno == EAGAIN) {
+                break;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_E << "HidRawDevice::readReports: read returns " << res
+                  << " (" << ::strerror(errno) << ")" << LOG_ENDL;
+            return false;
+        }
+        ReportBatch::Report &report = batch->reports[batch->count];
+        if (!parseReport(raw, res, &report)) {
+            return false;
+        }
+        // reports read back to back still get distinct times, in the order they were read
+        report.receivedNs = elapsedRealtimeNano();
+        if (batch->count > 0 && report.receivedNs <= batch->reports[batch->count - 1].receivedNs) {
+            report.receivedNs = batch->reports[batch->count - 1].receivedNs + 1;
+        }
+        ++batch->count;
+    }
+    return true;
+}
+
+bool HidRawDevice::waitForInput() {
+    struct pollfd pfd = { mDevFd, POLLIN, 0 };
+    while (::poll(&pfd, 1, -1) < 0) {
+        if (errno != EINTR) {
+            LOG_E << "HidRawDevice::waitForInput: poll error " << errno
+                  << " (" << ::strerror(errno) << ")" << LOG_ENDL;
+            return false;
+        }
+    }
+    // a removed device is readable, and the read reports the error
+    return true;
+}
+
+bool HidRawDevice::parseReport(const uint8_t *raw, int size, ReportBatch::Report *report) {
     if (mMultiIdDevice) {
-        if (!(res > 1)) {
-            LOG_E << "read hidraw returns data too short, len: " << res << LOG_ENDL;
+        if (!(size > 1)) {
+            LOG_E << "read hidraw returns data too short, len: " << size << LOG_ENDL;
             return false;
         }
-        data->resize(static_cast<size_t>(res - 1));
-        std::copy(buffer + 1, buffer + res, data->begin());
-        *id = buffer[0];
+        report->id = raw[0];
+        report->data = raw + 1;
+        report->size = static_cast<size_t>(size - 1);
     } else {
-        data->resize(static_cast<size_t>(res));
-        std::copy(buffer, buffer + res, data->begin());
-        *id = 0;
+        report->id = 0;
+        report->data = raw;
+        report->size = static_cast<size_t>(size);
     }
     return true;
 }
@@ -19,6 +19,8 @@
 #include "HidDevice.h"
 
 #include <HidParser.h>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <unordered_set>
@@ -33,6 +35,25 @@ using HidUtil::HidReport;
 class HidRawDevice : public HidDevice {
     friend class HidRawDeviceTest;
 public:
+    // Input reports read by one readReports() call, in a buffer allocated once and reused.
+    struct ReportBatch {
+        static constexpr size_t kMaxReports = 32;
+        static constexpr size_t kMaxReportSize = 256;
+
+        struct Report {
+            uint8_t id;
+            const uint8_t *data;    // report data after the id, inside buffer
+            size_t size;
+            int64_t receivedNs;     // boottime the report was read at
+        };
+
+        ReportBatch() : buffer(kMaxReports * kMaxReportSize), count(0) {}
+
+        std::vector<uint8_t> buffer;
+        Report reports[kMaxReports];
+        size_t count;
+    };
+
     HidRawDevice(const std::string &devName, const std::unordered_set<unsigned int> &usageSet);
     virtual ~HidRawDevice();
 
@@ -45,6 +66,14 @@ public:
     virtual bool setFeature(uint8_t id, const std::vector<uint8_t> &in) override;
     virtual bool sendReport(uint8_t id, std::vector<uint8_t> &data) override;
     virtual bool receiveReport(uint8_t *id, std::vector<uint8_t> *data) override;
+    virtual bool readFeature(uint8_t id, uint8_t *out, size_t size) override;
+    virtual bool writeFeature(uint8_t id, const uint8_t *in, size_t size) override;
+    virtual bool writeReport(uint8_t id, const uint8_t *data, size_t size) override;
+
+    // read the pending input reports, up to ReportBatch::kMaxReports, into batch without
+    // blocking. Each report is stamped when it is read, later than the report before it.
+    // Returns false if the device failed or is gone.
+    bool readReports(ReportBatch *batch);
 
 protected:
     bool populateDeviceInfo();
@@ -52,6 +81,10 @@ protected:
     bool generateDigest(const std::unordered_set<uint32_t> &usage);
     size_t calculateReportBitSize(const std::vector<HidReport> &reportItems);
     const HidParser::ReportPacket *getReportPacket(unsigned int type, unsigned int id);
+    int getFd() const { return mDevFd; }
+    bool waitForInput();
+    // parse one raw input report, which starts with the report id on a multi id device.
+    bool parseReport(const uint8_t *raw, int size, ReportBatch::Report *report);
 
     typedef std::pair<unsigned int, unsigned int> ReportTypeIdPair;
     struct UnsignedIntPairHash {
@@ -66,8 +99,15 @@ protected:
 
     HidParser::DigestVector mDigestVector;
 private:
-    std::mutex mIoBufferLock;
-    std::vector<uint8_t> mIoBuffer;
+    // buffer of one feature or output report, report id byte included, allocated once
+    struct IoBuffer {
+        std::mutex lock;
+        std::vector<uint8_t> data;
+    };
+    IoBuffer *getIoBuffer(unsigned int type, unsigned int id);
+
+    std::unordered_map<ReportTypeIdPair, std::unique_ptr<IoBuffer>, UnsignedIntPairHash>
+            mIoBuffers;
 
     int mDevFd;
     HidDeviceInfo mDeviceInfo;
@@ -15,15 +15,19 @@
  */
 #include "HidRawSensor.h"
 #include "HidSensorDef.h"
+#include "SensorEventCallback.h"
 
 #include <utils/Errors.h>
 #include "HidLog.h"
 
 #include <algorithm>
 #include <cfloat>
+#include <cmath>
 #include <codecvt>
+#include <cstring>
 #include <iomanip>
 #include <sstream>
+#include <type_traits>
 
 namespace android {
 namespace SensorHalExt {
@@ -34,7 +38,11 @@ const std::string CUSTOM_TYPE_PREFIX("com.google.hardware.sensor.hid_dynamic.");
 
 HidRawSensor::HidRawSensor(
         SP(HidDevice) device, uint32_t usage, const std::vector<HidParser::ReportPacket> &packets)
-        : mReportingStateId(-1), mPowerStateId(-1), mReportIntervalId(-1), mInputReportId(-1),
+        : mReportingStateId(-1), mReportingStateReportSize(0), mPowerStateId(-1),
+        mPowerStateReportSize(0), mReportIntervalId(-1), mReportIntervalReportSize(0),
+        mInputReportId(-1),
+        mInputDecoder(decodeGeneric), mInputReportSize(0), mTimestampOffset(0),
+        mTimestampSize(0), mTimestampScale(0), mTimestampLastRaw(0), mTimestampWraps(0),
         mEnabled(false), mSamplingPeriod(1000LL*1000*1000), mBatchingPeriod(0),
         mDevice(device), mValid(false) {
     if (device == nullptr) {
@@ -214,6 +222,11 @@ HidRawSensor::HidRawSensor(
             LOG_I << "unsupported sensor usage " << usage << LOG_ENDL;
     }
 
+    if (translationTableValid) {
+        compileTranslateTable();
+        findTimestampUsage(packets);
+    }
+
     bool sensorValid = validateFeatureValueAndBuildSensor();
     mValid = translationTableValid && sensorValid;
     LOG_V << "HidRawSensor init, translationTableValid: " << translationTableValid
@@ -787,6 +800,16 @@ bool HidRawSensor::findSensorControlUsage(const std::vector<HidParser::ReportPac
     using namespace Hid::Sensor::PropertyUsage;
     using namespace Hid::Sensor::RawMinMax;
 
+    // byte size of the feature report with id, which enable() and batch() read and write
+    auto featureReportSize = [&packets] (unsigned int id) -> size_t {
+        for (const auto &packet : packets) {
+            if (packet.type == HidParser::REPORT_TYPE_FEATURE && packet.id == id) {
+                return packet.getByteSize();
+            }
+        }
+        return 0;
+    };
+
     //REPORTING_STATE
     const HidParser::ReportItem *reportingState
             = find(packets, REPORTING_STATE, HidParser::REPORT_TYPE_FEATURE);
@@ -800,6 +823,7 @@ bool HidRawSensor::findSensorControlUsage(const std::vector<HidParser::ReportPac
     } else {
         mReportingStateId = reportingState->id;
         mReportingStateOffset = reportingState->bitOffset / 8;
+        mReportingStateReportSize = featureReportSize(reportingState->id);
     }
 
     //POWER_STATE
@@ -814,6 +838,7 @@ bool HidRawSensor::findSensorControlUsage(const std::vector<HidParser::ReportPac
     } else {
         mPowerStateId = powerState->id;
         mPowerStateOffset = powerState->bitOffset / 8;
+        mPowerStateReportSize = featureReportSize(powerState->id);
     }
 
     //REPORT_INTERVAL
@@ -828,11 +853,16 @@ bool HidRawSensor::findSensorControlUsage(const std::vector<HidParser::ReportPac
         mReportIntervalId = reportInterval->id;
         mReportIntervalOffset = reportInterval->bitOffset / 8;
         mReportIntervalSize = reportInterval->bitSize / 8;
+        mReportIntervalReportSize = featureReportSize(reportInterval->id);
 
         mFeatureInfo.minDelay = std::max(static_cast<int64_t>(1), reportInterval->minRaw) * 1000;
         mFeatureInfo.maxDelay = std::min(static_cast<int64_t>(1000000),
                                     reportInterval->maxRaw) * 1000; // maximum 1000 second
     }
+
+    // allocated once, so that enable() and batch() allocate nothing
+    mFeatureBuffer.resize(std::max({mReportingStateReportSize, mPowerStateReportSize,
+                                    mReportIntervalReportSize}));
     return true;
     return (mPowerStateId >= 0 || mReportingStateId >= 0) && mReportIntervalId >= 0;
 }
@@ -857,15 +887,15 @@ int HidRawSensor::enable(bool enable) {
         return NO_ERROR;
     }
 
-    std::vector<uint8_t> buffer;
+    uint8_t *buffer = mFeatureBuffer.data();
     bool setPowerOk = true;
     if (mPowerStateId >= 0) {
         setPowerOk = false;
         uint8_t id = static_cast<uint8_t>(mPowerStateId);
-        if (device->getFeature(id, &buffer)
-                && buffer.size() > mPowerStateOffset) {
+        if (mPowerStateReportSize > mPowerStateOffset
+                && device->readFeature(id, buffer, mPowerStateReportSize)) {
             buffer[mPowerStateOffset] = enable ? POWER_STATE_FULL_POWER : POWER_STATE_POWER_OFF;
-            setPowerOk = device->setFeature(id, buffer);
+            setPowerOk = device->writeFeature(id, buffer, mPowerStateReportSize);
         } else {
             LOG_E << "enable: changing POWER STATE failed" << LOG_ENDL;
         }
@@ -875,11 +905,11 @@ int HidRawSensor::enable(bool enable) {
     if (mReportingStateId >= 0) {
         setReportingOk = false;
         uint8_t id = static_cast<uint8_t>(mReportingStateId);
-        if (device->getFeature(id, &buffer)
-                && buffer.size() > mReportingStateOffset) {
+        if (mReportingStateReportSize > mReportingStateOffset
+                && device->readFeature(id, buffer, mReportingStateReportSize)) {
             buffer[mReportingStateOffset]
                     = enable ? REPORTING_STATE_ALL_EVENT : REPORTING_STATE_NO_EVENT;
-            setReportingOk = device->setFeature(id, buffer);
+            setReportingOk = device->writeFeature(id, buffer, mReportingStateReportSize);
         } else {
             LOG_E << "enable: changing REPORTING STATE failed" << LOG_ENDL;
         }
@@ -904,14 +934,14 @@ int HidRawSensor::batch(int64_t samplingPeriod, int64_t batchingPeriod) {
     }
 
     bool needRefresh = mSamplingPeriod != samplingPeriod || mBatchingPeriod != batchingPeriod;
-    std::vector<uint8_t> buffer;
+    uint8_t *buffer = mFeatureBuffer.data();
 
     bool ok = true;
     if (needRefresh && mReportIntervalId >= 0) {
         ok = false;
         uint8_t id = static_cast<uint8_t>(mReportIntervalId);
-        if (device->getFeature(id, &buffer)
-                && buffer.size() >= mReportIntervalOffset + mReportIntervalSize) {
+        if (mReportIntervalReportSize >= mReportIntervalOffset + mReportIntervalSize
+                && device->readFeature(id, buffer, mReportIntervalReportSize)) {
             int64_t periodMs = samplingPeriod / 1000000; //ns -> ms
             switch (mReportIntervalSize) {
                 case sizeof(uint16_t):
@@ -927,7 +957,7 @@ int HidRawSensor::batch(int64_t samplingPeriod, int64_t batchingPeriod) {
                     buffer[mReportIntervalOffset + 3] = (periodMs >> 24) & 0xFF;
                     break;
             }
-            ok = device->setFeature(id, buffer);
+            ok = device->writeFeature(id, buffer, mReportIntervalReportSize);
         }
     }
 
@@ -940,20 +970,106 @@ int HidRawSensor::batch(int64_t samplingPeriod, int64_t batchingPeriod) {
     }
 }
 
-void HidRawSensor::handleInput(uint8_t id, const std::vector<uint8_t> &message) {
-    if (id != mInputReportId || mEnabled == false) {
+namespace {
+// reads a little endian integer, which compilers turn into a single load on little endian cpus
+template <typename T>
+inline T readLittleEndian(const uint8_t *p) {
+    typename std::make_unsigned<T>::type v = 0;
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        v |= static_cast<decltype(v)>(p[i]) << (8 * i);
+    }
+    return static_cast<T>(v);
+}
+} // anonymous namespace
+
+void HidRawSensor::compileTranslateTable() {
+    mInputReportSize = 0;
+    for (const auto &rec : mTranslateTable) {
+        mInputReportSize = std::max(mInputReportSize, rec.byteOffset + rec.byteSize);
+    }
+
+    // common layouts of same size float values get a decoder with the loop and sizes unrolled
+    mInputDecoder = decodeGeneric;
+    size_t count = mTranslateTable.size();
+    size_t byteSize = mTranslateTable.front().byteSize;
+    for (const auto &rec : mTranslateTable) {
+        if (rec.type != TYPE_FLOAT || rec.byteSize != byteSize) {
+            return;
+        }
+    }
+    if (count == 3 && byteSize == sizeof(int16_t)) {
+        mInputDecoder = decodeFixedFloat<int16_t, 3>;
+    } else if (count == 3 && byteSize == sizeof(int32_t)) {
+        mInputDecoder = decodeFixedFloat<int32_t, 3>;
+    } else if (count == 4 && byteSize == sizeof(int16_t)) {
+        mInputDecoder = decodeFixedFloat<int16_t, 4>;
+    } else if (count == 4 && byteSize == sizeof(int32_t)) {
+        mInputDecoder = decodeFixedFloat<int32_t, 4>;
+    }
+}
+
+void HidRawSensor::findTimestampUsage(const std::vector<HidParser::ReportPacket> &packets) {
+    using namespace Hid::Sensor::ReportUsage;
+
+    const HidParser::ReportItem *timestamp
+            = find(packets, TIMESTAMP, HidParser::REPORT_TYPE_INPUT, mInputReportId);
+    if (timestamp == nullptr) {
         return;
     }
-    sensors_event_t event = {
-        .version = sizeof(event),
-        .sensor = -1,
-        .type = mSensor.type
-    };
+    // an unsigned counter, whatever the logical range says, in seconds or no unit, scaled by
+    // the unit exponent
+    if (!timestamp->isByteAligned()
+            || (timestamp->bitSize != 32 && timestamp->bitSize != 64)
+            || (timestamp->unit != 0 && timestamp->unit != 0x1001)
+            || !(timestamp->a > 0)) {
+        LOG_W << "Ignore invalid timestamp in input report" << LOG_ENDL;
+        return;
+    }
+    mTimestampOffset = timestamp->bitOffset / 8;
+    mTimestampSize = timestamp->bitSize / 8;
+    mTimestampScale = timestamp->a * 1e9;
+    mInputReportSize = std::max(mInputReportSize, mTimestampOffset + mTimestampSize);
+}
+
+int64_t HidRawSensor::decodeTimestamp(const uint8_t *report) {
+    uint64_t raw;
+    if (mTimestampSize == sizeof(uint32_t)) {
+        raw = readLittleEndian<uint32_t>(report + mTimestampOffset);
+        if (raw < mTimestampLastRaw) {
+            ++mTimestampWraps;
+        }
+        mTimestampLastRaw = raw;
+        raw += mTimestampWraps << 32;
+    } else {
+        raw = readLittleEndian<uint64_t>(report + mTimestampOffset);
+    }
+    // exact for whole ns units, such as us or ms
+    if (mTimestampScale == std::floor(mTimestampScale)) {
+        return static_cast<int64_t>(raw * static_cast<uint64_t>(mTimestampScale));
+    }
+    return static_cast<int64_t>(static_cast<double>(raw) * mTimestampScale);
+}
+
+template <typename T, size_t N>
+bool HidRawSensor::decodeFixedFloat(const std::vector<ReportTranslateRecord> &table,
+                                    const uint8_t *report, sensors_event_t *event) {
+    const ReportTranslateRecord *rec = table.data();
     bool valid = true;
-    for (const auto &rec : mTranslateTable) {
-        int64_t v = (message[rec.byteOffset + rec.byteSize - 1] & 0x80) ? -1 : 0;
+    for (size_t i = 0; i < N; ++i) {
+        int64_t v = readLittleEndian<T>(report + rec[i].byteOffset);
+        valid &= v <= rec[i].maxValue && v >= rec[i].minValue;
+        event->data[rec[i].index] = rec[i].a * (v + rec[i].b);
+    }
+    return valid;
+}
+
+bool HidRawSensor::decodeGeneric(const std::vector<ReportTranslateRecord> &table,
+                                 const uint8_t *report, sensors_event_t *event) {
+    bool valid = true;
+    for (const auto &rec : table) {
+        int64_t v = (report[rec.byteOffset + rec.byteSize - 1] & 0x80) ? -1 : 0;
         for (int i = static_cast<int>(rec.byteSize) - 1; i >= 0; --i) {
-            v = (v << 8) | message[rec.byteOffset + i]; // HID is little endian
+            v = (v << 8) | report[rec.byteOffset + i]; // HID is little endian
         }
 
         switch (rec.type) {
@@ -961,24 +1077,52 @@ void HidRawSensor::handleInput(uint8_t id, const std::vector<uint8_t> &message)
                 if (v > rec.maxValue || v < rec.minValue) {
                     valid = false;
                 }
-                event.data[rec.index] = rec.a * (v + rec.b);
+                event->data[rec.index] = rec.a * (v + rec.b);
                 break;
             case TYPE_INT64:
                 if (v > rec.maxValue || v < rec.minValue) {
                     valid = false;
                 }
-                event.u64.data[rec.index] = v + rec.b;
+                event->u64.data[rec.index] = v + rec.b;
                 break;
             case TYPE_ACCURACY:
-                event.magnetic.status = (v & 0xFF) + rec.b;
+                event->magnetic.status = (v & 0xFF) + rec.b;
                 break;
         }
     }
-    if (!valid) {
+    return valid;
+}
+
+void HidRawSensor::handleInput(uint8_t id, const std::vector<uint8_t> &message) {
+    sensors_event_t event;
+    if (decodeInput(id, message.data(), message.size(), TIMESTAMP_AUTO_FILL, &event)) {
+        generateEvent(event);
+    }
+}
+
+bool HidRawSensor::decodeInput(uint8_t id, const uint8_t *message, size_t size,
+                               int64_t receivedNs, sensors_event_t *event) {
+    if (id != mInputReportId || mEnabled == false) {
+        return false;
+    }
+    if (size < mInputReportSize) {
+        LOG_E << "Input report of " << size << " bytes, expected "
+              << mInputReportSize << ", discard" << LOG_ENDL;
+        return false;
+    }
+    memset(event, 0, sizeof(*event));
+    event->version = sizeof(*event);
+    event->sensor = -1;
+    event->type = mSensor.type;
+    if (!mInputDecoder(mTranslateTable, message, event)) {
         LOG_V << "Range error observed in decoding, discard" << LOG_ENDL;
     }
-    event.timestamp = -1;
-    generateEvent(event);
+    event->timestamp = receivedNs;
+    if (mTimestampSize > 0 && receivedNs != TIMESTAMP_AUTO_FILL) {
+        // back-dated to when the device sampled it, rather than when the report was read
+        event->timestamp = mClockEstimator.stampSample(decodeTimestamp(message), receivedNs);
+    }
+    return true;
 }
 
 std::string HidRawSensor::dump() const {
@@ -1014,6 +1158,13 @@ std::string HidRawSensor::dump() const {
               << "; byte-offset,size: " << t.byteOffset << ", " << t.byteSize
               << "; scaling,bias: " << t.a << ", " << t.b << LOG_ENDL;
     }
+    ss << "  Timestamp ";
+    if (mTimestampSize > 0) {
+        ss << "found, byte-offset,size: " << mTimestampOffset << ", " << mTimestampSize
+              << "; ns per unit: " << mTimestampScale << LOG_ENDL;
+    } else {
+        ss << "not found" << LOG_ENDL;
+    }
 
     ss << "Control features: " << LOG_ENDL;
     ss << "  Power state ";
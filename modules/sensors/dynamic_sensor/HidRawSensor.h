@@ -17,6 +17,7 @@
 #define ANDROID_SENSORHAL_EXT_HIDRAW_SENSOR_H
 
 #include "BaseSensorObject.h"
+#include "ClockDomainEstimator.h"
 #include "HidDevice.h"
 #include "Utils.h"
 
@@ -46,6 +47,19 @@ public:
     // handle input report received
     void handleInput(uint8_t id, const std::vector<uint8_t> &message);
 
+    // decode input report received into event without submitting it, returns false if there is
+    // no event for the report. The event is stamped with receivedNs, the boottime the report was
+    // read at, which may be TIMESTAMP_AUTO_FILL if unknown. If the report has a hardware
+    // timestamp, it is used instead, mapped to boottime using receivedNs and kept after the
+    // timestamp of the previous event. Call from one thread only.
+    bool decodeInput(uint8_t id, const uint8_t *message, size_t size, int64_t receivedNs,
+                     sensors_event_t *event);
+
+    // submit events generated by decodeInput() in one batch
+    void submitEvents(const sensors_event_t *events, size_t count) {
+        generateEvents(events, count);
+    }
+
     // indicate if the HidRawSensor is a valid one
     bool isValid() const { return mValid; };
 
@@ -68,6 +82,11 @@ private:
         int64_t b;
     };
 
+    // decodes an input report into event according to the translate table, returns false if any
+    // value is out of range
+    typedef bool (*InputDecoder)(const std::vector<ReportTranslateRecord> &table,
+                                 const uint8_t *report, sensors_event_t *event);
+
     // sensor related information parsed from HID descriptor
     struct FeatureValue {
         // information needed to furnish sensor_t structure (see hardware/sensors.h)
@@ -132,23 +151,57 @@ private:
     // process HID snesor spec defined orientation(quaternion) sensor usages.
     bool processQuaternionUsage(const std::vector<HidParser::ReportPacket> &packets);
 
+    // pick the input decoder for the complete translate table and the input report size it needs.
+    void compileTranslateTable();
+
+    // find the hardware timestamp of the input report, if any, after compileTranslateTable().
+    void findTimestampUsage(const std::vector<HidParser::ReportPacket> &packets);
+
+    // device time of the hardware timestamp of report, in ns, extended past counter wraps
+    int64_t decodeTimestamp(const uint8_t *report);
+
+    // input decoder for N float values of integer type T, such as tri-axis and quaternion reports
+    template <typename T, size_t N>
+    static bool decodeFixedFloat(const std::vector<ReportTranslateRecord> &table,
+                                 const uint8_t *report, sensors_event_t *event);
+
+    // input decoder for any translate table
+    static bool decodeGeneric(const std::vector<ReportTranslateRecord> &table,
+                              const uint8_t *report, sensors_event_t *event);
+
     // dump data for test/debug purpose
     std::string dump() const;
 
     // Features for control sensor
     int mReportingStateId;
     unsigned int mReportingStateOffset;
+    size_t mReportingStateReportSize;
 
     int mPowerStateId;
     unsigned int mPowerStateOffset;
+    size_t mPowerStateReportSize;
 
     int mReportIntervalId;
     unsigned int mReportIntervalOffset;
     unsigned int mReportIntervalSize;
+    size_t mReportIntervalReportSize;
+
+    // holds any of the control feature reports above
+    std::vector<uint8_t> mFeatureBuffer;
 
     // Input report translate table
     std::vector<ReportTranslateRecord> mTranslateTable;
     unsigned mInputReportId;
+    InputDecoder mInputDecoder;
+    size_t mInputReportSize;
+
+    // Hardware timestamp in the input report, mTimestampSize is 0 if there is none
+    size_t mTimestampOffset;
+    size_t mTimestampSize;
+    double mTimestampScale;     // ns per raw unit
+    uint64_t mTimestampLastRaw;
+    uint64_t mTimestampWraps;
+    ClockDomainEstimator mClockEstimator;
 
     FeatureValue mFeatureInfo;
     sensor_t mSensor;
@@ -19,6 +19,7 @@
 #include "HidRawSensorDevice.h"
 
 #include <utils/Log.h>
+#include <utils/Looper.h>
 #include <utils/SystemClock.h>
 
 #include <errno.h>
@@ -41,9 +42,26 @@ HidRawSensorDaemon::HidRawSensorDaemon(DynamicSensorManager& manager)
             this, std::string(DEV_PATH), std::string(DEV_NAME_REGEX));
 }
 
+HidRawSensorDaemon::~HidRawSensorDaemon() {
+    // stops and joins the detector thread first, so that devices are not in use while being
+    // stopped. Clearing mDetector alone would not: the running thread holds a reference to it.
+    mDetector->stop();
+    mDetector.clear();
+    for (auto &i : mHidRawSensorDevices) {
+        i.second->stop();
+    }
+}
+
 BaseSensorVector HidRawSensorDaemon::createSensor(const std::string &deviceKey) {
     BaseSensorVector ret;
-    sp<HidRawSensorDevice> device(HidRawSensorDevice::create(deviceKey));
+    // called on the detector thread, possibly before mDetector is set; the device is added to
+    // the looper of that thread, which then reads its input too
+    sp<Looper> looper(Looper::getForThread());
+    if (looper == nullptr) {
+        ALOGE("createSensor called without a looper");
+        return ret;
+    }
+    sp<HidRawSensorDevice> device(HidRawSensorDevice::create(deviceKey, looper));
 
     if (device != nullptr) {
         ALOGV("created HidRawSensorDevice(%p) successfully on device %s contains %zu sensors",
@@ -63,7 +81,11 @@ BaseSensorVector HidRawSensorDaemon::createSensor(const std::string &deviceKey)
 }
 
 void HidRawSensorDaemon::removeSensor(const std::string &deviceKey) {
-    mHidRawSensorDevices.erase(deviceKey);
+    auto i = mHidRawSensorDevices.find(deviceKey);
+    if (i != mHidRawSensorDevices.end()) {
+        i->second->stop();
+        mHidRawSensorDevices.erase(i);
+    }
 }
 
 } // namespace SensorHalExt
@@ -38,13 +38,13 @@ namespace android {
 namespace SensorHalExt {
 
 class HidRawSensorDevice;
-class ConnectionDetector;
+class FileConnectionDetector;
 
 class HidRawSensorDaemon : public BaseDynamicSensorDaemon {
     friend class HidRawSensorDaemonTest;
 public:
     HidRawSensorDaemon(DynamicSensorManager& manager);
-    virtual ~HidRawSensorDaemon() = default;
+    virtual ~HidRawSensorDaemon();
 private:
     virtual BaseSensorVector createSensor(const std::string &deviceKey);
     virtual void removeSensor(const std::string &deviceKey);
@@ -52,7 +52,8 @@ private:
     class HidRawSensor;
     void registerExisting();
 
-    sp<ConnectionDetector> mDetector;
+    // its thread also reads the input of every device
+    sp<FileConnectionDetector> mDetector;
     std::unordered_map<std::string, sp<HidRawSensorDevice>> mHidRawSensorDevices;
 };
 
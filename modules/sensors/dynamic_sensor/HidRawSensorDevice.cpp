@@ -35,8 +35,9 @@ using namespace Hid::Sensor::PropertyUsage;
 const std::unordered_set<unsigned int> HidRawSensorDevice::sInterested{
         ACCELEROMETER_3D, GYROMETER_3D, COMPASS_3D, CUSTOM};
 
-sp<HidRawSensorDevice> HidRawSensorDevice::create(const std::string &devName) {
-    sp<HidRawSensorDevice> device(new HidRawSensorDevice(devName));
+sp<HidRawSensorDevice> HidRawSensorDevice::create(
+        const std::string &devName, const sp<Looper> &looper) {
+    sp<HidRawSensorDevice> device(new HidRawSensorDevice(devName, looper));
     // offset +1 strong count added by constructor
     device->decStrong(device.get());
 
@@ -47,9 +48,8 @@ sp<HidRawSensorDevice> HidRawSensorDevice::create(const std::string &devName) {
     }
 }
 
-HidRawSensorDevice::HidRawSensorDevice(const std::string &devName)
-        : RefBase(), HidRawDevice(devName, sInterested),
-          Thread(false /*canCallJava*/), mValid(false) {
+HidRawSensorDevice::HidRawSensorDevice(const std::string &devName, const sp<Looper> &looper)
+        : RefBase(), HidRawDevice(devName, sInterested), mLooper(looper), mValid(false) {
     // create HidRawSensor objects from digest
     // HidRawSensor object will take sp<HidRawSensorDevice> as parameter, so increment strong count
     // to prevent "this" being destructed.
@@ -74,39 +74,63 @@ HidRawSensorDevice::HidRawSensorDevice(const std::string &devName)
         return;
     }
 
-    run("HidRawSensor");
+    if (mLooper->addFd(getFd(), 0, Looper::EVENT_INPUT, this, nullptr) != 1) {
+        ALOGE("Cannot add hidraw device %s to looper", devName.c_str());
+        return;
+    }
     mValid = true;
 }
 
 HidRawSensorDevice::~HidRawSensorDevice() {
     ALOGV("~HidRawSensorDevice %p", this);
-    requestExitAndWait();
-    ALOGV("~HidRawSensorDevice %p, thread exited", this);
+    // the fd is closed by ~HidRawDevice, after it is surely out of the looper
+    stop();
 }
 
-bool HidRawSensorDevice::threadLoop() {
-    ALOGV("Hid Raw Device thread started %p", this);
-    std::vector<uint8_t> buffer;
-    bool ret;
-    uint8_t usageId;
+void HidRawSensorDevice::stop() {
+    if (getFd() >= 0) {
+        mLooper->removeFd(getFd());
+    }
+}
 
-    while(!Thread::exitPending()) {
-        ret = receiveReport(&usageId, &buffer);
-        if (!ret) {
-            break;
-        }
+int HidRawSensorDevice::handleEvent(int /*fd*/, int /*events*/, void * /*data*/) {
+    // a removed device reports an error or hangup, and the read fails
+    if (!readReports(&mReportBatch)) {
+        ALOGI("Hid Raw Device input ended for %p", this);
+        return 0; // removes the fd, and the reference of looper
+    }
+    dispatchReports(mReportBatch);
+    // the looper calls again if reports are left because the batch is full
+    return 1;
+}
+
+void HidRawSensorDevice::dispatchReports(const ReportBatch &batch) {
+    HidRawSensor *pending = nullptr;
+    size_t count = 0;
 
-        auto i = mSensors.find(usageId);
-        if (i == mSensors.end()) {
-            ALOGW("Input of unknow usage id %u received", usageId);
+    for (size_t i = 0; i < batch.count; ++i) {
+        const ReportBatch::Report &report = batch.reports[i];
+        auto s = mSensors.find(report.id);
+        if (s == mSensors.end()) {
+            ALOGW("Input of unknow usage id %u received", report.id);
             continue;
         }
 
-        i->second->handleInput(usageId, buffer);
+        HidRawSensor *sensor = s->second.get();
+        if (sensor != pending && count > 0) {
+            pending->submitEvents(mEvents, count);
+            count = 0;
+        }
+        pending = sensor;
+        if (sensor->decodeInput(report.id, report.data, report.size, report.receivedNs,
+                                &mEvents[count])) {
+            ++count;
+        }
     }
 
-    ALOGI("Hid Raw Device thread ended for %p", this);
-    return false;
+    if (count > 0) {
+        pending->submitEvents(mEvents, count);
+    }
 }
 
 BaseSensorVector HidRawSensorDevice::getSensors() const {
@@ -22,29 +22,44 @@
 #include "HidRawSensor.h"
 
 #include <HidParser.h>
-#include <utils/Thread.h>
+#include <utils/Looper.h>
 #include <string>
 #include <vector>
 
 namespace android {
 namespace SensorHalExt {
 
-class HidRawSensorDevice : public HidRawDevice, public Thread {
+// Sensors of one hidraw device. Input of the device is read and dispatched by a callback on
+// looper, so that one thread serves every device added to the same looper.
+class HidRawSensorDevice : public HidRawDevice, public LooperCallback {
 public:
-    static sp<HidRawSensorDevice> create(const std::string &devName);
+    static sp<HidRawSensorDevice> create(const std::string &devName, const sp<Looper> &looper);
     virtual ~HidRawSensorDevice();
 
     // get a list of sensors associated with this device
     BaseSensorVector getSensors() const;
+
+    // stop reading input. looper holds a reference to the device until then, or until the
+    // device fails. Call from the looper thread, or after it stopped polling.
+    void stop();
 private:
     static const std::unordered_set<unsigned int> sInterested;
 
     // constructor will result in +1 strong count
-    explicit HidRawSensorDevice(const std::string &devName);
-    // implement function of Thread
-    virtual bool threadLoop() override;
+    HidRawSensorDevice(const std::string &devName, const sp<Looper> &looper);
+    // implement function of LooperCallback
+    virtual int handleEvent(int fd, int events, void *data) override;
+    // decode a batch of reports and submit the events, stamped with the time each report was
+    // read at, one call per run of the same sensor
+    void dispatchReports(const ReportBatch &batch);
+
     std::unordered_map<unsigned int/*reportId*/, sp<HidRawSensor>> mSensors;
+    sp<Looper> mLooper;
     bool mValid;
+
+    // reused by every handleEvent() call
+    ReportBatch mReportBatch;
+    sensors_event_t mEvents[ReportBatch::kMaxReports];
 };
 
 } // namespace SensorHalExt
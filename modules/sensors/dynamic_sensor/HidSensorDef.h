@@ -74,6 +74,7 @@ enum {
     MAGNETIC_FLUX_Z_AXIS = 0x200487,
     MAGNETOMETER_ACCURACY = 0x200488,
     ORIENTATION_QUATERNION = 0x200483,
+    TIMESTAMP = 0x200529,
 };
 } // namespace ReportUsage
 
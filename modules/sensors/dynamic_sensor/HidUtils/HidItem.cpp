@@ -15,8 +15,9 @@
  */
 #include "HidItem.h"
 #include "HidDefs.h"
-#include "StreamIoUtil.h"
+#include <algorithm>
 #include <iostream>
+#include <iterator>
 
 namespace HidUtil {
 
@@ -41,38 +42,90 @@ bool HidItem::dataAsSigned(int *out) const {
         return false;
     }
     size_t bitSize_1 = data.size() * 8 - 1;
-    unsigned int sign = u & (1 << bitSize_1);
-    *out = u | ((sign == 0) ? 0 : ( ~0 << bitSize_1));
+    unsigned int sign = u & (1u << bitSize_1);
+    *out = u | ((sign == 0) ? 0 : (~0u << bitSize_1));
     return true;
 }
 
-std::vector<HidItem> HidItem::tokenize(const uint8_t *begin, size_t size) {
-    // construct a stream
-    charvectorbuf<unsigned char> buf(begin, size);
-    std::istream is(&buf);
-    return tokenize(is);
+void HidItemData::assign(const uint8_t *begin, size_t size) {
+    mSize = size;
+    if (size <= kInlineSize) {
+        std::copy(begin, begin + size, mInline);
+        mLong.clear();
+    } else {
+        mLong.assign(begin, begin + size);
+    }
 }
 
-std::vector<HidItem> HidItem::tokenize(const std::vector<uint8_t> &descriptor) {
-    // construct a stream
-    charvectorbuf<unsigned char> buf(descriptor);
-    std::istream is(&buf);
-    return tokenize(is);
+HidItem HidItem::read(const uint8_t *begin, size_t size, size_t offset) {
+    using namespace HidUtil::HidDef::MainTag;
+    using namespace HidUtil::HidDef::TagType;
+
+    HidItem h;
+    h.valid = false;
+    h.type = 0;
+    h.tag = 0;
+    h.offset = offset;
+    h.byteSize = 0;
+    if (offset >= size) {
+        return h;
+    }
+
+    const uint8_t *p = begin + offset;
+    const uint8_t *end = begin + size;
+    static const size_t lenTable[] = { 0, 1, 2, 4 };
+    uint8_t first = *p++;
+    size_t len = lenTable[first & 0x3]; // low 2 bits are length descriptor
+    h.tag = (first >> 4);
+    h.type = (first & 0xC) >> 2;
+
+    if (h.tag == LONG_ITEM && h.type == RESERVED) { // long item
+        if (end - p < 2) {
+            return h;
+        }
+        len = *p++;
+        h.tag = *p++;
+    }
+
+    if (static_cast<size_t>(end - p) < len) {
+        return h;
+    }
+    h.data.assign(p, len);
+    p += len;
+    h.byteSize = p - (begin + offset);
+    h.valid = true;
+    return h;
 }
 
-std::vector<HidItem> HidItem::tokenize(std::istream &is) {
+std::vector<HidItem> HidItem::tokenize(const uint8_t *begin, size_t size) {
     std::vector<HidItem> hidToken;
+    // most items are 1 or 2 bytes
+    hidToken.reserve(size / 2 + 1);
 
-    // this is important to avoid skipping characters
-    is.unsetf(std::ios_base::skipws);
-    while (!is.eof()) {
-        HidItem i;
-        is >> i;
-        if (i.valid) {
-            hidToken.push_back(i);
-        } else {
+    size_t offset = 0;
+    while (offset < size) {
+        HidItem i = read(begin, size, offset);
+        if (!i.valid) {
             break;
         }
+        offset += i.byteSize;
+        hidToken.push_back(std::move(i));
+    }
+    return hidToken;
+}
+
+std::vector<HidItem> HidItem::tokenize(const std::vector<uint8_t> &descriptor) {
+    return tokenize(descriptor.data(), descriptor.size());
+}
+
+std::vector<HidItem> HidItem::tokenize(std::istream &is) {
+    std::streamoff base = std::max<std::streamoff>(is.tellg(), 0);
+    std::vector<uint8_t> descriptor(
+            (std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+
+    std::vector<HidItem> hidToken = tokenize(descriptor);
+    for (auto &i : hidToken) {
+        i.offset += base;
     }
     return hidToken;
 }
@@ -101,13 +154,14 @@ std::istream& operator>>(std::istream &is, HidUtil::HidItem &h) {
             h.tag = b;
         }
 
-        h.data.resize(len);
-        for (auto &i : h.data) {
+        std::vector<uint8_t> data(len);
+        for (auto &i : data) {
             if (is.eof()) {
                 break;
             }
             is >> i;
         }
+        h.data.assign(data.data(), data.size());
         h.byteSize = (ssize_t) is.tellg() - h.offset;
         h.valid = !is.eof();
     }
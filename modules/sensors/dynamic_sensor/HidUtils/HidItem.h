@@ -16,6 +16,7 @@
 #ifndef HIDUTIL_HIDITEM_H_
 #define HIDUTIL_HIDITEM_H_
 
+#include <cstdint>
 #include <cstdlib>
 #include <vector>
 #include <istream>
@@ -23,13 +24,35 @@
 
 namespace HidUtil {
 
+// Data bytes of a HidItem. Short items carry at most 4 bytes, which are stored inline; only long
+// items, which are rare, keep theirs on the heap.
+class HidItemData {
+public:
+    HidItemData() : mSize(0), mInline{} {}
+
+    void assign(const uint8_t *begin, size_t size);
+
+    size_t size() const { return mSize; }
+    bool empty() const { return mSize == 0; }
+    const uint8_t *begin() const { return mSize <= kInlineSize ? mInline : mLong.data(); }
+    const uint8_t *end() const { return begin() + mSize; }
+    uint8_t operator[](size_t i) const { return begin()[i]; }
+
+private:
+    static constexpr size_t kInlineSize = 4;
+
+    size_t mSize;
+    uint8_t mInline[kInlineSize];
+    std::vector<uint8_t> mLong;
+};
+
 struct HidItem {
     bool valid;
     unsigned int type;
     unsigned int tag;
     ssize_t offset;
     ssize_t byteSize;
-    std::vector<uint8_t> data;
+    HidItemData data;
 
     bool dataAsUnsigned(unsigned int *out) const;
     bool dataAsSigned(int *out) const;
@@ -38,9 +61,14 @@ struct HidItem {
     friend std::istream& operator>>(std::istream &is, HidItem &h);
     friend std::ostream& operator<<(std::ostream &os, const HidItem &h);
 
+    // read one item at offset of the size bytes at begin; returns the item, which is not valid
+    // if it is truncated
+    static HidItem read(const uint8_t *begin, size_t size, size_t offset);
+
     // tokenize from a unsigned char vector
     static std::vector<HidItem> tokenize(const std::vector<uint8_t> &descriptor);
     static std::vector<HidItem> tokenize(const uint8_t *begin, size_t size);
+    // tokenize the rest of a stream; offsets are positions in the stream
     static std::vector<HidItem> tokenize(std::istream &is);
 };
 
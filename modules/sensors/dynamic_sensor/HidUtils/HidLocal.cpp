@@ -23,6 +23,8 @@ namespace HidUtil {
 constexpr uint32_t INVALID_USAGE = 0xFFFF;
 constexpr uint32_t INVALID_DESIGNATOR = 0xFFFF;
 constexpr uint32_t INVALID_STRING = 0xFFFF;
+// a usage page has 0x10000 usages; a min/max range longer than that is malformed
+constexpr uint32_t MAX_RANGE = 0xFFFF;
 
 uint32_t HidLocal::getUsage(size_t index) const {
     if (usage.empty()) {
@@ -70,9 +72,14 @@ bool HidLocal::append(const HidItem &i) {
             if (!usageMin.isSet()) {
                 LOG_E << "usage min not set when saw usage max " << i << LOG_ENDL;
                 ret = false;
+            } else if (unsignedError) {
+                valueError = true;
+            } else if (unsignedInteger > usageMin.get(0)
+                    && unsignedInteger - usageMin.get(0) > MAX_RANGE) {
+                LOG_E << "invalid usage range " << usageMin.get(0) << " to " << i << LOG_ENDL;
+                ret = false;
             } else {
                 uint32_t usagemax = unsignedInteger;
-                valueError = unsignedError;
                 for (size_t j = usageMin.get(0); j <= usagemax; ++j) {
                     usage.push_back(j);
                 }
@@ -88,12 +95,17 @@ bool HidLocal::append(const HidItem &i) {
             valueError = unsignedError;
             break;
         case STRING_MAXIMUM: {
-            if (!usageMin.isSet()) {
+            if (!stringMin.isSet()) {
                 LOG_E << "string min not set when saw string max " << i << LOG_ENDL;
                 ret = false;
+            } else if (unsignedError) {
+                valueError = true;
+            } else if (unsignedInteger > stringMin.get(0)
+                    && unsignedInteger - stringMin.get(0) > MAX_RANGE) {
+                LOG_E << "invalid string range " << stringMin.get(0) << " to " << i << LOG_ENDL;
+                ret = false;
             } else {
                 uint32_t stringMax = unsignedInteger;
-                valueError = unsignedError;
                 for (size_t j = stringMin.get(0); j <= stringMax; ++j) {
                     string.push_back(j);
                 }
@@ -24,8 +24,8 @@ namespace HidUtil {
 void HidParser::reset() {
     mGlobalStack = HidGlobalStack();
     mLocal = HidLocal();
-    mTree = std::make_shared<HidTreeNode>();
-    mCurrent = mTree;
+    mTree = HidTree();
+    mCurrent = HidTree::ROOT;
 }
 
 bool HidParser::parse(const std::vector<HidItem> &token) {
@@ -74,13 +74,12 @@ bool HidParser::processMainTag(const HidItem &i) {
             }
             unsigned int fullUsage =
                     mGlobalStack.top().usagePage.get(0) << 16 | mLocal.getUsage(0);
-            mCurrent = mCurrent->addChild(
-                    std::make_shared<HidTreeNode>(mCurrent, collectionType, fullUsage));
+            mCurrent = mTree.addChild(mCurrent, collectionType, fullUsage);
             break;
         }
         case END_COLLECTION:
-            mCurrent = mCurrent->getParent();
-            if (!mCurrent) {
+            mCurrent = mTree.getParent(mCurrent);
+            if (mCurrent == HidTree::NO_NODE) {
                 // trigger parse failure so that mCurrent will not be accessed
                 LOG_E << "unmatched END_COLLECTION at " << i.offset << LOG_ENDL;
                 ret = false;
@@ -116,8 +115,7 @@ bool HidParser::processMainTag(const HidItem &i) {
 
             HidReport report(reportType, flag, top, mLocal);
             mReport.push_back(report);
-            std::shared_ptr<HidTreeNode> node(new HidReportNode(mCurrent, report));
-            mCurrent->addChild(node);
+            mTree.addReport(mCurrent, report);
             break;
         }
         default:
@@ -135,22 +133,11 @@ bool HidParser::parse(const unsigned char *begin, size_t size) {
 }
 
 void HidParser::filterTree() {
-    if (mTree != nullptr) {
-        filterTree(mTree);
-    }
-}
-
-void HidParser::filterTree(std::shared_ptr<HidTreeNode> &node) {
-    if (node->isReportCollection()) {
-        std::shared_ptr<HidReportNode> reportNode =
-                std::static_pointer_cast<HidReportNode>(node->getChildren().front());
-        if (reportNode != nullptr) {
-            reportNode->collapse(node->getFullUsage());
-            node = reportNode;
-        }
-    } else {
-        for (auto &i : node->getChildren()) {
-            filterTree(i);
+    // Nodes are stored in descriptor order, which visits parents before their children, and a
+    // report collection has no collection below it, so one pass over the arena does it.
+    for (HidTree::NodeIndex i = 0; i < mTree.size(); ++i) {
+        if (mTree.isReportCollection(i)) {
+            mTree.collapse(i);
         }
     }
 }
@@ -158,30 +145,31 @@ void HidParser::filterTree(std::shared_ptr<HidTreeNode> &node) {
 HidParser::DigestVector HidParser::generateDigest(
         const std::unordered_set<unsigned int> &interestedUsage) {
     DigestVector digestVector;
-    digest(&digestVector, mTree, interestedUsage);
+    digest(&digestVector, mTree, HidTree::ROOT, interestedUsage);
     return digestVector;
 }
 
 void HidParser::digest(HidParser::DigestVector *digestVector,
-                       const std::shared_ptr<HidTreeNode> &node,
+                       const HidTree &tree,
+                       HidTree::NodeIndex node,
                        const std::unordered_set<unsigned int> &interestedUsage) {
     if (digestVector == nullptr) {
         return;
     }
 
-    if (node->isUsageCollection()
-            && interestedUsage.find(node->getFullUsage()) != interestedUsage.end()) {
+    if (tree.isUsageCollection(node)
+            && interestedUsage.find(tree.getFullUsage(node)) != interestedUsage.end()) {
         // this collection contains the usage interested
         ReportSetGroup reportSetGroup;
 
         // one layer deep search
-        for (auto &i : node->getChildren()) {
+        for (HidTree::NodeIndex i = tree.getFirstChild(node); i != HidTree::NO_NODE;
+                i = tree.getNextSibling(i)) {
             // skip all nodes that is not a report node
-            if (i->getNodeType() != HidTreeNode::TYPE_REPORT) {
+            if (tree.getNodeType(i) != HidTree::TYPE_REPORT) {
                 continue;
             }
-            const HidReport &report =
-                    std::static_pointer_cast<HidReportNode>(i)->getReport();
+            const HidReport &report = tree.getReport(i);
 
             unsigned int id = report.getReportId();;
             if (reportSetGroup.find(id) == reportSetGroup.end()) {
@@ -204,15 +192,16 @@ void HidParser::digest(HidParser::DigestVector *digestVector,
             }
         }
         ReportDigest digest = {
-            .fullUsage = node->getFullUsage(),
+            .fullUsage = tree.getFullUsage(node),
             .packets = convertGroupToPacket(reportSetGroup)
         };
         digestVector->emplace_back(digest);
     } else {
-        for (const auto &child : node->getChildren()) {
-            if (child->getNodeType() == HidTreeNode::TYPE_NORMAL) {
+        for (HidTree::NodeIndex child = tree.getFirstChild(node); child != HidTree::NO_NODE;
+                child = tree.getNextSibling(child)) {
+            if (tree.getNodeType(child) == HidTree::TYPE_NORMAL) {
                 // only follow into collection nodes
-                digest(digestVector, child, interestedUsage);
+                digest(digestVector, tree, child, interestedUsage);
             }
         }
     }
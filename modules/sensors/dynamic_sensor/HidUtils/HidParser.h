@@ -59,7 +59,7 @@ public:
     DigestVector generateDigest(const std::unordered_set<unsigned int> &interestedUsage);
 
     // get parsed tree (filtered or not filtered)
-    const std::shared_ptr<HidTreeNode> getTree() const { return mTree; }
+    const HidTree& getTree() const { return mTree; }
 
     // get all parsed report in a parsed form.
     const std::vector<HidReport>& getReport() const { return mReport; }
@@ -71,17 +71,17 @@ private:
     // helper subroutines
     void reset();
     bool processMainTag(const HidItem &i);
-    static void filterTree(std::shared_ptr<HidTreeNode> &node);
     static void digest(
             DigestVector *digestVector,
-            const std::shared_ptr<HidTreeNode> &node,
+            const HidTree &tree,
+            HidTree::NodeIndex node,
             const std::unordered_set<unsigned int> &interestedUsage);
     static std::vector<ReportPacket> convertGroupToPacket(const ReportSetGroup &group);
 
     HidGlobalStack mGlobalStack;
     HidLocal mLocal;
-    std::shared_ptr<HidTreeNode> mTree;
-    std::shared_ptr<HidTreeNode> mCurrent;
+    HidTree mTree;
+    HidTree::NodeIndex mCurrent;
     std::vector<HidReport> mReport;
 };
 
@@ -139,7 +139,8 @@ struct HidParser::ReportItem {
             return false;
         }
         input = input / a - b;
-        if (input < minRaw || input > maxRaw) {
+        // written so that NaN, from a report with an empty logical range, is out of range too
+        if (!(input >= minRaw && input <= maxRaw)) {
             return false;
         }
         *output = static_cast<uint32_t>(static_cast<int64_t>(input) & rawMask());
@@ -157,7 +158,8 @@ struct HidParser::ReportItem {
 
     bool isNegative(int64_t value) const {
         constexpr int64_t one = 1;
-        return ((one << (bitSize - 1)) & value) != 0;
+        // a report of size 0 has no sign bit
+        return bitSize != 0 && ((one << (bitSize - 1)) & value) != 0;
     }
 };
 
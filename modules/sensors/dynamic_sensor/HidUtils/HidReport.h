@@ -27,7 +27,6 @@
 namespace HidUtil {
 
 class HidParser;
-class HidTreeNode;
 
 // HidReport represent an input, output or feature report
 class HidReport {
@@ -16,112 +16,90 @@
 #include "HidDefs.h"
 #include "HidLog.h"
 #include "HidTree.h"
-#include <memory>
+#include <algorithm>
+#include <iterator>
 
 namespace HidUtil {
 
-// HidTreeNode
-HidTreeNode::HidTreeNode() : mNodeType(TYPE_UNINITIALIZED), mData(0), mFullUsage(0) {
+HidTree::HidTree() {
+    mNodes.push_back({TYPE_UNINITIALIZED, 0, 0, NO_NODE, NO_NODE, NO_NODE, NO_NODE, 0});
 }
 
-HidTreeNode::HidTreeNode(std::shared_ptr<HidTreeNode> parent,
-                         uint32_t data, uint32_t fullUsage, int nodeType)
-        : mNodeType(nodeType), mData(data),
-        mFullUsage(fullUsage), mParent(parent) {
-}
-
-HidTreeNode::HidTreeNode(std::shared_ptr<HidTreeNode> parent,
-                         uint32_t data, uint32_t fullUsage)
-        : mNodeType(TYPE_NORMAL), mData(data),
-        mFullUsage(fullUsage), mParent(parent) {
-}
-
-void HidTreeNode::outputRecursive(std::ostream &os, int level) const {
-    insertIndentation(os, level);
-    os << "Node data: " << mData
-       << ", usage " << std::hex << mFullUsage << std::dec << LOG_ENDL;
-
-    for (auto &child : mChildren) {
-        child->outputRecursive(os, level + 1);
-    }
-}
+HidTree::NodeIndex HidTree::addNode(NodeIndex parent, const Node &node) {
+    NodeIndex index = static_cast<NodeIndex>(mNodes.size());
+    mNodes.push_back(node);
 
-std::shared_ptr<HidTreeNode> HidTreeNode::deepCopy(
-        std::shared_ptr<HidTreeNode> parent) const {
-    std::shared_ptr<HidTreeNode> copy(new HidTreeNode(parent, mData, mFullUsage, mNodeType));
-    for (auto &i : mChildren) {
-        copy->mChildren.push_back(i->deepCopy(copy));
+    Node &p = mNodes[parent];
+    if (p.lastChild == NO_NODE) {
+        p.firstChild = index;
+    } else {
+        mNodes[p.lastChild].nextSibling = index;
     }
-    return copy;
-}
-
-void HidTreeNode::insertIndentation(std::ostream &os, int level) const {
-    constexpr char indentCharacter = '\t';
-    std::fill_n(std::ostreambuf_iterator<char>(os), level, indentCharacter);
-}
-
-std::shared_ptr<HidTreeNode> HidTreeNode::addChild(std::shared_ptr<HidTreeNode> child) {
-    mChildren.push_back(child);
-    return child;
+    p.lastChild = index;
+    return index;
 }
 
-std::shared_ptr<HidTreeNode> HidTreeNode::getParent() const {
-    return mParent.lock();
+HidTree::NodeIndex HidTree::addChild(NodeIndex parent, uint32_t data, uint32_t fullUsage) {
+    return addNode(parent, {TYPE_NORMAL, data, fullUsage, parent, NO_NODE, NO_NODE, NO_NODE, 0});
 }
 
-bool HidTreeNode::isReportCollection() const {
-    return mNodeType == TYPE_NORMAL && mChildren.size() == 1
-            && mChildren.front()->mNodeType == TYPE_REPORT;
+HidTree::NodeIndex HidTree::addReport(NodeIndex parent, const HidReport &report) {
+    uint32_t reportIndex = static_cast<uint32_t>(mReports.size());
+    mReports.push_back(report);
+    return addNode(parent,
+            {TYPE_REPORT, 0 /*data*/, 0 /*fullUsage*/, parent, NO_NODE, NO_NODE, NO_NODE,
+             reportIndex});
 }
 
-unsigned int HidTreeNode::getFullUsage() const {
-    return mFullUsage;
+bool HidTree::isReportCollection(NodeIndex node) const {
+    const Node &n = mNodes[node];
+    return n.type == TYPE_NORMAL && n.firstChild != NO_NODE
+            && n.firstChild == n.lastChild && mNodes[n.firstChild].type == TYPE_REPORT;
 }
 
-std::vector<std::shared_ptr<HidTreeNode>>& HidTreeNode::getChildren() {
-    return mChildren;
-}
-
-const std::vector<std::shared_ptr<HidTreeNode>>& HidTreeNode::getChildren() const {
-    return mChildren;
-}
-
-bool HidTreeNode::isUsageCollection() const {
+bool HidTree::isUsageCollection(NodeIndex node) const {
     using namespace HidDef::CollectionType;
-    return mNodeType == TYPE_NORMAL && (mData == PHYSICAL || mData == APPLICATION);
+    const Node &n = mNodes[node];
+    return n.type == TYPE_NORMAL && (n.data == PHYSICAL || n.data == APPLICATION);
 }
 
-int HidTreeNode::getNodeType() const {
-    return mNodeType;
+const HidReport& HidTree::getReport(NodeIndex node) const {
+    return mReports[mNodes[node].report];
 }
 
-std::ostream& operator<<(std::ostream& os, const HidTreeNode& n) {
-    n.outputRecursive(os, 0);
-    return os;
-}
+void HidTree::collapse(NodeIndex node) {
+    Node &n = mNodes[node];
+    const Node &child = mNodes[n.firstChild];
+    mReports[child.report].setCollapsed(n.fullUsage);
 
-// HidReportNode
-HidReportNode::HidReportNode(std::shared_ptr<HidTreeNode> parent, const HidReport &report)
-    : HidTreeNode(parent, 0 /*data*/, 0 /*fullUsage*/, TYPE_REPORT), mReport(report) {
+    n.type = TYPE_REPORT;
+    n.data = 0;
+    n.fullUsage = 0;
+    n.report = child.report;
+    n.firstChild = NO_NODE;
+    n.lastChild = NO_NODE;
 }
 
-void HidReportNode::outputRecursive(std::ostream &os, int level) const {
-    insertIndentation(os, level);
-    os << mReport << LOG_ENDL;
-}
+void HidTree::outputRecursive(std::ostream &os, NodeIndex node, int level) const {
+    constexpr char indentCharacter = '\t';
+    std::fill_n(std::ostreambuf_iterator<char>(os), level, indentCharacter);
 
-std::shared_ptr<HidTreeNode> HidReportNode::deepCopy(
-        std::shared_ptr<HidTreeNode> parent) const {
-    std::shared_ptr<HidTreeNode> copy(new HidReportNode(parent, mReport));
-    return copy;
-}
+    const Node &n = mNodes[node];
+    if (n.type == TYPE_REPORT) {
+        os << mReports[n.report] << LOG_ENDL;
+        return;
+    }
+    os << "Node data: " << n.data
+       << ", usage " << std::hex << n.fullUsage << std::dec << LOG_ENDL;
 
-const HidReport& HidReportNode::getReport() const {
-    return mReport;
+    for (NodeIndex i = n.firstChild; i != NO_NODE; i = mNodes[i].nextSibling) {
+        outputRecursive(os, i, level + 1);
+    }
 }
 
-void HidReportNode::collapse(unsigned int newUsage) {
-    mReport.setCollapsed(newUsage);
+std::ostream& operator<<(std::ostream& os, const HidTree& t) {
+    t.outputRecursive(os, HidTree::ROOT, 0);
+    return os;
 }
 
 } //namespace HidUtil
@@ -19,84 +19,85 @@
 #include "HidReport.h"
 
 #include <cstddef>
+#include <cstdint>
 #include <vector>
 #include <iostream>
 
 namespace HidUtil {
 
-// HID report parser output tree node
-class HidTreeNode {
-    friend std::ostream& operator<<(std::ostream& os, const HidTreeNode& n);
+// HID report parser output tree
+//
+// Nodes live in one arena in the order they are added and refer to each other by index, so that
+// the tree is traversed without chasing pointers and copied with two vector copies. The root node
+// is always at index ROOT. Children of a node are linked through their next sibling.
+class HidTree {
+    friend std::ostream& operator<<(std::ostream& os, const HidTree& t);
 public:
+    typedef uint32_t NodeIndex;
+    static constexpr NodeIndex ROOT = 0;
+    static constexpr NodeIndex NO_NODE = UINT32_MAX;
+
     enum {
         TYPE_UNINITIALIZED = 0,
         TYPE_NORMAL = 1,
-        TYPE_REPORT = 2     // can be cast to HidReportNode
+        TYPE_REPORT = 2     // has a HidReport
     };
-    HidTreeNode();
-    HidTreeNode(std::shared_ptr<HidTreeNode> parent, uint32_t data, uint32_t fullUsage);
 
-    virtual ~HidTreeNode() = default;
+    // tree of a root node only
+    HidTree();
 
-    // make a deep copy of tree at and below this node and attach it to specified parent node
-    virtual std::shared_ptr<HidTreeNode> deepCopy(
-          std::shared_ptr<HidTreeNode> parent = nullptr) const;
+    // add a collection node as the last child of parent, returns its index
+    NodeIndex addChild(NodeIndex parent, uint32_t data, uint32_t fullUsage);
 
-    // add child to this node
-    std::shared_ptr<HidTreeNode> addChild(std::shared_ptr<HidTreeNode> child);
+    // add a report node as the last child of parent, returns its index
+    NodeIndex addReport(NodeIndex parent, const HidReport &report);
 
-    // get all children of a node
-    std::vector<std::shared_ptr<HidTreeNode>>& getChildren();
-    const std::vector<std::shared_ptr<HidTreeNode>>& getChildren() const;
+    // parent of node, NO_NODE for the root node
+    NodeIndex getParent(NodeIndex node) const { return mNodes[node].parent; }
 
-    // get parent (nullptr if it is root node or if lock weak_ptr failed)
-    std::shared_ptr<HidTreeNode> getParent() const;
+    // first child of node and the next sibling of a child, NO_NODE if there is none
+    NodeIndex getFirstChild(NodeIndex node) const { return mNodes[node].firstChild; }
+    NodeIndex getNextSibling(NodeIndex node) const { return mNodes[node].nextSibling; }
 
-    // access usage of this node
-    unsigned int getFullUsage() const;
+    // access usage of node
+    unsigned int getFullUsage(NodeIndex node) const { return mNodes[node].fullUsage; }
+    int getNodeType(NodeIndex node) const { return mNodes[node].type; }
 
-    bool isReportCollection() const;
-    bool isUsageCollection() const;
-    int getNodeType() const;
-protected:
-    // for derived class to define different nodeType
-    HidTreeNode(std::shared_ptr<HidTreeNode> parent,
-              uint32_t data, uint32_t fullUsage, int nodeType);
+    bool isReportCollection(NodeIndex node) const;
+    bool isUsageCollection(NodeIndex node) const;
 
-    // helper for stream output
-    void insertIndentation(std::ostream &os, int level) const;
-private:
-    // helper for stream output
-    virtual void outputRecursive(std::ostream& os, int level) const;
+    // obtain HidReport attached to a node of TYPE_REPORT
+    const HidReport& getReport(NodeIndex node) const;
 
-    int mNodeType;
-    uint32_t mData;
-    uint32_t mFullUsage;
+    // turn node, which must be a report collection, into its only child report node, with the
+    // report collapsed to the usage of node
+    void collapse(NodeIndex node);
 
-    std::vector<std::shared_ptr<HidTreeNode>> mChildren;
-    std::weak_ptr<HidTreeNode> mParent;
-};
+    // number of nodes in the arena, including children detached by collapse()
+    size_t size() const { return mNodes.size(); }
 
-// Tree node that corresponds to an input, output or feature report
-class HidReportNode : public HidTreeNode {
-public:
-    HidReportNode(std::shared_ptr<HidTreeNode> parent, const HidReport &report);
-
-    virtual std::shared_ptr<HidTreeNode> deepCopy(
-          std::shared_ptr<HidTreeNode> parent = nullptr) const override;
+private:
+    struct Node {
+        int type;
+        uint32_t data;
+        uint32_t fullUsage;
+        NodeIndex parent;
+        NodeIndex firstChild;
+        NodeIndex lastChild;
+        NodeIndex nextSibling;
+        uint32_t report;        // index in mReports of a TYPE_REPORT node
+    };
 
-    // obtain HidReport attached to this node
-    const HidReport& getReport() const;
+    NodeIndex addNode(NodeIndex parent, const Node &node);
 
-    // reset usage of node and set underlying report to collapsed
-    void collapse(unsigned int newUsage);
-private:
-    virtual void outputRecursive(std::ostream &os, int level) const override;
+    // helper for stream output
+    void outputRecursive(std::ostream &os, NodeIndex node, int level) const;
 
-    HidReport mReport;
+    std::vector<Node> mNodes;
+    std::vector<HidReport> mReports;
 };
 
-std::ostream& operator<<(std::ostream& os, const HidTreeNode& n);
+std::ostream& operator<<(std::ostream& os, const HidTree& t);
 
 } // namespace HidUtil
 
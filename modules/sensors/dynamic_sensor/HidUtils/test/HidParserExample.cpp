@@ -33,7 +33,7 @@ bool doParse() {
 
         if (parseResult) {
             LOG_V << name << "  filtered tree: " << LOG_ENDL;
-            LOG_V << *(hidParser.getTree());
+            LOG_V << hidParser.getTree();
         } else {
             ret = false;
             LOG_E << name << " parsing error!" << LOG_ENDL;
@@ -56,7 +56,7 @@ bool doParseAndFilter() {
         if (parseResult) {
             hidParser.filterTree();
             LOG_V << name << "  filtered tree: " << LOG_ENDL;
-            LOG_V << *(hidParser.getTree());
+            LOG_V << hidParser.getTree();
         } else {
             ret = false;
             LOG_E << name << " parsing error!" << LOG_ENDL;
@@ -54,16 +54,16 @@ int main() {
 
     // parse it
     if (hidParser.parse(hidItemVector)) {
-        // making a deepcopy of tree (not necessary, but for illustration)
-        std::shared_ptr<HidTreeNode> tree = hidParser.getTree()->deepCopy();
+        // making a copy of tree (not necessary, but for illustration)
+        HidTree tree = hidParser.getTree();
 
         LOG_V << "Tree: " << LOG_ENDL;
-        LOG_V << *tree;
+        LOG_V << tree;
         LOG_V << LOG_ENDL;
 
         hidParser.filterTree();
         LOG_V << "FilteredTree: " << LOG_ENDL;
-        LOG_V << *(hidParser.getTree());
+        LOG_V << hidParser.getTree();
 
         LOG_V << "DigestVector: " << LOG_ENDL;
         std::unordered_set<unsigned int> interested = {ACCEL_3D_USAGE};
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "HidParser.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+
+// Fuzzer of the HidUtils descriptor path: the input is tokenized and parsed as a report
+// descriptor, and when it parses, the tree is filtered and digested for the usage of every
+// collection in it, and every report item of the digest decodes and encodes values taken from
+// the input, the way HidRawSensor does with reports of a device.
+//
+// Run it like this:
+//
+// m hidparser_fuzzer
+// out/host/linux-x86/fuzz/x86_64/hidparser_fuzzer/hidparser_fuzzer
+
+using namespace HidUtil;
+
+static void collectUsages(const HidTree &tree, HidTree::NodeIndex node,
+                          std::unordered_set<unsigned int> *usages) {
+    for (HidTree::NodeIndex i = tree.getFirstChild(node); i != HidTree::NO_NODE;
+            i = tree.getNextSibling(i)) {
+        if (tree.getNodeType(i) == HidTree::TYPE_NORMAL) {
+            usages->insert(tree.getFullUsage(i));
+            collectUsages(tree, i, usages);
+        }
+    }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    std::vector<HidItem> tokens = HidItem::tokenize(data, size);
+    HidParser parser;
+    if (!parser.parse(tokens)) {
+        return 0;
+    }
+    parser.filterTree();
+
+    std::unordered_set<unsigned int> usages;
+    collectUsages(parser.getTree(), HidTree::ROOT, &usages);
+    HidParser::DigestVector digest = parser.generateDigest(usages);
+
+    // the dump goes through every report and item, as the HAL does when it logs a device
+    std::ostringstream os;
+    os << parser.getTree() << digest;
+
+    size_t next = 0;
+    for (const auto &d : digest) {
+        for (const auto &packet : d.packets) {
+            for (const auto &item : packet.reports) {
+                uint32_t raw = 0;
+                for (size_t i = 0; i < sizeof(raw) && size > 0; ++i, ++next) {
+                    raw = raw << 8 | data[next % size];
+                }
+                double value;
+                if (item.decode(static_cast<uint32_t>(raw & item.rawMask()), &value)) {
+                    uint32_t encoded;
+                    item.encode(value, &encoded);
+                }
+            }
+        }
+    }
+    return 0;
+}
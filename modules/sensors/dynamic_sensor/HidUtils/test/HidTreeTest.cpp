@@ -0,0 +1,322 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "HidDefs.h"
+#include "HidParser.h"
+#include "TestHidDescriptor.h"
+#include <gtest/gtest.h>
+
+#include <array>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <unordered_map>
+
+// Differential tests of HidTree and HidParser against the shared_ptr node graph they replaced,
+// which is kept here as the reference: trees and digests of every test descriptor have to be
+// the same.
+
+using namespace HidUtil;
+
+namespace {
+
+struct RefNode {
+    int type;
+    uint32_t data;
+    uint32_t fullUsage;
+    std::vector<std::shared_ptr<RefNode>> children;
+    std::weak_ptr<RefNode> parent;
+    std::shared_ptr<HidReport> report;
+};
+
+std::shared_ptr<RefNode> refParse(const TestHidDescriptor &d) {
+    using namespace HidDef::MainTag;
+    using namespace HidDef::TagType;
+
+    HidGlobalStack globalStack;
+    HidLocal local;
+    auto root = std::make_shared<RefNode>();
+    root->type = HidTree::TYPE_UNINITIALIZED;
+    root->data = 0;
+    root->fullUsage = 0;
+    std::shared_ptr<RefNode> current = root;
+
+    for (const HidItem &i : HidItem::tokenize(d.data, d.len)) {
+        if (i.type == GLOBAL) {
+            globalStack.append(i);
+            continue;
+        }
+        if (i.type == LOCAL) {
+            local.append(i);
+            continue;
+        }
+
+        auto node = std::make_shared<RefNode>();
+        node->parent = current;
+        switch (i.tag) {
+            case COLLECTION:
+                node->type = HidTree::TYPE_NORMAL;
+                i.dataAsUnsigned(&node->data);
+                node->fullUsage = globalStack.top().usagePage.get(0) << 16 | local.getUsage(0);
+                current->children.push_back(node);
+                current = node;
+                break;
+            case END_COLLECTION:
+                current = current->parent.lock();
+                if (current == nullptr) {
+                    return nullptr;
+                }
+                break;
+            default: {
+                unsigned int flag = 0;
+                i.dataAsUnsigned(&flag);
+                node->type = HidTree::TYPE_REPORT;
+                node->data = 0;
+                node->fullUsage = 0;
+                node->report = std::make_shared<HidReport>(i.tag, flag, globalStack.top(), local);
+                current->children.push_back(node);
+                break;
+            }
+        }
+        local.clear();
+    }
+    return root;
+}
+
+bool refIsReportCollection(const RefNode &node) {
+    return node.type == HidTree::TYPE_NORMAL && node.children.size() == 1
+            && node.children.front()->type == HidTree::TYPE_REPORT;
+}
+
+void refFilterTree(std::shared_ptr<RefNode> &node) {
+    if (refIsReportCollection(*node)) {
+        std::shared_ptr<RefNode> reportNode = node->children.front();
+        reportNode->report->setCollapsed(node->fullUsage);
+        node = reportNode;
+    } else {
+        for (auto &i : node->children) {
+            refFilterTree(i);
+        }
+    }
+}
+
+void refOutput(std::ostream &os, const RefNode &node, int level) {
+    std::fill_n(std::ostreambuf_iterator<char>(os), level, '\t');
+    if (node.type == HidTree::TYPE_REPORT) {
+        os << *node.report << std::endl;
+        return;
+    }
+    os << "Node data: " << node.data
+       << ", usage " << std::hex << node.fullUsage << std::dec << std::endl;
+    for (auto &child : node.children) {
+        refOutput(os, *child, level + 1);
+    }
+}
+
+std::string refToString(const RefNode &root) {
+    std::ostringstream os;
+    refOutput(os, root, 0);
+    return os.str();
+}
+
+std::vector<HidParser::ReportPacket> refConvertGroupToPacket(
+        const std::unordered_map<unsigned int, std::array<std::vector<HidReport>, 3>> &group) {
+    std::vector<HidParser::ReportPacket> packets;
+    for (const auto &setPair : group) {
+        unsigned int id = setPair.first;
+        for (int type : {HidParser::REPORT_TYPE_FEATURE, HidParser::REPORT_TYPE_INPUT,
+                         HidParser::REPORT_TYPE_OUTPUT}) {
+            HidParser::ReportPacket packet = {};
+            packet.type = type;
+            packet.id = id;
+            for (const auto &r : setPair.second[type]) {
+                auto logical = r.getLogicalRange();
+                auto physical = r.getPhysicalRange();
+                HidParser::ReportItem item = {};
+                item.usage = r.getFullUsage();
+                item.id = id;
+                item.minRaw = logical.first;
+                item.maxRaw = logical.second;
+                item.a = static_cast<double>((physical.second - physical.first))
+                        / (logical.second - logical.first) * r.getExponentValue();
+                item.b = physical.first - logical.first;
+                item.unit = r.getUnit();
+                item.bitOffset = packet.bitSize;
+                item.bitSize = r.getSize();
+                item.count = r.getCount();
+                packet.reports.push_back(item);
+                packet.bitSize += item.bitSize * item.count;
+            }
+            if (!packet.reports.empty()) {
+                packets.push_back(std::move(packet));
+            }
+        }
+    }
+    return packets;
+}
+
+void refDigest(HidParser::DigestVector *digestVector, const RefNode &node,
+               const std::unordered_set<unsigned int> &interestedUsage) {
+    using namespace HidDef::CollectionType;
+    using namespace HidDef::MainTag;
+
+    bool usageCollection = node.type == HidTree::TYPE_NORMAL
+            && (node.data == PHYSICAL || node.data == APPLICATION);
+    if (usageCollection && interestedUsage.count(node.fullUsage) != 0) {
+        std::unordered_map<unsigned int, std::array<std::vector<HidReport>, 3>> group;
+        for (auto &i : node.children) {
+            if (i->type != HidTree::TYPE_REPORT) {
+                continue;
+            }
+            const HidReport &report = *i->report;
+            auto &set = group[report.getReportId()];
+            switch (report.getType()) {
+                case FEATURE:
+                    set[HidParser::REPORT_TYPE_FEATURE].push_back(report);
+                    break;
+                case INPUT:
+                    set[HidParser::REPORT_TYPE_INPUT].push_back(report);
+                    break;
+                case OUTPUT:
+                    set[HidParser::REPORT_TYPE_OUTPUT].push_back(report);
+                    break;
+            }
+        }
+        digestVector->push_back({node.fullUsage, refConvertGroupToPacket(group)});
+    } else {
+        for (auto &child : node.children) {
+            if (child->type == HidTree::TYPE_NORMAL) {
+                refDigest(digestVector, *child, interestedUsage);
+            }
+        }
+    }
+}
+
+void collectUsages(const RefNode &node, std::set<unsigned int> *usages) {
+    if (node.type == HidTree::TYPE_NORMAL) {
+        usages->insert(node.fullUsage);
+    }
+    for (auto &child : node.children) {
+        collectUsages(*child, usages);
+    }
+}
+
+template<typename T>
+std::string toString(const T &t) {
+    std::ostringstream os;
+    os << t;
+    return os.str();
+}
+
+void expectSameDigest(const HidParser::DigestVector &expected,
+                      const HidParser::DigestVector &actual) {
+    ASSERT_EQ(expected.size(), actual.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        EXPECT_EQ(expected[i].fullUsage, actual[i].fullUsage);
+        ASSERT_EQ(expected[i].packets.size(), actual[i].packets.size());
+        for (size_t j = 0; j < expected[i].packets.size(); ++j) {
+            const auto &e = expected[i].packets[j];
+            const auto &a = actual[i].packets[j];
+            EXPECT_EQ(e.bitSize, a.bitSize);
+            EXPECT_EQ(e.type, a.type);
+            EXPECT_EQ(e.id, a.id);
+            ASSERT_EQ(e.reports.size(), a.reports.size());
+            for (size_t k = 0; k < e.reports.size(); ++k) {
+                const auto &er = e.reports[k];
+                const auto &ar = a.reports[k];
+                EXPECT_EQ(er.usage, ar.usage);
+                EXPECT_EQ(er.id, ar.id);
+                EXPECT_EQ(er.minRaw, ar.minRaw);
+                EXPECT_EQ(er.maxRaw, ar.maxRaw);
+                EXPECT_EQ(er.a, ar.a);
+                EXPECT_EQ(er.b, ar.b);
+                EXPECT_EQ(er.unit, ar.unit);
+                EXPECT_EQ(er.bitOffset, ar.bitOffset);
+                EXPECT_EQ(er.bitSize, ar.bitSize);
+                EXPECT_EQ(er.count, ar.count);
+            }
+        }
+    }
+}
+
+} // anonymous namespace
+
+TEST(HidTreeTest, SameTreeAsReference) {
+    for (const TestHidDescriptor *p = gDescriptorArray; p->data != nullptr; ++p) {
+        SCOPED_TRACE(p->name);
+        std::shared_ptr<RefNode> ref = refParse(*p);
+        ASSERT_NE(ref, nullptr);
+        HidParser parser;
+        ASSERT_TRUE(parser.parse(p->data, p->len));
+        EXPECT_EQ(refToString(*ref), toString(parser.getTree()));
+
+        refFilterTree(ref);
+        parser.filterTree();
+        EXPECT_EQ(refToString(*ref), toString(parser.getTree()));
+    }
+}
+
+TEST(HidTreeTest, SameDigestAsReference) {
+    for (const TestHidDescriptor *p = gDescriptorArray; p->data != nullptr; ++p) {
+        SCOPED_TRACE(p->name);
+        std::shared_ptr<RefNode> ref = refParse(*p);
+        ASSERT_NE(ref, nullptr);
+        refFilterTree(ref);
+        HidParser parser;
+        ASSERT_TRUE(parser.parse(p->data, p->len));
+        parser.filterTree();
+
+        std::set<unsigned int> usages;
+        collectUsages(*ref, &usages);
+        std::vector<std::unordered_set<unsigned int>> interestedSets = {
+            {}, std::unordered_set<unsigned int>(usages.begin(), usages.end())};
+        for (unsigned int usage : usages) {
+            interestedSets.push_back({usage});
+        }
+
+        for (const auto &interested : interestedSets) {
+            HidParser::DigestVector expected;
+            refDigest(&expected, *ref, interested);
+            expectSameDigest(expected, parser.generateDigest(interested));
+        }
+    }
+}
+
+TEST(HidTreeTest, CopyIsIndependent) {
+    const TestHidDescriptor *d = findTestDescriptor("accel3");
+    ASSERT_NE(d, nullptr);
+    HidParser parser;
+    ASSERT_TRUE(parser.parse(d->data, d->len));
+
+    HidTree copy = parser.getTree();
+    std::string unfiltered = toString(copy);
+    EXPECT_EQ(unfiltered, toString(parser.getTree()));
+
+    parser.filterTree();
+    EXPECT_NE(unfiltered, toString(parser.getTree()));
+    EXPECT_EQ(unfiltered, toString(copy));
+}
+
+TEST(HidTreeTest, UnmatchedEndCollection) {
+    const unsigned char descriptor[] = {
+        0x05, 0x20,     // usage page (sensor)
+        0x09, 0x73,     // usage (accelerometer 3d)
+        0xA1, 0x00,     // collection (physical)
+        0xC0,           // end collection
+        0xC0,           // end collection
+    };
+    HidParser parser;
+    EXPECT_FALSE(parser.parse(descriptor, sizeof(descriptor)));
+}
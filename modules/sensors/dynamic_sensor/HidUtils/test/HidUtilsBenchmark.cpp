@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "HidParser.h"
+#include "TestHidDescriptor.h"
+
+#include <benchmark/benchmark.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Benchmarks of the HidUtils descriptor path over the descriptors in TestHidDescriptor.cpp,
+// one run per descriptor: tokenizing, parsing, and filtering plus digesting for the usage of
+// every collection. BM_TokenizeStream reads the items one at a time with operator>> from an
+// istream instead, which is how descriptors used to be tokenized, as a baseline for BM_Tokenize.
+// Decoding and encoding of report items is measured on fields that are not
+// byte aligned, which HID allows and which need bit extraction.
+//
+// Run it like this:
+//
+// m hidutils_benchmark
+// out/host/linux-x86/benchmarktest64/hidutils_benchmark/hidutils_benchmark
+
+using namespace HidUtil;
+
+static size_t descriptorCount() {
+    size_t count = 0;
+    while (gDescriptorArray[count].data != nullptr) {
+        ++count;
+    }
+    return count;
+}
+
+static void forEachDescriptor(benchmark::internal::Benchmark *b) {
+    b->DenseRange(0, descriptorCount() - 1);
+}
+
+static std::unordered_set<unsigned int> collectionUsages(const HidTree &tree) {
+    std::unordered_set<unsigned int> usages;
+    for (HidTree::NodeIndex i = 0; i < tree.size(); ++i) {
+        if (tree.getNodeType(i) == HidTree::TYPE_NORMAL) {
+            usages.insert(tree.getFullUsage(i));
+        }
+    }
+    return usages;
+}
+
+static void BM_Tokenize(benchmark::State &state) {
+    const TestHidDescriptor &d = gDescriptorArray[state.range(0)];
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(HidItem::tokenize(d.data, d.len));
+    }
+    state.SetLabel(d.name);
+    state.SetBytesProcessed(state.iterations() * d.len);
+}
+BENCHMARK(BM_Tokenize)->Apply(forEachDescriptor);
+
+static void BM_TokenizeStream(benchmark::State &state) {
+    const TestHidDescriptor &d = gDescriptorArray[state.range(0)];
+    std::istringstream is(std::string(reinterpret_cast<const char *>(d.data), d.len));
+    is.unsetf(std::ios_base::skipws);
+    for (auto _ : state) {
+        is.clear();
+        is.seekg(0);
+        std::vector<HidItem> items;
+        while (!is.eof()) {
+            HidItem i;
+            is >> i;
+            if (!i.valid) {
+                break;
+            }
+            items.push_back(i);
+        }
+        benchmark::DoNotOptimize(items);
+    }
+    state.SetLabel(d.name);
+    state.SetBytesProcessed(state.iterations() * d.len);
+}
+BENCHMARK(BM_TokenizeStream)->Apply(forEachDescriptor);
+
+static void BM_Parse(benchmark::State &state) {
+    const TestHidDescriptor &d = gDescriptorArray[state.range(0)];
+    std::vector<HidItem> tokens = HidItem::tokenize(d.data, d.len);
+    for (auto _ : state) {
+        HidParser parser;
+        benchmark::DoNotOptimize(parser.parse(tokens));
+    }
+    state.SetLabel(d.name);
+    state.SetBytesProcessed(state.iterations() * d.len);
+}
+BENCHMARK(BM_Parse)->Apply(forEachDescriptor);
+
+static void BM_FilterAndDigest(benchmark::State &state) {
+    const TestHidDescriptor &d = gDescriptorArray[state.range(0)];
+    HidParser parsed;
+    if (!parsed.parse(d.data, d.len)) {
+        state.SkipWithError("parse failed");
+        return;
+    }
+    std::unordered_set<unsigned int> usages = collectionUsages(parsed.getTree());
+    for (auto _ : state) {
+        state.PauseTiming();
+        HidParser parser = parsed;
+        state.ResumeTiming();
+        parser.filterTree();
+        benchmark::DoNotOptimize(parser.generateDigest(usages));
+    }
+    state.SetLabel(d.name);
+}
+BENCHMARK(BM_FilterAndDigest)->Apply(forEachDescriptor);
+
+// Fields of bitSize bits packed back to back from bit 3 of a packet, so that no field starts or
+// ends on a byte boundary, with signed values over the whole raw range.
+class UnalignedPacket {
+public:
+    static constexpr size_t kFieldCount = 16;
+
+    explicit UnalignedPacket(size_t bitSize) : mData((3 + kFieldCount * bitSize + 7) / 8 + 4) {
+        for (size_t i = 0; i < kFieldCount; ++i) {
+            HidParser::ReportItem item = {};
+            item.usage = 0x200453 + i;
+            item.minRaw = -(int64_t(1) << (bitSize - 1));
+            item.maxRaw = (int64_t(1) << (bitSize - 1)) - 1;
+            item.a = 0.001;
+            item.b = 0;
+            item.bitOffset = 3 + i * bitSize;
+            item.bitSize = bitSize;
+            item.count = 1;
+            mItems.push_back(item);
+            set(item, item.mask(i * 0x9E3779B1u));
+        }
+    }
+
+    // raw value of item, read little endian as HID reports are
+    uint32_t get(const HidParser::ReportItem &item) const {
+        uint64_t word = 0;
+        const uint8_t *p = &mData[item.bitOffset / 8];
+        for (size_t i = 0; i < 5; ++i) {
+            word |= uint64_t(p[i]) << (8 * i);
+        }
+        return static_cast<uint32_t>((word >> (item.bitOffset & 7)) & item.rawMask());
+    }
+
+    void set(const HidParser::ReportItem &item, uint32_t raw) {
+        uint64_t mask = uint64_t(item.rawMask()) << (item.bitOffset & 7);
+        uint64_t bits = uint64_t(raw) << (item.bitOffset & 7);
+        uint8_t *p = &mData[item.bitOffset / 8];
+        for (size_t i = 0; i < 5; ++i) {
+            p[i] = static_cast<uint8_t>((p[i] & ~(mask >> (8 * i))) | (bits >> (8 * i)));
+        }
+    }
+
+    const std::vector<HidParser::ReportItem> &items() const { return mItems; }
+
+private:
+    std::vector<uint8_t> mData;
+    std::vector<HidParser::ReportItem> mItems;
+};
+
+static void BM_DecodeUnaligned(benchmark::State &state) {
+    UnalignedPacket packet(state.range(0));
+    for (auto _ : state) {
+        for (const auto &item : packet.items()) {
+            double value = 0;
+            item.decode(packet.get(item), &value);
+            benchmark::DoNotOptimize(value);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * UnalignedPacket::kFieldCount);
+}
+BENCHMARK(BM_DecodeUnaligned)->Arg(5)->Arg(12)->Arg(20)->Arg(31);
+
+static void BM_EncodeUnaligned(benchmark::State &state) {
+    UnalignedPacket packet(state.range(0));
+    std::vector<double> values;
+    for (const auto &item : packet.items()) {
+        double value = 0;
+        item.decode(packet.get(item), &value);
+        values.push_back(value);
+    }
+    for (auto _ : state) {
+        for (size_t i = 0; i < values.size(); ++i) {
+            const auto &item = packet.items()[i];
+            uint32_t raw;
+            if (item.encode(values[i], &raw)) {
+                packet.set(item, raw);
+            }
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * UnalignedPacket::kFieldCount);
+}
+BENCHMARK(BM_EncodeUnaligned)->Arg(5)->Arg(12)->Arg(20)->Arg(31);
+
+BENCHMARK_MAIN();
@@ -16,89 +16,90 @@
 
 #include "RingBuffer.h"
 
-#include <stdlib.h>
-#include <string.h>
+#include <algorithm>
 
 namespace android {
 
 RingBuffer::RingBuffer(size_t size)
     : mSize(size),
-      mData((sensors_event_t *)malloc(sizeof(sensors_event_t) * mSize)),
+      mData(new Slot[mSize]()),
+      mWritePos(0),
       mReadPos(0),
-      mWritePos(0) {
+      mReaderWaiting(false) {
 }
 
 RingBuffer::~RingBuffer() {
-    free(mData);
-    mData = NULL;
+    delete[] mData;
+    mData = nullptr;
 }
 
 ssize_t RingBuffer::write(const sensors_event_t *ev, size_t size) {
-    Mutex::Autolock autoLock(mLock);
-
-    size_t numAvailableToRead = mWritePos - mReadPos;
-    size_t numAvailableToWrite = mSize - numAvailableToRead;
-
-    if (size > numAvailableToWrite) {
-        size = numAvailableToWrite;
-    }
-
-    size_t writePos = (mWritePos % mSize);
-    size_t copy = mSize - writePos;
-
-    if (copy > size) {
-        copy = size;
+    size_t pos = mWritePos.load(std::memory_order_relaxed);
+    size_t count;
+    for (;;) {
+        size_t used = pos - mReadPos.load(std::memory_order_acquire);
+        if (used > mSize) {
+            // pos is stale, the reader has moved past it since
+            pos = mWritePos.load(std::memory_order_relaxed);
+            continue;
+        }
+        count = std::min(size, mSize - used);
+        if (count == 0) {
+            return 0;
+        }
+        if (mWritePos.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed)) {
+            break;
+        }
     }
 
-    memcpy(&mData[writePos], ev, copy * sizeof(sensors_event_t));
-
-    if (size > copy) {
-        memcpy(mData, &ev[copy], (size - copy) * sizeof(sensors_event_t));
+    for (size_t i = 0; i < count; ++i) {
+        Slot &slot = mData[(pos + i) % mSize];
+        slot.event = ev[i];
+        slot.seq.store(pos + i + 1, std::memory_order_release);
     }
 
-    mWritePos += size;
-
-    if (numAvailableToRead == 0 && size > 0) {
-        mNotEmptyCondition.broadcast();
-    }
-
-    return size;
+    wakeReader();
+    return count;
 }
 
 ssize_t RingBuffer::read(sensors_event_t *ev, size_t size) {
-    Mutex::Autolock autoLock(mLock);
-
-    size_t numAvailableToRead;
-    for (;;) {
-        numAvailableToRead = mWritePos - mReadPos;
-        if (numAvailableToRead > 0) {
-            break;
+    size_t pos = mReadPos.load(std::memory_order_relaxed);
+
+    if (!isPublished(pos)) {
+        std::unique_lock<std::mutex> lk(mLock);
+        mReaderWaiting.store(true, std::memory_order_relaxed);
+        // pairs with the fence in wakeReader(): either the writer sees mReaderWaiting, or this
+        // thread sees the slot it published
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while (!isPublished(pos)) {
+            mNotEmptyCondition.wait(lk);
         }
-
-        mNotEmptyCondition.wait(mLock);
+        mReaderWaiting.store(false, std::memory_order_relaxed);
     }
 
-    if (size > numAvailableToRead) {
-        size = numAvailableToRead;
+    size_t count = 0;
+    while (count < size && isPublished(pos + count)) {
+        ev[count] = mData[(pos + count) % mSize].event;
+        ++count;
     }
+    // hands the slots back to the writers
+    mReadPos.store(pos + count, std::memory_order_release);
 
-    size_t readPos = (mReadPos % mSize);
-    size_t copy = mSize - readPos;
-
-    if (copy > size) {
-        copy = size;
-    }
+    return count;
+}
 
-    memcpy(ev, &mData[readPos], copy * sizeof(sensors_event_t));
+bool RingBuffer::isPublished(size_t pos) const {
+    return mData[pos % mSize].seq.load(std::memory_order_acquire) == pos + 1;
+}
 
-    if (size > copy) {
-        memcpy(&ev[copy], mData, (size - copy) * sizeof(sensors_event_t));
+void RingBuffer::wakeReader() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (mReaderWaiting.load(std::memory_order_relaxed)) {
+        // the reader checks for events and starts waiting under the lock, so taking it here
+        // cannot miss the reader in between
+        std::lock_guard<std::mutex> lk(mLock);
+        mNotEmptyCondition.notify_one();
     }
-
-    mReadPos += size;
-
-    return size;
 }
 
 }  // namespace android
-
@@ -18,30 +18,55 @@
 
 #define RING_BUFFER_H_
 
-#include <media/stagefright/foundation/ABase.h>
-
 #include <hardware/sensors.h>
-#include <utils/threads.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 
 namespace android {
 
+// Lock free ring buffer of sensor events for any number of writers and a single reader.
+//
+// A writer reserves room for all of its events with one compare-and-swap on the write position,
+// copies them in and publishes each slot by storing its sequence number. The reader consumes
+// published slots in order and only takes a lock when it has to sleep; a writer takes that lock,
+// once per write() call, only if the reader is sleeping.
 class RingBuffer {
 public:
     explicit RingBuffer(size_t size);
     ~RingBuffer();
 
+    // Writes as many of the events as there is room for, and returns that number. Thread safe.
     ssize_t write(const sensors_event_t *ev, size_t size);
+
+    // Reads up to size events, blocking until there is at least one. Only one thread may read.
     ssize_t read(sensors_event_t *ev, size_t size);
 
 private:
-    Mutex mLock;
-    Condition mNotEmptyCondition;
+    struct Slot {
+        // Position of the event in the slot plus one, once it is published.
+        std::atomic<size_t> seq;
+        sensors_event_t event;
+    };
+
+    bool isPublished(size_t pos) const;
+    void wakeReader();
+
+    const size_t mSize;
+    Slot *mData;
+
+    // Positions only ever grow; the slot of a position is pos % mSize. Kept on their own cache
+    // lines, as writers contend on the first and the reader stores the second.
+    alignas(64) std::atomic<size_t> mWritePos;
+    alignas(64) std::atomic<size_t> mReadPos;
 
-    size_t mSize;
-    sensors_event_t *mData;
-    size_t mReadPos, mWritePos;
+    std::mutex mLock;
+    std::condition_variable mNotEmptyCondition;
+    std::atomic<bool> mReaderWaiting;
 
-    DISALLOW_EVIL_CONSTRUCTORS(RingBuffer);
+    RingBuffer(const RingBuffer &) = delete;
+    RingBuffer &operator=(const RingBuffer &) = delete;
 };
 
 }  // namespace android
@@ -17,12 +17,12 @@
 #ifndef ANDROID_SENSORHAL_DSE_SENSOR_EVENT_CALLBACK_H
 #define ANDROID_SENSORHAL_DSE_SENSOR_EVENT_CALLBACK_H
 
+#include "BaseSensorObject.h"
 #include "Utils.h"
 #include <hardware/sensors.h>
 
 namespace android {
 namespace SensorHalExt {
-class BaseSensorObject;
 
 // if timestamp in sensors_event_t has this value, it will be filled at dispatcher.
 constexpr int64_t TIMESTAMP_AUTO_FILL = -1;
@@ -30,6 +30,18 @@ constexpr int64_t TIMESTAMP_AUTO_FILL = -1;
 class SensorEventCallback {
 public:
     virtual int submitEvent(SP(BaseSensorObject) sensor, const sensors_event_t &e) = 0;
+
+    // submit events of the same sensor at once, in order. Default implementation submits them
+    // one by one.
+    virtual int submitEvents(SP(BaseSensorObject) sensor, const sensors_event_t *e, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            int ret = submitEvent(sensor, e[i]);
+            if (ret < 0) {
+                return ret;
+            }
+        }
+        return 0;
+    }
     virtual ~SensorEventCallback() = default;
 };
 
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ANDROID_SENSORHAL_EXT_BENCHMARK_HID_DEVICE_H
+#define ANDROID_SENSORHAL_EXT_BENCHMARK_HID_DEVICE_H
+
+#include "HidDevice.h"
+#include "HidParser.h"
+#include "HidRawSensor.h"
+#include "TestHidDescriptor.h"
+#include "Utils.h"
+
+#include <time.h>
+
+#include <vector>
+
+namespace android {
+namespace SensorHalExt {
+
+inline int64_t benchmarkClockNs(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Device that accepts any feature report, so that sensors created on it can be enabled.
+class BenchmarkHidDevice : public HidDevice {
+public:
+    BenchmarkHidDevice() {
+        mInfo = {
+            .name = "Benchmark sensor",
+            .physicalPath = "/physical/path",
+            .busType = "USB",
+            .vendorId = 0x1234,
+            .productId = 0x5678,
+            .descriptor = {0}
+        };
+    }
+
+    virtual const HidDeviceInfo& getDeviceInfo() { return mInfo; }
+
+    virtual bool getFeature(uint8_t /*id*/, std::vector<uint8_t> *out) {
+        out->assign(64, 0);
+        return true;
+    }
+
+    virtual bool setFeature(uint8_t /*id*/, const std::vector<uint8_t> &/*in*/) { return true; }
+
+    virtual bool sendReport(uint8_t /*id*/, std::vector<uint8_t> &/*data*/) { return true; }
+
+    virtual bool readFeature(uint8_t /*id*/, uint8_t *out, size_t size) {
+        memset(out, 0, size);
+        return true;
+    }
+
+    virtual bool writeFeature(uint8_t /*id*/, const uint8_t * /*in*/, size_t /*size*/) {
+        return true;
+    }
+
+    virtual bool receiveReport(uint8_t * /*id*/, std::vector<uint8_t> * /*data*/) {
+        return false;
+    }
+
+private:
+    HidDeviceInfo mInfo;
+};
+
+// An enabled sensor of the given usage from a test descriptor, and the id and size of its input
+// report.
+struct BenchmarkSensor {
+    SP(HidRawSensor) sensor;
+    uint8_t reportId;
+    size_t reportSize;
+};
+
+inline bool createBenchmarkSensor(SP(HidDevice) device, const char *descriptorName,
+                                  unsigned int usage, BenchmarkSensor *out) {
+    const TestHidDescriptor *descriptor = findTestDescriptor(descriptorName);
+    HidUtil::HidParser parser;
+    if (descriptor == nullptr || !parser.parse(descriptor->data, descriptor->len)) {
+        return false;
+    }
+    parser.filterTree();
+    auto digests = parser.generateDigest({usage});
+    if (digests.empty()) {
+        return false;
+    }
+    const auto &digest = digests.front();
+    out->reportSize = 0;
+    for (const auto &packet : digest.packets) {
+        if (packet.type == HidUtil::HidParser::REPORT_TYPE_INPUT) {
+            out->reportId = packet.id;
+            out->reportSize = packet.getByteSize();
+        }
+    }
+    out->sensor = SP(HidRawSensor)(new HidRawSensor(device, digest.fullUsage, digest.packets));
+    return out->reportSize > 0 && out->sensor->isValid() && out->sensor->enable(true) == 0;
+}
+
+} // namespace SensorHalExt
+} // namespace android
+
+#endif // ANDROID_SENSORHAL_EXT_BENCHMARK_HID_DEVICE_H
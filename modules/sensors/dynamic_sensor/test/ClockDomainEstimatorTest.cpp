@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "ClockDomainEstimatorTest"
+
+#include "ClockDomainEstimator.h"
+#include "HidLog.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+// Test of ClockDomainEstimator with synthetic device clocks that drift against the host clock,
+// sampled at 100 Hz or 1 kHz and received with a random delay in batches, like hidraw reads.
+
+namespace android {
+namespace SensorHalExt {
+
+namespace {
+
+constexpr int64_t kMinDelayNs = 1000000LL;          // transport delay, not observable
+constexpr int kMaxBatch = 4;                           // reports per read
+constexpr int64_t kWarmUpNs = 35000000000LL;        // window filled
+constexpr int64_t kToleranceNs = 250000LL;
+
+// A device clock running at 1 + drift host ns per device ns, where drift changes at
+// changeAtNs, and which restarts from 0 at resetAtNs.
+struct DeviceClock {
+    double drift;
+    double driftAfterChange;
+    int64_t changeAtNs;
+    int64_t resetAtNs;
+
+    int64_t at(int64_t hostNs) const {
+        const int64_t start = 123456789000LL;   // arbitrary device time at host time 0
+        if (hostNs >= resetAtNs) {
+            return std::llround((hostNs - resetAtNs) * (1 + driftAfterChange));
+        }
+        if (hostNs < changeAtNs) {
+            return start + std::llround(hostNs * (1 + drift));
+        }
+        return start + std::llround(changeAtNs * (1 + drift)
+                + (hostNs - changeAtNs) * (1 + driftAfterChange));
+    }
+};
+
+// Sampling of the device clock: a report every periodNs, read batch reports at a time, and
+// received with a delay of up to jitterNs on top of the transport delay.
+struct Reports {
+    int64_t periodNs;
+    int64_t jitterNs;
+    int batch;
+};
+
+constexpr Reports k100Hz = {10000000LL, 3000000LL, 4};
+// Each report is read on its own, with a jitter of several report periods, so that refits move
+// the mapping back by more than a period.
+constexpr Reports k1kHz = {1000000LL, 3000000LL, 1};
+
+// Runs seconds of samples through the estimator. Checks that mapped times never pass the
+// receive time, and that once warm since the start or the last change of the clock, they are
+// within tolerance of the sample time plus the transport delay. Checks that event timestamps
+// from stampSample() always increase, even when the mapping moves back.
+bool run(const char *name, const DeviceClock &clock, const Reports &reports, int seconds) {
+    const int64_t periodNs = reports.periodNs;
+    const int batch = reports.batch;
+    std::mt19937 random(1);
+    std::uniform_int_distribution<int64_t> jitter(0, reports.jitterNs);
+    ClockDomainEstimator estimator;
+
+    const int64_t hostStartNs = 1000000000000LL;
+    const int64_t endNs = seconds * 1000000000LL;
+    int64_t settledNs = std::min(clock.changeAtNs, clock.resetAtNs) + kWarmUpNs;
+    int64_t lastStamp = INT64_MIN;
+    int64_t maxBackwards = 0;
+    int64_t maxError = 0;
+    int64_t maxReceiveError = 0;
+    int64_t samples[kMaxBatch];
+    for (int64_t batchNs = 0; batchNs < endNs; batchNs += batch * periodNs) {
+        // every report of the batch is received with the last one
+        int64_t receivedNs = batchNs + (batch - 1) * periodNs + kMinDelayNs + jitter(random);
+        for (int i = 0; i < batch; ++i) {
+            samples[i] = batchNs + i * periodNs;
+        }
+        for (int i = 0; i < batch; ++i) {
+            int64_t deviceNs = clock.at(samples[i]);
+            int64_t stamp = estimator.stampSample(deviceNs, hostStartNs + receivedNs)
+                    - hostStartNs;
+            int64_t mapped = estimator.toHostTime(deviceNs) - hostStartNs;
+
+            if (mapped > receivedNs) {
+                LOG_E << name << ": mapped time " << mapped << " after receive time "
+                      << receivedNs << LOG_ENDL;
+                return false;
+            }
+            if (lastStamp != INT64_MIN) {
+                if (stamp <= lastStamp) {
+                    LOG_E << name << ": timestamp " << stamp << " not after previous "
+                          << lastStamp << LOG_ENDL;
+                    return false;
+                }
+                maxBackwards = std::max(maxBackwards, lastStamp - mapped);
+            }
+            lastStamp = stamp;
+
+            if (samples[i] < kWarmUpNs
+                    || (samples[i] >= std::min(clock.changeAtNs, clock.resetAtNs)
+                            && samples[i] < settledNs)) {
+                continue;
+            }
+            int64_t error = std::llabs(mapped - (samples[i] + kMinDelayNs));
+            maxError = std::max(maxError, error);
+            maxReceiveError = std::max(maxReceiveError, receivedNs - (samples[i] + kMinDelayNs));
+        }
+    }
+
+    LOG_I << name << ": rate " << estimator.getRate() << ", max error " << maxError / 1000
+          << " us, max error of receive time " << maxReceiveError / 1000
+          << " us, mapping moved back by up to " << maxBackwards / 1000 << " us" << LOG_ENDL;
+    if (maxError > kToleranceNs) {
+        LOG_E << name << ": max error " << maxError << " ns over " << kToleranceNs << LOG_ENDL;
+        return false;
+    }
+    return true;
+}
+
+} // anonymous namespace
+
+class ClockDomainEstimatorTest {
+public:
+    static bool test() {
+        const int64_t never = INT64_MAX;
+        return run("same rate", {0, 0, never, never}, k100Hz, 60)
+                && run("fast device", {200e-6, 200e-6, never, never}, k100Hz, 60)
+                && run("slow device", {-300e-6, -300e-6, never, never}, k100Hz, 60)
+                && run("drift change", {200e-6, -150e-6, 60000000000LL, never}, k100Hz, 120)
+                && run("device reset", {100e-6, 100e-6, never, 60000000000LL}, k100Hz, 120)
+                && run("1 kHz, jitter over period", {200e-6, 200e-6, never, never}, k1kHz, 60);
+    }
+};
+
+} // namespace SensorHalExt
+} // namespace android
+
+int main() {
+    return android::SensorHalExt::ClockDomainEstimatorTest::test() ? 0 : 1;
+}
@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "DigestCacheTest"
+
+#include "DigestCache.h"
+#include "HidLog.h"
+
+#include <vector>
+
+// Test of the cache of report descriptor digests: hits, misses on hash collisions, and eviction.
+//
+// Run it like this:
+//
+// m digestcache_host_test
+// out/host/linux-x86/bin/digestcache_host_test
+
+namespace android {
+namespace SensorHalExt {
+
+namespace {
+
+using HidUtil::HidParser;
+
+const std::vector<uint8_t> kDescriptorA = {0x05, 0x20, 0x09, 0x73, 0xa1, 0x01, 0xc0};
+const std::vector<uint8_t> kDescriptorB = {0x05, 0x20, 0x09, 0x76, 0xa1, 0x01, 0xc0};
+const std::vector<uint8_t> kDescriptorC = {0x05, 0x20, 0x09, 0x83, 0xa1, 0x01, 0xc0};
+const std::vector<unsigned int> kUsages = {0x200073, 0x200076};
+
+// a digest that is told apart from the others by its usage alone
+HidParser::DigestVector digestOf(unsigned int fullUsage) {
+    return {{fullUsage, {}}};
+}
+
+// true if the cache holds the digest made by digestOf(fullUsage) for descriptor and usages
+bool hits(DigestCache &cache, const std::vector<uint8_t> &descriptor,
+          const std::vector<unsigned int> &usages, unsigned int fullUsage) {
+    HidParser::DigestVector digest;
+    return cache.get(descriptor, usages, &digest)
+            && digest.size() == 1 && digest[0].fullUsage == fullUsage;
+}
+
+bool misses(DigestCache &cache, const std::vector<uint8_t> &descriptor,
+            const std::vector<unsigned int> &usages) {
+    HidParser::DigestVector digest;
+    return !cache.get(descriptor, usages, &digest);
+}
+
+uint64_t sameHash(const std::vector<uint8_t> &, const std::vector<unsigned int> &) {
+    return 42;
+}
+
+bool testHit() {
+    DigestCache cache;
+    if (!misses(cache, kDescriptorA, kUsages)) {
+        LOG_E << "Empty cache hit" << LOG_ENDL;
+        return false;
+    }
+    cache.put(kDescriptorA, kUsages, digestOf(1));
+    if (!hits(cache, kDescriptorA, kUsages, 1)) {
+        LOG_E << "Cached digest not found" << LOG_ENDL;
+        return false;
+    }
+    if (!misses(cache, kDescriptorB, kUsages)) {
+        LOG_E << "Hit for a descriptor not cached" << LOG_ENDL;
+        return false;
+    }
+    if (!misses(cache, kDescriptorA, {0x200073})) {
+        LOG_E << "Hit for a usage set not cached" << LOG_ENDL;
+        return false;
+    }
+    return true;
+}
+
+// Descriptors with the same hash must not get each other's digest.
+bool testCollision() {
+    DigestCache cache(DigestCache::kMaxEntries, sameHash);
+    cache.put(kDescriptorA, kUsages, digestOf(1));
+    if (!misses(cache, kDescriptorB, kUsages)) {
+        LOG_E << "Hit for a colliding descriptor" << LOG_ENDL;
+        return false;
+    }
+    if (!misses(cache, kDescriptorA, {0x200073})) {
+        LOG_E << "Hit for a colliding usage set" << LOG_ENDL;
+        return false;
+    }
+
+    // the colliding entry replaces the first one
+    cache.put(kDescriptorB, kUsages, digestOf(2));
+    if (!hits(cache, kDescriptorB, kUsages, 2) || !misses(cache, kDescriptorA, kUsages)) {
+        LOG_E << "Colliding entry did not replace the first one" << LOG_ENDL;
+        return false;
+    }
+    return true;
+}
+
+bool testEviction() {
+    DigestCache cache(2);
+    cache.put(kDescriptorA, kUsages, digestOf(1));
+    cache.put(kDescriptorB, kUsages, digestOf(2));
+    // putting an entry again does not make it take another slot
+    cache.put(kDescriptorB, kUsages, digestOf(2));
+    if (!hits(cache, kDescriptorA, kUsages, 1) || !hits(cache, kDescriptorB, kUsages, 2)) {
+        LOG_E << "Entry evicted before the cache was full" << LOG_ENDL;
+        return false;
+    }
+
+    cache.put(kDescriptorC, kUsages, digestOf(3));
+    if (!misses(cache, kDescriptorA, kUsages)) {
+        LOG_E << "Oldest entry not evicted" << LOG_ENDL;
+        return false;
+    }
+    if (!hits(cache, kDescriptorB, kUsages, 2) || !hits(cache, kDescriptorC, kUsages, 3)) {
+        LOG_E << "Newer entries evicted" << LOG_ENDL;
+        return false;
+    }
+    return true;
+}
+
+// A cache of no entries has nothing to evict and stays empty.
+bool testZeroEntries() {
+    DigestCache cache(0);
+    cache.put(kDescriptorA, kUsages, digestOf(1));
+    cache.put(kDescriptorB, kUsages, digestOf(2));
+    if (!misses(cache, kDescriptorA, kUsages) || !misses(cache, kDescriptorB, kUsages)) {
+        LOG_E << "Cache of no entries hit" << LOG_ENDL;
+        return false;
+    }
+    return true;
+}
+
+} // anonymous namespace
+
+class DigestCacheTest {
+public:
+    static bool test() {
+        bool ret = true;
+        ret = testHit() && ret;
+        ret = testCollision() && ret;
+        ret = testEviction() && ret;
+        ret = testZeroEntries() && ret;
+        return ret;
+    }
+};
+
+} // namespace SensorHalExt
+} // namespace android
+
+int main() {
+    return android::SensorHalExt::DigestCacheTest::test() ? 0 : 1;
+}
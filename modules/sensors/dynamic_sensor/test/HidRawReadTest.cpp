@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "HidRawReadTest"
+
+#include "BenchmarkHidDevice.h"
+#include "HidLog.h"
+#include "HidRawDevice.h"
+#include "HidSensorDef.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+// Test of reading hidraw input reports in batches, with a packet mode pipe standing in for the
+// hidraw node: like hidraw, it hands out one report per read(). The pipe has no HID descriptor,
+// so the device is not valid, but it still reads reports.
+//
+// Run it like this:
+//
+// m hidrawread_host_test
+// out/host/linux-x86/bin/hidrawread_host_test
+
+namespace android {
+namespace SensorHalExt {
+
+namespace {
+
+constexpr size_t kReportCount = 8;
+
+// Checks that the reports of a batch, read in one go, get strictly increasing timestamps, and
+// that so do the events decoded from them.
+bool testBatchTimestamps() {
+    int fds[2];
+    if (::pipe2(fds, O_DIRECT | O_CLOEXEC) != 0) {
+        LOG_E << "pipe2() failed: " << ::strerror(errno) << LOG_ENDL;
+        return false;
+    }
+    HidRawDevice device("/proc/self/fd/" + std::to_string(fds[0]), {});
+
+    SP(HidDevice) sensorDevice(new BenchmarkHidDevice());
+    BenchmarkSensor accel;
+    if (!createBenchmarkSensor(sensorDevice, "accel3",
+                               Hid::Sensor::SensorTypeUsage::ACCELEROMETER_3D, &accel)) {
+        LOG_E << "Could not create sensor" << LOG_ENDL;
+        return false;
+    }
+
+    std::vector<uint8_t> report(accel.reportSize, 0x10);
+    for (size_t i = 0; i < kReportCount; ++i) {
+        if (::write(fds[1], report.data(), report.size()) != (ssize_t)report.size()) {
+            LOG_E << "write() failed: " << ::strerror(errno) << LOG_ENDL;
+            return false;
+        }
+    }
+
+    bool ret = true;
+    HidRawDevice::ReportBatch batch;
+    if (!device.readReports(&batch) || batch.count != kReportCount) {
+        LOG_E << "Read " << batch.count << " reports, expected " << kReportCount << LOG_ENDL;
+        ret = false;
+    }
+    int64_t lastReceivedNs = INT64_MIN;
+    int64_t lastTimestamp = INT64_MIN;
+    for (size_t i = 0; i < batch.count; ++i) {
+        const HidRawDevice::ReportBatch::Report &r = batch.reports[i];
+        if (r.receivedNs <= lastReceivedNs) {
+            LOG_E << "Report " << i << " read at " << r.receivedNs << ", not after "
+                  << lastReceivedNs << LOG_ENDL;
+            ret = false;
+        }
+        lastReceivedNs = r.receivedNs;
+
+        // a device with a single report id reads it as id 0, the sensor has its own
+        sensors_event_t event;
+        if (!accel.sensor->decodeInput(accel.reportId, r.data, r.size, r.receivedNs, &event)) {
+            LOG_E << "Report " << i << " not decoded" << LOG_ENDL;
+            ret = false;
+            continue;
+        }
+        if (event.timestamp <= lastTimestamp) {
+            LOG_E << "Event " << i << " stamped " << event.timestamp << ", not after "
+                  << lastTimestamp << LOG_ENDL;
+            ret = false;
+        }
+        lastTimestamp = event.timestamp;
+    }
+
+    ::close(fds[1]);
+    ::close(fds[0]);
+    return ret;
+}
+
+} // anonymous namespace
+
+class HidRawReadTest {
+public:
+    static bool test() {
+        return testBatchTimestamps();
+    }
+};
+
+} // namespace SensorHalExt
+} // namespace android
+
+int main() {
+    return android::SensorHalExt::HidRawReadTest::test() ? 0 : 1;
+}
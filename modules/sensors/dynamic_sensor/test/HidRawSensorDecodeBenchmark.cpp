@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "BenchmarkHidDevice.h"
+#include "HidSensorDef.h"
+#include "SensorEventCallback.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+// Micro-benchmark of HidRawSensor::handleInput(), which decodes input reports into sensor events,
+// on a single core. Reports decoded reports/sec and ns per report of each test sensor, with the
+// event callback doing no more than keeping the event.
+//
+// Run it like this:
+//
+// m hidrawsensor_decode_host_benchmark
+// out/host/linux-x86/bin/hidrawsensor_decode_host_benchmark [reports]
+
+namespace android {
+namespace SensorHalExt {
+
+namespace {
+
+class LastEventCallback : public SensorEventCallback {
+public:
+    virtual int submitEvent(SP(BaseSensorObject) /*sensor*/, const sensors_event_t &e) override {
+        mLast = e;
+        ++mCount;
+        return 0;
+    }
+
+    sensors_event_t mLast = {};
+    int64_t mCount = 0;
+};
+
+struct DecodeCase {
+    const char *name;
+    const char *descriptor;
+    unsigned int usage;
+};
+
+} // anonymous namespace
+
+int runBenchmark(int reports) {
+    using namespace Hid::Sensor::SensorTypeUsage;
+    const DecodeCase cases[] = {
+        {"accelerometer", "accel3", ACCELEROMETER_3D},
+        {"gyroscope", "gyro3", GYROMETER_3D},
+        {"magnetometer", "comp3", COMPASS_3D},
+        {"orientation", "devor", DEVICE_ORIENTATION},
+    };
+    constexpr size_t kReportVariants = 64;
+
+    SP(HidDevice) device(new BenchmarkHidDevice());
+    for (const auto &c : cases) {
+        BenchmarkSensor s;
+        if (!createBenchmarkSensor(device, c.descriptor, c.usage, &s)) {
+            fprintf(stderr, "Could not create %s sensor\n", c.name);
+            return EXIT_FAILURE;
+        }
+        LastEventCallback callback;
+        s.sensor->setEventCallback(&callback);
+
+        // varied reports, so that the decoder cannot be predicted from one value
+        std::vector<std::vector<uint8_t>> messages(kReportVariants);
+        for (size_t i = 0; i < kReportVariants; ++i) {
+            messages[i].resize(s.reportSize);
+            for (size_t j = 0; j < s.reportSize; ++j) {
+                messages[i][j] = static_cast<uint8_t>(i * 37 + j * 11);
+            }
+        }
+
+        int64_t start = benchmarkClockNs(CLOCK_THREAD_CPUTIME_ID);
+        for (int i = 0; i < reports; ++i) {
+            s.sensor->handleInput(s.reportId, messages[i % kReportVariants]);
+        }
+        int64_t elapsed = benchmarkClockNs(CLOCK_THREAD_CPUTIME_ID) - start;
+
+        if (callback.mCount != reports) {
+            fprintf(stderr, "%s sensor generated %lld events from %d reports\n", c.name,
+                    (long long)callback.mCount, reports);
+            return EXIT_FAILURE;
+        }
+        printf("%-14s report %2zu bytes: reports/sec %.0f, ns/report %.1f, last x %f\n", c.name,
+               s.reportSize, reports * 1e9 / elapsed, (double)elapsed / reports,
+               callback.mLast.data[0]);
+    }
+    return EXIT_SUCCESS;
+}
+
+} // namespace SensorHalExt
+} // namespace android
+
+int main(int argc, char **argv) {
+    int reports = argc > 1 ? atoi(argv[1]) : 10000000;
+    if (reports <= 0) {
+        printf("usage: %s [reports]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    return android::SensorHalExt::runBenchmark(reports);
+}
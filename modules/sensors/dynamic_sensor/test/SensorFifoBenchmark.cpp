@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "BenchmarkHidDevice.h"
+#include "HidSensorDef.h"
+#include "RingBuffer.h"
+#include "SensorEventCallback.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Benchmark of the standalone mode event path of DynamicSensorManager.
+//
+// Each producer thread plays the part of a HidRawSensorDevice thread: it feeds input reports to
+// its own HidRawSensor, which decodes them and submits the events to a sink doing what
+// DynamicSensorManager::submitEvent() does in standalone mode. The main thread reads them back
+// the way poll() does. Reports delivered events/sec, events dropped because the fifo was full,
+// CPU time per event, and how many events each read returned.
+//
+// Producers run flat out by default, which mostly measures contention, or at rate_hz each, which
+// is closer to real sensors and shows the cost of waking the reader.
+//
+// Run it like this:
+//
+// m sensorfifo_host_benchmark
+// out/host/linux-x86/bin/sensorfifo_host_benchmark [producers] [events_per_producer] [rate_hz]
+
+namespace android {
+namespace SensorHalExt {
+
+namespace {
+
+constexpr size_t kFifoSize = 4096;
+constexpr int kPollBufferSize = 64;
+
+// Standalone mode of DynamicSensorManager::submitEvent(), including the handle lookup.
+class FifoSink : public SensorEventCallback {
+public:
+    FifoSink() : mFifo(kFifoSize), mDropped(0) {}
+
+    void addSensor(BaseSensorObject *sensor, int handle) {
+        std::lock_guard<std::mutex> lk(mLock);
+        mReverseMap[sensor] = handle;
+    }
+
+    virtual int submitEvent(SP(BaseSensorObject) source, const sensors_event_t &e) override {
+        int handle;
+        {
+            std::lock_guard<std::mutex> lk(mLock);
+            handle = mReverseMap[source.get()];
+        }
+        sensors_event_t event = e;
+        event.version = sizeof(event);
+        event.sensor = handle;
+        if (event.timestamp == TIMESTAMP_AUTO_FILL) {
+            event.timestamp = benchmarkClockNs(CLOCK_BOOTTIME);
+        }
+        if (mFifo.write(&event, 1) < 1) {
+            mDropped.fetch_add(1, std::memory_order_relaxed);
+        }
+        return 0;
+    }
+
+    RingBuffer mFifo;
+    std::atomic<int64_t> mDropped;
+
+private:
+    std::mutex mLock;
+    std::unordered_map<void *, int> mReverseMap;
+};
+
+} // anonymous namespace
+
+int runBenchmark(int producerCount, int eventsPerProducer, int rateHz) {
+    SP(HidDevice) device(new BenchmarkHidDevice());
+    FifoSink sink;
+    std::vector<BenchmarkSensor> producers(producerCount);
+    for (int i = 0; i < producerCount; ++i) {
+        if (!createBenchmarkSensor(device, "accel3",
+                                   Hid::Sensor::SensorTypeUsage::ACCELEROMETER_3D, &producers[i])) {
+            fprintf(stderr, "Could not create sensor %d\n", i);
+            return EXIT_FAILURE;
+        }
+        sink.addSensor(producers[i].sensor.get(), i + 1);
+        producers[i].sensor->setEventCallback(&sink);
+    }
+    std::vector<uint8_t> report(producers[0].reportSize, 0x10);
+
+    int64_t cpuStart = benchmarkClockNs(CLOCK_PROCESS_CPUTIME_ID);
+    int64_t start = benchmarkClockNs(CLOCK_MONOTONIC);
+    std::vector<std::thread> threads;
+    for (auto &producer : producers) {
+        threads.emplace_back([&producer, &sink, &report, eventsPerProducer, rateHz] {
+            struct timespec next;
+            clock_gettime(CLOCK_MONOTONIC, &next);
+            for (int i = 0; i < eventsPerProducer; ++i) {
+                if (rateHz > 0) {
+                    next.tv_nsec += 1000000000 / rateHz;
+                    if (next.tv_nsec >= 1000000000) {
+                        next.tv_nsec -= 1000000000;
+                        ++next.tv_sec;
+                    }
+                    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr);
+                }
+                producer.sensor->handleInput(producer.reportId, report);
+            }
+            // Tells the reader this producer is done, which it cannot tell from a count, as
+            // events may have been dropped.
+            sensors_event_t done = {};
+            done.type = SENSOR_TYPE_META_DATA;
+            while (sink.mFifo.write(&done, 1) < 1) {
+                std::this_thread::yield();
+            }
+        });
+    }
+
+    int64_t received = 0;
+    int64_t reads = 0;
+    int done = 0;
+    sensors_event_t data[kPollBufferSize];
+    while (done < producerCount) {
+        ssize_t count = sink.mFifo.read(data, kPollBufferSize);
+        for (ssize_t i = 0; i < count; ++i) {
+            if (data[i].type == SENSOR_TYPE_META_DATA) {
+                ++done;
+            } else {
+                ++received;
+            }
+        }
+        ++reads;
+    }
+    int64_t elapsed = benchmarkClockNs(CLOCK_MONOTONIC) - start;
+    int64_t cpu = benchmarkClockNs(CLOCK_PROCESS_CPUTIME_ID) - cpuStart;
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    int64_t total = (int64_t)producerCount * eventsPerProducer;
+    printf("producers %d, rate_hz %d, events %lld, received %lld, dropped %lld\n", producerCount,
+           rateHz, (long long)total, (long long)received, (long long)sink.mDropped.load());
+    printf("events/sec %.0f, cpu ns/event %.0f, events/read %.1f\n",
+           received * 1e9 / elapsed, (double)cpu / total, (double)received / reads);
+    return EXIT_SUCCESS;
+}
+
+} // namespace SensorHalExt
+} // namespace android
+
+int main(int argc, char **argv) {
+    int producers = argc > 1 ? atoi(argv[1]) : 8;
+    int events = argc > 2 ? atoi(argv[2]) : 200000;
+    int rateHz = argc > 3 ? atoi(argv[3]) : 0;
+    if (producers <= 0 || events <= 0 || rateHz < 0) {
+        printf("usage: %s [producers] [events_per_producer] [rate_hz]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    return android::SensorHalExt::runBenchmark(producers, events, rateHz);
+}
@@ -14,40 +14,101 @@
  * limitations under the License.
  */
 
+#include "DirectChannel.h"
+#include "SensorEventMerger.h"
 #include "SensorEventQueue.h"
+#include "SubHalCommandQueue.h"
+#include "SubHalLoader.h"
 #include "multihal.h"
 
 #define LOG_NDEBUG 1
 #include <log/log.h>
+#include <cutils/ashmem.h>
 #include <cutils/atomic.h>
+#include <cutils/properties.h>
 #include <hardware/sensors.h>
+#include <utils/SystemClock.h>
 
+#include <algorithm>
+#include <atomic>
 #include <vector>
 #include <string>
 #include <fstream>
 #include <map>
+#include <new>
 
 #include <dirent.h>
 #include <dlfcn.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <math.h>
 #include <poll.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 
 static pthread_mutex_t init_modules_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t init_sensors_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+// If set, the writer tasks and poll() use the queues without a lock, and poll() sleeps on
+// data_available_fd. Otherwise they serialize on queue_mutex, and poll() sleeps on
+// data_available_cond.
+static bool multihal_lock_free_queues = false;
+
 // This mutex is shared by all queues
 static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 // Used to pause the multihal poll(). Broadcasted by sub-polling tasks if waiting_for_data.
 static pthread_cond_t data_available_cond = PTHREAD_COND_INITIALIZER;
-bool waiting_for_data = false;
+
+// Used to pause the multihal poll() instead, with lock-free queues. Signalled by sub-polling
+// tasks if waiting_for_data, so writers only make a syscall when the reader sleeps.
+static int data_available_fd = -1;
+static std::atomic<bool> waiting_for_data(false);
+
+static void lock_queues() {
+    if (!multihal_lock_free_queues) {
+        pthread_mutex_lock(&queue_mutex);
+    }
+}
+
+static void unlock_queues() {
+    if (!multihal_lock_free_queues) {
+        pthread_mutex_unlock(&queue_mutex);
+    }
+}
+
+// Call with the queues locked.
+static void signal_data_available() {
+    if (!multihal_lock_free_queues) {
+        if (waiting_for_data.load(std::memory_order_relaxed)) {
+            ALOGV("writerTask - broadcast data_available_cond");
+            pthread_cond_broadcast(&data_available_cond);
+        }
+        return;
+    }
+    // Pairs with the fence in wait_for_data().
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    // Only one writer needs to wake the reader, so the first one to see the flag clears it.
+    if (waiting_for_data.load(std::memory_order_relaxed) &&
+            waiting_for_data.exchange(false, std::memory_order_relaxed)) {
+        ALOGV("writerTask - signal data_available_fd");
+        uint64_t one = 1;
+        if (TEMP_FAILURE_RETRY(write(data_available_fd, &one, sizeof(one))) < 0) {
+            ALOGE("writerTask failed to signal data_available_fd: %s", strerror(errno));
+        }
+    }
+}
+
+// If set, the multihal owns the direct report channels, and offers them for the continuous
+// sensors of every sub-HAL, instead of forwarding them to the primary sub-HAL.
+static bool multihal_direct_channels = false;
 
 // Vector of sub modules, whose indexes are referred to in this file as module_index.
 static std::vector<hw_module_t *> *sub_hw_modules = nullptr;
@@ -83,6 +144,12 @@ std::map<int, FullHandle> global_to_full;
 std::map<FullHandle, int> full_to_global;
 int next_global_handle = 1;
 
+// Flat copy of full_to_global, indexed by [moduleIndex][localHandle], for remapping events in
+// poll(). Unassigned entries are -1. Local handles above MAX_FLAT_LOCAL_HANDLE only live in
+// full_to_global.
+static const int MAX_FLAT_LOCAL_HANDLE = 1023;
+static std::vector<std::vector<int>> local_to_global;
+
 static int assign_global_handle(int module_index, int local_handle) {
     int global_handle = next_global_handle++;
     FullHandle full_handle;
@@ -90,6 +157,17 @@ static int assign_global_handle(int module_index, int local_handle) {
     full_handle.localHandle = local_handle;
     full_to_global[full_handle] = global_handle;
     global_to_full[global_handle] = full_handle;
+
+    if (local_handle >= 0 && local_handle <= MAX_FLAT_LOCAL_HANDLE) {
+        if ((int)local_to_global.size() <= module_index) {
+            local_to_global.resize(module_index + 1);
+        }
+        std::vector<int>& module_handles = local_to_global[module_index];
+        if ((int)module_handles.size() <= local_handle) {
+            module_handles.resize(local_handle + 1, -1);
+        }
+        module_handles[local_handle] = global_handle;
+    }
     return global_handle;
 }
 
@@ -127,28 +205,103 @@ static int get_global_handle(FullHandle* full_handle) {
     return global_handle;
 }
 
+// Same as get_global_handle(FullHandle*), but tries the flat local_to_global table first.
+static int get_global_handle(int module_index, int local_handle) {
+    if (module_index < (int)local_to_global.size()) {
+        const std::vector<int>& module_handles = local_to_global[module_index];
+        if (local_handle >= 0 && local_handle < (int)module_handles.size() &&
+                module_handles[local_handle] >= 0) {
+            return module_handles[local_handle];
+        }
+    }
+    FullHandle full_handle;
+    full_handle.moduleIndex = module_index;
+    full_handle.localHandle = local_handle;
+    return get_global_handle(&full_handle);
+}
+
+// Queue sizing. Every queue holds at least the default capacity, and at least as many events as
+// the sub-HAL's largest hardware FIFO, so that a FIFO flush fits in one write. It is grown further
+// so that the sub-HAL's sensors, all running at their fastest rate, do not fill it while the
+// reader is stalled for up to SENSOR_EVENT_QUEUE_STALL_BUDGET_NS.
 static const int SENSOR_EVENT_QUEUE_CAPACITY = 36;
+static const int SENSOR_EVENT_QUEUE_MAX_CAPACITY = 4096;
+static const int64_t SENSOR_EVENT_QUEUE_STALL_BUDGET_NS = 100000000LL;
+
+// Each stats field has a single writer, so a relaxed load and store is enough, and avoids a
+// locked read-modify-write on the event path.
+template <typename T>
+static inline void stats_add(std::atomic<T>& counter, T value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+static int latency_bucket(int64_t latency_ns) {
+    uint64_t latency_us = latency_ns > 0 ? latency_ns / 1000 : 0;
+    if (latency_us == 0) {
+        return 0;
+    }
+    int bucket = 64 - __builtin_clzll(latency_us);
+    return std::min(bucket, MULTIHAL_STATS_LATENCY_BUCKETS - 1);
+}
+
+struct sensors_poll_context_t;
+static void write_direct_reports(sensors_poll_context_t* ctx, int module_index,
+        const sensors_event_t* events, int count);
 
 struct TaskContext {
+  sensors_poll_context_t* context;
   sensors_poll_device_t* device;
   SensorEventQueue* queue;
+  multihal_sub_hal_stats* stats;
+  int moduleIndex;
+  multihal_sensor_stats* sensorStats;
+  int sensorCount;
 };
 
+// Discards the oldest events of a full drop-oldest queue and charges them to their sensors.
+// Returns the number of events dropped, 0 if the reader holds the oldest events.
+// Sensor stats are indexed by global handle - 1: assign_global_handle() numbers the sensors
+// from 1 in sensor list order.
+static int drop_oldest_events(TaskContext* ctx, int maxCount) {
+    int handles[SENSOR_EVENT_QUEUE_CAPACITY];
+    int dropped = ctx->queue->dropOldest(std::min(maxCount, SENSOR_EVENT_QUEUE_CAPACITY), handles);
+    for (int i = 0; i < dropped; i++) {
+        int global_handle = get_global_handle(ctx->moduleIndex, handles[i]);
+        if (global_handle > 0 && global_handle <= ctx->sensorCount) {
+            stats_add<uint64_t>(ctx->sensorStats[global_handle - 1].events_dropped, 1);
+        }
+    }
+    if (dropped > 0) {
+        stats_add<uint64_t>(ctx->stats->events_dropped, dropped);
+    }
+    return dropped;
+}
+
 void *writerTask(void* ptr) {
     ALOGV("writerTask STARTS");
     TaskContext* ctx = (TaskContext*)ptr;
     sensors_poll_device_t* device = ctx->device;
     SensorEventQueue* queue = ctx->queue;
+    multihal_sub_hal_stats* stats = ctx->stats;
     sensors_event_t* buffer;
     int eventsPolled;
     while (1) {
-        pthread_mutex_lock(&queue_mutex);
-        if (queue->waitForSpace(&queue_mutex)) {
+        lock_queues();
+        if (queue->getPolicy() == SensorEventQueue::DROP_OLDEST &&
+                queue->getSize() == queue->getCapacity() &&
+                drop_oldest_events(ctx, SENSOR_EVENT_QUEUE_CAPACITY) > 0) {
+            ALOGV("writerTask dropped old events to make space");
+        }
+        int64_t waitStart = android::elapsedRealtimeNano();
+        if (queue->waitForSpace(multihal_lock_free_queues ? NULL : &queue_mutex)) {
             ALOGV("writerTask waited for space");
+            stats_add<uint64_t>(stats->producer_blocked_count, 1);
+            stats_add<uint64_t>(stats->producer_blocked_ns,
+                    android::elapsedRealtimeNano() - waitStart);
         }
-        int bufferSize = queue->getWritableRegion(SENSOR_EVENT_QUEUE_CAPACITY, &buffer);
+        int bufferSize = queue->getWritableRegion(queue->getCapacity(), &buffer);
         // Do blocking poll outside of lock
-        pthread_mutex_unlock(&queue_mutex);
+        unlock_queues();
 
         ALOGV("writerTask before poll() - bufferSize = %d", bufferSize);
         eventsPolled = device->poll(device, buffer, bufferSize);
@@ -160,14 +313,20 @@ void *writerTask(void* ptr) {
             }
             continue;
         }
-        pthread_mutex_lock(&queue_mutex);
+        if (multihal_direct_channels) {
+            write_direct_reports(ctx->context, ctx->moduleIndex, buffer, eventsPolled);
+        }
+        lock_queues();
         queue->markAsWritten(eventsPolled);
         ALOGV("writerTask wrote %d events", eventsPolled);
-        if (waiting_for_data) {
-            ALOGV("writerTask - broadcast data_available_cond");
-            pthread_cond_broadcast(&data_available_cond);
+        signal_data_available();
+        unlock_queues();
+
+        stats_add<uint64_t>(stats->events_written, eventsPolled);
+        uint32_t size = queue->getSize();
+        if (size > stats->queue_high_water_mark.load(std::memory_order_relaxed)) {
+            stats->queue_high_water_mark.store(size, std::memory_order_relaxed);
         }
-        pthread_mutex_unlock(&queue_mutex);
     }
     // never actually returns
     return NULL;
@@ -180,6 +339,12 @@ void *writerTask(void* ptr) {
 static struct sensor_t const* global_sensors_list = NULL;
 static int global_sensors_count = -1;
 
+// sensors_poll_context_t::direct_state bits.
+// The sensor is reported in at least one direct channel.
+static const uint8_t DIRECT_REPORTED = 1 << 0;
+// The sensor only runs for direct channels, so poll() must not deliver its events.
+static const uint8_t DIRECT_ONLY = 1 << 1;
+
 /*
  * Extends a sensors_poll_device_1 by including all the sub-module's devices.
  */
@@ -190,11 +355,13 @@ struct sensors_poll_context_t {
      */
     sensors_poll_device_1 proxy_device; // must be first
 
-    void addSubHwDevice(struct hw_device_t*);
+    void addSubHwDevice(struct hw_device_t*, int queue_capacity);
+    void dump(int fd);
 
     int activate(int handle, int enabled);
     int setDelay(int handle, int64_t ns);
     int poll(sensors_event_t* data, int count);
+    int poll_region(const sensors_event_t** events);
     int batch(int handle, int flags, int64_t period_ns, int64_t timeout);
     int flush(int handle);
     int inject_sensor_data(const sensors_event_t *data);
@@ -210,28 +377,126 @@ struct sensors_poll_context_t {
     std::vector<pthread_t> threads;
     int nextReadIndex;
 
+    // If set, poll() fills each batch through a K-way merge of the queue heads on timestamp, see
+    // SensorEventMerger, so that it is in order across all sub-HALs. Otherwise it copies the
+    // readable run of each queue in turn, starting at nextReadIndex.
+    bool mergeByTimestamp;
+    SensorEventMerger merger;
+    // If set, a sub-HAL whose queue is full overwrites its oldest events instead of blocking.
+    SensorEventQueue::OverflowPolicy overflowPolicy;
+    // If set, configuration calls go through a command queue per sub-HAL, parallel to
+    // sub_hw_devices, instead of being made on the caller's thread.
+    bool asyncConfig;
+    std::vector<SubHalCommandQueue*> command_queues;
+
+    // Run handed out by poll_region(), released on the next poll_region() or poll().
+    SensorEventQueue* heldQueue;
+    int heldCount;
+
+    // Shared memory block, with an entry for each sub_hw_devices entry. statsSize bytes, mapped
+    // from statsFd if statsMapped is set, calloc()ed otherwise.
+    multihal_stats* stats;
+    int statsFd;
+    size_t statsSize;
+    bool statsMapped;
+
+    // With multihal_direct_channels, what poll() clients and direct channels each asked of a
+    // sensor, indexed by global handle. The sub-HAL runs the sensor at the faster of the two.
+    struct SensorConfig {
+        bool poll_enabled;
+        int64_t poll_period_ns;
+        int64_t poll_timeout_ns;
+        int64_t direct_period_ns;
+    };
+    // Guards sensor_configs. Never held across a call into a sub-HAL.
+    pthread_mutex_t direct_config_mutex;
+    std::vector<SensorConfig> sensor_configs;
+    // One per global handle. Held across the sub-HAL calls that configure the sensor, so that
+    // they reach the sub-HAL in the order that sensor_configs was updated in, while calls for
+    // other sensors go ahead. Taken before direct_config_mutex.
+    std::vector<pthread_mutex_t> sensor_config_mutexes;
+    // Guards direct_channels, which the writer threads write to.
+    pthread_mutex_t direct_channels_mutex;
+    std::map<int, DirectChannel*> direct_channels;
+    int next_direct_channel_handle;
+    // DIRECT_* bits for each global handle, read by the writer threads and poll() without a lock.
+    std::vector<std::atomic<uint8_t>> direct_state;
+
     sensors_poll_device_t* get_v0_device_by_handle(int global_handle);
     sensors_poll_device_1_t* get_v1_device_by_handle(int global_handle);
     sensors_poll_device_1_t* get_primary_v1_device();
     int get_device_version_by_handle(int global_handle);
-
-    void copy_event_remap_handle(sensors_event_t* src, sensors_event_t* dest, int sub_index);
+    SubHalCommandQueue* get_command_queue_by_handle(int global_handle);
+
+    // The sub-HAL calls that plan_direct_report() decided on for a sensor.
+    struct SubHalConfig {
+        bool batch;             // forward_batch(handle, 0, period_ns, timeout_ns)
+        int64_t period_ns;
+        int64_t timeout_ns;
+        int activate;           // then forward_activate(handle, activate), unless -1
+        bool clear_direct_state;
+    };
+
+    int forward_activate(int handle, int enabled);
+    int forward_batch(int handle, int flags, int64_t period_ns, int64_t timeout);
+    void plan_direct_report(int handle, SubHalConfig* sub_hal_config);
+    int apply_direct_report(int handle, const SubHalConfig& sub_hal_config);
+    int update_direct_report(int handle);
+    void update_direct_reports();
+    int register_multihal_direct_channel(const struct sensors_direct_mem_t* mem,
+                                         int channel_handle);
+    int config_multihal_direct_report(int sensor_handle, int channel_handle, int rate_level);
+
+    bool has_data();
+    void wait_for_data();
+    int remap_handles(sensors_event_t* events, int count, int sub_index);
+    int read_round_robin(sensors_event_t* data, int maxReads);
+    int read_merged(sensors_event_t* data, int maxReads);
+    void release_held_region();
+    void record_delivery(int sub_index, const sensors_event_t* events, int count, int64_t now);
 };
 
-void sensors_poll_context_t::addSubHwDevice(struct hw_device_t* sub_hw_device) {
+void sensors_poll_context_t::addSubHwDevice(struct hw_device_t* sub_hw_device,
+        int queue_capacity) {
     ALOGV("addSubHwDevice");
+    int module_index = this->sub_hw_devices.size();
     this->sub_hw_devices.push_back(sub_hw_device);
 
-    SensorEventQueue *queue = new SensorEventQueue(SENSOR_EVENT_QUEUE_CAPACITY);
+    SensorEventQueue *queue = new SensorEventQueue(queue_capacity, this->overflowPolicy);
     this->queues.push_back(queue);
 
+    multihal_sub_hal_stats* subHalStats = &this->stats->sub_hals[this->stats->sub_hal_count++];
+    const char* name = sub_hw_device->module->name;
+    snprintf(subHalStats->name, sizeof(subHalStats->name), "%s", name ? name : "");
+    subHalStats->queue_capacity = queue_capacity;
+
     TaskContext* taskContext = new TaskContext();
+    taskContext->context = this;
     taskContext->device = (sensors_poll_device_t*) sub_hw_device;
     taskContext->queue = queue;
+    taskContext->stats = subHalStats;
+    taskContext->moduleIndex = module_index;
+    taskContext->sensorStats = (multihal_sensor_stats*)
+            ((char*)this->stats + this->stats->sensors_offset);
+    taskContext->sensorCount = this->stats->sensor_count;
 
     pthread_t writerThread;
     pthread_create(&writerThread, NULL, writerTask, taskContext);
     this->threads.push_back(writerThread);
+
+    if (this->asyncConfig) {
+        this->command_queues.push_back(new SubHalCommandQueue(
+                (sensors_poll_device_1_t*) sub_hw_device, subHalStats));
+    }
+}
+
+// Returns the command queue of the sub-HAL with the sensor, or NULL if calls to it are direct.
+SubHalCommandQueue* sensors_poll_context_t::get_command_queue_by_handle(int global_handle) {
+    int sub_index = get_module_index(global_handle);
+    if (sub_index < 0 || sub_index >= (int) this->command_queues.size()) {
+        return NULL;
+    }
+    return this->command_queues[sub_index];
 }
 
 // Returns the device pointer, or NULL if the global handle is invalid.
@@ -308,17 +573,52 @@ const char *apiNumToStr(int version) {
 }
 
 int sensors_poll_context_t::activate(int handle, int enabled) {
-    int retval = -EINVAL;
     ALOGV("activate");
+    int retval;
+    if (handle > 0 && handle < (int)this->sensor_configs.size()) {
+        pthread_mutex_lock(&this->sensor_config_mutexes[handle]);
+        pthread_mutex_lock(&this->direct_config_mutex);
+        SensorConfig& config = this->sensor_configs[handle];
+        if (config.direct_period_ns > 0) {
+            // Direct reports keep the sensor enabled. Only its rate, and whether poll() sees its
+            // events, change.
+            config.poll_enabled = enabled;
+            SubHalConfig sub_hal_config;
+            this->plan_direct_report(handle, &sub_hal_config);
+            pthread_mutex_unlock(&this->direct_config_mutex);
+            retval = this->apply_direct_report(handle, sub_hal_config);
+        } else {
+            pthread_mutex_unlock(&this->direct_config_mutex);
+            retval = this->forward_activate(handle, enabled);
+            if (retval >= 0) {
+                pthread_mutex_lock(&this->direct_config_mutex);
+                config.poll_enabled = enabled;
+                pthread_mutex_unlock(&this->direct_config_mutex);
+            }
+        }
+        pthread_mutex_unlock(&this->sensor_config_mutexes[handle]);
+    } else {
+        retval = this->forward_activate(handle, enabled);
+    }
+    ALOGV("retval %d", retval);
+    return retval;
+}
+
+int sensors_poll_context_t::forward_activate(int handle, int enabled) {
+    int retval = -EINVAL;
     int local_handle = get_local_handle(handle);
     sensors_poll_device_t* v0 = this->get_v0_device_by_handle(handle);
     if (halIsCompliant(this, handle) && local_handle >= 0 && v0) {
-        retval = v0->activate(v0, local_handle, enabled);
+        SubHalCommandQueue* command_queue = this->get_command_queue_by_handle(handle);
+        if (command_queue) {
+            retval = command_queue->activate(local_handle, enabled);
+        } else {
+            retval = v0->activate(v0, local_handle, enabled);
+        }
     } else {
         ALOGE("IGNORING activate(enable %d) call to non-API-compliant sensor handle=%d !",
                 enabled, handle);
     }
-    ALOGV("retval %d", retval);
     return retval;
 }
 
@@ -328,7 +628,13 @@ int sensors_poll_context_t::setDelay(int handle, int64_t ns) {
     int local_handle = get_local_handle(handle);
     sensors_poll_device_t* v0 = this->get_v0_device_by_handle(handle);
     if (halIsCompliant(this, handle) && local_handle >= 0 && v0) {
-        retval = v0->setDelay(v0, local_handle, ns);
+        SubHalCommandQueue* command_queue = this->get_command_queue_by_handle(handle);
+        if (command_queue) {
+            command_queue->setDelay(local_handle, ns);
+            retval = 0;
+        } else {
+            retval = v0->setDelay(v0, local_handle, ns);
+        }
     } else {
         ALOGE("IGNORING setDelay() call for non-API-compliant sensor handle=%d !", handle);
     }
@@ -336,65 +642,211 @@ int sensors_poll_context_t::setDelay(int handle, int64_t ns) {
     return retval;
 }
 
-void sensors_poll_context_t::copy_event_remap_handle(sensors_event_t* dest, sensors_event_t* src,
-        int sub_index) {
-    memcpy(dest, src, sizeof(struct sensors_event_t));
-    // A normal event's "sensor" field is a local handle. Convert it to a global handle.
-    // A meta-data event must have its sensor set to 0, but it has a nested event
-    // with a local handle that needs to be converted to a global handle.
-    FullHandle full_handle;
-    full_handle.moduleIndex = sub_index;
-
-    // If it's a metadata event, rewrite the inner payload, not the sensor field.
-    // If the event's sensor field is unregistered for any reason, rewrite the sensor field
-    // with a -1, instead of writing an incorrect but plausible sensor number, because
-    // get_global_handle() returns -1 for unknown FullHandles.
-    if (dest->type == SENSOR_TYPE_META_DATA) {
-        full_handle.localHandle = dest->meta_data.sensor;
-        dest->meta_data.sensor = get_global_handle(&full_handle);
-    } else {
-        full_handle.localHandle = dest->sensor;
-        dest->sensor = get_global_handle(&full_handle);
+// Rewrites the local handles of count events, copied from the queue of sub_index, in place.
+// Events with a bad handle are dropped and the rest are packed to the front.
+// Returns the number of events kept.
+int sensors_poll_context_t::remap_handles(sensors_event_t* events, int count, int sub_index) {
+    int kept = 0;
+    for (int i = 0; i < count; i++) {
+        sensors_event_t* event = &events[i];
+        // A normal event's "sensor" field is a local handle. Convert it to a global handle.
+        // A meta-data event must have its sensor set to 0, but it has a nested event
+        // with a local handle that needs to be converted to a global handle.
+        //
+        // If it's a metadata event, rewrite the inner payload, not the sensor field.
+        // If the event's sensor field is unregistered for any reason, rewrite the sensor field
+        // with a -1, instead of writing an incorrect but plausible sensor number, because
+        // get_global_handle() returns -1 for unknown FullHandles.
+        if (event->type == SENSOR_TYPE_META_DATA) {
+            event->meta_data.sensor = get_global_handle(sub_index, event->meta_data.sensor);
+        } else {
+            event->sensor = get_global_handle(sub_index, event->sensor);
+        }
+        if (event->sensor == SENSORS_HANDLE_BASE - 1) {
+            // Bad handle, do not pass corrupted event upstream !
+            ALOGW("Dropping bad local handle event packet on the floor");
+            continue;
+        }
+        if (event->sensor > 0 && event->sensor < (int)this->direct_state.size() &&
+                (this->direct_state[event->sensor].load(std::memory_order_relaxed) & DIRECT_ONLY)) {
+            // Only running for direct channels, which already have the event.
+            continue;
+        }
+        if (kept != i) {
+            memcpy(&events[kept], event, sizeof(struct sensors_event_t));
+        }
+        kept++;
+    }
+    return kept;
+}
+
+// Returns true if any queue has a readable event.
+bool sensors_poll_context_t::has_data() {
+    for (SensorEventQueue* queue : this->queues) {
+        if (queue->peek() != NULL) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Blocks until a writerTask signals that it has written data, unless some queue already has data.
+// Call with the queues locked.
+void sensors_poll_context_t::wait_for_data() {
+    if (!multihal_lock_free_queues) {
+        waiting_for_data.store(true, std::memory_order_relaxed);
+        pthread_cond_wait(&data_available_cond, &queue_mutex);
+        waiting_for_data.store(false, std::memory_order_relaxed);
+        return;
+    }
+    waiting_for_data.store(true, std::memory_order_relaxed);
+    // Pairs with the fence in signal_data_available(): either the writer sees that we are about
+    // to sleep, or we see the events it published.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!has_data()) {
+        uint64_t count;
+        if (TEMP_FAILURE_RETRY(read(data_available_fd, &count, sizeof(count))) < 0) {
+            ALOGE("poll failed to wait on data_available_fd: %s", strerror(errno));
+        }
+    }
+    waiting_for_data.store(false, std::memory_order_relaxed);
+}
+
+void sensors_poll_context_t::record_delivery(int sub_index, const sensors_event_t* events,
+        int count, int64_t now) {
+    multihal_sub_hal_stats* subHalStats = &this->stats->sub_hals[sub_index];
+    stats_add<uint64_t>(subHalStats->events_delivered, count);
+    for (int i = 0; i < count; i++) {
+        if (events[i].type != SENSOR_TYPE_META_DATA) {
+            stats_add<uint64_t>(
+                    subHalStats->delivery_latency[latency_bucket(now - events[i].timestamp)], 1);
+        }
+    }
+}
+
+// Reads up to maxReads events, taking the contiguous readable run of each queue in turn.
+int sensors_poll_context_t::read_round_robin(sensors_event_t* data, int maxReads) {
+    int empties = 0;
+    int queueCount = (int)this->queues.size();
+    int eventsRead = 0;
+    int64_t now = android::elapsedRealtimeNano();
+
+    while (empties < queueCount && eventsRead < maxReads) {
+        SensorEventQueue* queue = this->queues.at(this->nextReadIndex);
+        sensors_event_t* events;
+        int count = queue->getReadableRegion(maxReads - eventsRead, &events);
+        if (count == 0) {
+            empties++;
+        } else {
+            empties = 0;
+            memcpy(&data[eventsRead], events, count * sizeof(struct sensors_event_t));
+            // In drop-oldest mode the writer may have overwritten the start of the run while
+            // it was being copied. Those events were counted as dropped, so discard the copies.
+            int dropped = queue->dequeue(count);
+            if (dropped > 0) {
+                count -= dropped;
+                memmove(&data[eventsRead], &data[eventsRead + dropped],
+                        count * sizeof(struct sensors_event_t));
+            }
+            count = this->remap_handles(&data[eventsRead], count, nextReadIndex);
+            this->record_delivery(nextReadIndex, &data[eventsRead], count, now);
+            eventsRead += count;
+        }
+        this->nextReadIndex = (this->nextReadIndex + 1) % queueCount;
+    }
+    return eventsRead;
+}
+
+// Reads up to maxReads events, oldest timestamp first across all queues.
+int sensors_poll_context_t::read_merged(sensors_event_t* data, int maxReads) {
+    int eventsRead = 0;
+    int index;
+    int64_t now = android::elapsedRealtimeNano();
+
+    this->merger.start(this->queues);
+    while (eventsRead < maxReads && (index = this->merger.next()) >= 0) {
+        SensorEventQueue* queue = this->queues[index];
+        memcpy(&data[eventsRead], queue->peek(), sizeof(struct sensors_event_t));
+        // A copy of an event the writer dropped meanwhile is discarded, as in read_round_robin().
+        if (queue->dequeue(1) == 0 && this->remap_handles(&data[eventsRead], 1, index) > 0) {
+            this->record_delivery(index, &data[eventsRead], 1, now);
+            eventsRead++;
+        }
+        this->merger.advance(index);
+    }
+    return eventsRead;
+}
+
+void sensors_poll_context_t::release_held_region() {
+    if (this->heldQueue != NULL) {
+        this->heldQueue->dequeue(this->heldCount);
+        this->heldQueue = NULL;
+        this->heldCount = 0;
+    }
+}
+
+int sensors_poll_context_t::poll_region(const sensors_event_t** events) {
+    ALOGV("poll_region");
+    int queueCount = (int)this->queues.size();
+    if (queueCount == 0) {
+        ALOGE("poll_region called with no sub-HAL queues");
+        return -EINVAL;
+    }
+
+    lock_queues();
+    this->release_held_region();
+    while (true) {
+        for (int i = 0; i < queueCount; i++) {
+            int index = this->nextReadIndex;
+            SensorEventQueue* queue = this->queues[index];
+            this->nextReadIndex = (this->nextReadIndex + 1) % queueCount;
+
+            sensors_event_t* region;
+            // Pin the run, so that a drop-oldest writer cannot overwrite it while it is held.
+            int count = queue->getReadableRegion(queue->getCapacity(), &region, true);
+            if (count == 0) {
+                continue;
+            }
+            // The reader owns readable slots until it dequeues them, so remap them in place.
+            int kept = this->remap_handles(region, count, index);
+            if (kept == 0) {
+                queue->dequeue(count);
+                continue;
+            }
+            this->record_delivery(index, region, kept, android::elapsedRealtimeNano());
+            this->heldQueue = queue;
+            this->heldCount = count;
+            *events = region;
+            unlock_queues();
+            ALOGV("poll_region returning %d events.", kept);
+            return kept;
+        }
+        // The queues have been scanned and none contain data, so wait.
+        ALOGV("poll_region stopping to wait for data");
+        this->wait_for_data();
     }
 }
 
 int sensors_poll_context_t::poll(sensors_event_t *data, int maxReads) {
     ALOGV("poll");
-    int empties = 0;
-    int queueCount = 0;
     int eventsRead = 0;
 
-    pthread_mutex_lock(&queue_mutex);
-    queueCount = (int)this->queues.size();
+    lock_queues();
+    this->release_held_region();
+
     while (eventsRead == 0) {
-        while (empties < queueCount && eventsRead < maxReads) {
-            SensorEventQueue* queue = this->queues.at(this->nextReadIndex);
-            sensors_event_t* event = queue->peek();
-            if (event == NULL) {
-                empties++;
-            } else {
-                empties = 0;
-                this->copy_event_remap_handle(&data[eventsRead], event, nextReadIndex);
-                if (data[eventsRead].sensor == SENSORS_HANDLE_BASE - 1) {
-                    // Bad handle, do not pass corrupted event upstream !
-                    ALOGW("Dropping bad local handle event packet on the floor");
-                } else {
-                    eventsRead++;
-                }
-                queue->dequeue();
-            }
-            this->nextReadIndex = (this->nextReadIndex + 1) % queueCount;
+        if (this->mergeByTimestamp) {
+            eventsRead = this->read_merged(data, maxReads);
+        } else {
+            eventsRead = this->read_round_robin(data, maxReads);
         }
         if (eventsRead == 0) {
             // The queues have been scanned and none contain data, so wait.
             ALOGV("poll stopping to wait for data");
-            waiting_for_data = true;
-            pthread_cond_wait(&data_available_cond, &queue_mutex);
-            waiting_for_data = false;
-            empties = 0;
+            this->wait_for_data();
         }
     }
-    pthread_mutex_unlock(&queue_mutex);
+    unlock_queues();
     ALOGV("poll returning %d events.", eventsRead);
 
     return eventsRead;
@@ -402,15 +854,46 @@ int sensors_poll_context_t::poll(sensors_event_t *data, int maxReads) {
 
 int sensors_poll_context_t::batch(int handle, int flags, int64_t period_ns, int64_t timeout) {
     ALOGV("batch");
+    int retval;
+    if (handle > 0 && handle < (int)this->sensor_configs.size()) {
+        pthread_mutex_lock(&this->sensor_config_mutexes[handle]);
+        pthread_mutex_lock(&this->direct_config_mutex);
+        SensorConfig& config = this->sensor_configs[handle];
+        config.poll_period_ns = period_ns;
+        config.poll_timeout_ns = timeout;
+        if (config.direct_period_ns > 0) {
+            SubHalConfig sub_hal_config;
+            this->plan_direct_report(handle, &sub_hal_config);
+            pthread_mutex_unlock(&this->direct_config_mutex);
+            retval = this->apply_direct_report(handle, sub_hal_config);
+        } else {
+            pthread_mutex_unlock(&this->direct_config_mutex);
+            retval = this->forward_batch(handle, flags, period_ns, timeout);
+        }
+        pthread_mutex_unlock(&this->sensor_config_mutexes[handle]);
+    } else {
+        retval = this->forward_batch(handle, flags, period_ns, timeout);
+    }
+    ALOGV("retval %d", retval);
+    return retval;
+}
+
+int sensors_poll_context_t::forward_batch(int handle, int flags, int64_t period_ns,
+        int64_t timeout) {
     int retval = -EINVAL;
     int local_handle = get_local_handle(handle);
     sensors_poll_device_1_t* v1 = this->get_v1_device_by_handle(handle);
     if (halIsCompliant(this, handle) && local_handle >= 0 && v1) {
-        retval = v1->batch(v1, local_handle, flags, period_ns, timeout);
+        SubHalCommandQueue* command_queue = this->get_command_queue_by_handle(handle);
+        if (command_queue) {
+            command_queue->batch(local_handle, flags, period_ns, timeout);
+            retval = 0;
+        } else {
+            retval = v1->batch(v1, local_handle, flags, period_ns, timeout);
+        }
     } else {
         ALOGE("IGNORING batch() call to non-API-compliant sensor handle=%d !", handle);
     }
-    ALOGV("retval %d", retval);
     return retval;
 }
 
@@ -420,7 +903,12 @@ int sensors_poll_context_t::flush(int handle) {
     int local_handle = get_local_handle(handle);
     sensors_poll_device_1_t* v1 = this->get_v1_device_by_handle(handle);
     if (halIsCompliant(this, handle) && local_handle >= 0 && v1) {
-        retval = v1->flush(v1, local_handle);
+        SubHalCommandQueue* command_queue = this->get_command_queue_by_handle(handle);
+        if (command_queue) {
+            retval = command_queue->flush(local_handle);
+        } else {
+            retval = v1->flush(v1, local_handle);
+        }
     } else {
         ALOGE("IGNORING flush() call to non-API-compliant sensor handle=%d !", handle);
     }
@@ -465,6 +953,11 @@ int sensors_poll_context_t::register_direct_channel(const struct sensors_direct_
                                                    int channel_handle) {
     int retval = -EINVAL;
     ALOGV("register_direct_channel");
+    if (multihal_direct_channels) {
+        retval = this->register_multihal_direct_channel(mem, channel_handle);
+        ALOGV("retval %d", retval);
+        return retval;
+    }
     sensors_poll_device_1_t* v1 = get_primary_v1_device();
     if (v1 && halSupportDirectSensorReport(v1)) {
         retval = v1->register_direct_channel(v1, mem, channel_handle);
@@ -482,6 +975,14 @@ int sensors_poll_context_t::config_direct_report(int sensor_handle,
                                                 const struct sensors_direct_cfg_t *config) {
     int retval = -EINVAL;
     ALOGV("config_direct_report");
+    if (multihal_direct_channels) {
+        if (config != nullptr) {
+            retval = this->config_multihal_direct_report(sensor_handle, channel_handle,
+                    config->rate_level);
+        }
+        ALOGV("retval %d", retval);
+        return retval;
+    }
 
     if (config != nullptr) {
         int local_handle = get_local_handle(sensor_handle);
@@ -497,14 +998,280 @@ int sensors_poll_context_t::config_direct_report(int sensor_handle,
     ALOGV("retval %d", retval);
     return retval;
 }
+// Recomputes the direct report rate of the sensor from every channel, and decides how to configure
+// its sub-HAL for whichever of poll() clients and direct channels needs the shorter period.
+// Called with direct_config_mutex held. The calls are made by apply_direct_report() once it is
+// released.
+void sensors_poll_context_t::plan_direct_report(int handle, SubHalConfig* sub_hal_config) {
+    SensorConfig& config = this->sensor_configs[handle];
+    int64_t direct_period_ns = 0;
+    pthread_mutex_lock(&this->direct_channels_mutex);
+    for (auto& entry : this->direct_channels) {
+        int64_t period_ns = entry.second->getPeriodNs(handle);
+        if (period_ns > 0 && (direct_period_ns == 0 || period_ns < direct_period_ns)) {
+            direct_period_ns = period_ns;
+        }
+    }
+    pthread_mutex_unlock(&this->direct_channels_mutex);
+    bool was_direct = config.direct_period_ns > 0;
+    config.direct_period_ns = direct_period_ns;
+
+    *sub_hal_config = {false, 0, 0, -1, false};
+    if (direct_period_ns == 0) {
+        if (!was_direct) {
+            return;
+        }
+        // Hand the sensor back to poll() clients, as they last configured it.
+        if (config.poll_enabled) {
+            *sub_hal_config = {true, config.poll_period_ns, config.poll_timeout_ns, -1, true};
+        } else {
+            *sub_hal_config = {false, 0, 0, 0, true};
+        }
+        return;
+    }
+
+    int64_t period_ns = direct_period_ns;
+    if (config.poll_enabled && config.poll_period_ns < period_ns) {
+        period_ns = config.poll_period_ns;
+    }
+    // Set before enabling the sensor, so that poll() never sees its first events.
+    this->direct_state[handle].store(
+            DIRECT_REPORTED | (config.poll_enabled ? 0 : DIRECT_ONLY), std::memory_order_relaxed);
+    // Direct channels are read as events arrive, so the sensor must not batch.
+    *sub_hal_config = {true, period_ns, 0, (!was_direct && !config.poll_enabled) ? 1 : -1, false};
+}
+
+// Makes the sub-HAL calls that plan_direct_report() decided on. Called with the sensor's
+// sensor_config_mutexes entry held, and direct_config_mutex released.
+int sensors_poll_context_t::apply_direct_report(int handle, const SubHalConfig& sub_hal_config) {
+    int retval = 0;
+    if (sub_hal_config.batch) {
+        retval = this->forward_batch(handle, 0, sub_hal_config.period_ns,
+                sub_hal_config.timeout_ns);
+    }
+    if (retval >= 0 && sub_hal_config.activate >= 0) {
+        retval = this->forward_activate(handle, sub_hal_config.activate);
+    }
+    if (sub_hal_config.clear_direct_state) {
+        this->direct_state[handle].store(0, std::memory_order_relaxed);
+    }
+    return retval;
+}
+
+// plan_direct_report() and apply_direct_report() for one sensor, after a direct channel changed.
+int sensors_poll_context_t::update_direct_report(int handle) {
+    SubHalConfig sub_hal_config;
+    pthread_mutex_lock(&this->sensor_config_mutexes[handle]);
+    pthread_mutex_lock(&this->direct_config_mutex);
+    this->plan_direct_report(handle, &sub_hal_config);
+    pthread_mutex_unlock(&this->direct_config_mutex);
+    int retval = this->apply_direct_report(handle, sub_hal_config);
+    pthread_mutex_unlock(&this->sensor_config_mutexes[handle]);
+    return retval;
+}
+
+// update_direct_report() for every sensor that has direct reports, after a channel stopped some.
+void sensors_poll_context_t::update_direct_reports() {
+    std::vector<int> handles;
+    pthread_mutex_lock(&this->direct_config_mutex);
+    for (int handle = 1; handle < (int)this->sensor_configs.size(); handle++) {
+        if (this->sensor_configs[handle].direct_period_ns > 0) {
+            handles.push_back(handle);
+        }
+    }
+    pthread_mutex_unlock(&this->direct_config_mutex);
+    for (int handle : handles) {
+        this->update_direct_report(handle);
+    }
+}
+
+int sensors_poll_context_t::register_multihal_direct_channel(
+        const struct sensors_direct_mem_t* mem, int channel_handle) {
+    if (mem != nullptr) {
+        DirectChannel* channel = new DirectChannel(mem);
+        int error = channel->getError();
+        if (error < 0) {
+            delete channel;
+            return error;
+        }
+        pthread_mutex_lock(&this->direct_channels_mutex);
+        channel_handle = this->next_direct_channel_handle++;
+        this->direct_channels[channel_handle] = channel;
+        pthread_mutex_unlock(&this->direct_channels_mutex);
+        return channel_handle;
+    }
+
+    pthread_mutex_lock(&this->direct_channels_mutex);
+    DirectChannel* channel = nullptr;
+    auto it = this->direct_channels.find(channel_handle);
+    if (it != this->direct_channels.end()) {
+        channel = it->second;
+        this->direct_channels.erase(it);
+    }
+    pthread_mutex_unlock(&this->direct_channels_mutex);
+    if (channel != nullptr) {
+        bool active = channel->isActive();
+        delete channel;
+        if (active) {
+            this->update_direct_reports();
+        }
+    }
+    return 0;
+}
+
+int sensors_poll_context_t::config_multihal_direct_report(int sensor_handle, int channel_handle,
+        int rate_level) {
+    int retval = -EINVAL;
+    pthread_mutex_lock(&this->direct_channels_mutex);
+    auto it = this->direct_channels.find(channel_handle);
+    if (it == this->direct_channels.end()) {
+        ALOGE("config_direct_report() on unknown channel %d", channel_handle);
+        pthread_mutex_unlock(&this->direct_channels_mutex);
+    } else if (sensor_handle == -1) {
+        if (rate_level == SENSOR_DIRECT_RATE_STOP) {
+            it->second->stopAll();
+            retval = 0;
+        }
+        pthread_mutex_unlock(&this->direct_channels_mutex);
+        if (retval == 0) {
+            this->update_direct_reports();
+        }
+    } else {
+        int max_rate_level = 0;
+        if (sensor_handle > 0 && sensor_handle <= global_sensors_count) {
+            max_rate_level = (global_sensors_list[sensor_handle - 1].flags &
+                    SENSOR_FLAG_MASK_DIRECT_REPORT) >> SENSOR_FLAG_SHIFT_DIRECT_REPORT;
+        }
+        if (max_rate_level == 0 || rate_level < 0 || rate_level > max_rate_level) {
+            ALOGE("config_direct_report(sensor=%d, rate_level=%d) is not supported",
+                    sensor_handle, rate_level);
+        } else {
+            retval = it->second->config(sensor_handle, rate_level);
+        }
+        pthread_mutex_unlock(&this->direct_channels_mutex);
+        if (retval >= 0) {
+            int update_retval = this->update_direct_report(sensor_handle);
+            if (update_retval < 0) {
+                ALOGE("Configuring sensor %d for direct report failed: %d", sensor_handle,
+                        update_retval);
+                retval = update_retval;
+            }
+        }
+    }
+    return retval;
+}
+
+// Copies the events of a sub-HAL, still with local handles, to the direct channels that report
+// their sensors. Called by the writer thread of module_index.
+static void write_direct_reports(sensors_poll_context_t* ctx, int module_index,
+        const sensors_event_t* events, int count) {
+    bool locked = false;
+    for (int i = 0; i < count; i++) {
+        if (events[i].type == SENSOR_TYPE_META_DATA) {
+            continue;
+        }
+        int handle = get_global_handle(module_index, events[i].sensor);
+        if (handle <= 0 || handle >= (int)ctx->direct_state.size() ||
+                !(ctx->direct_state[handle].load(std::memory_order_relaxed) & DIRECT_REPORTED)) {
+            continue;
+        }
+        if (!locked) {
+            pthread_mutex_lock(&ctx->direct_channels_mutex);
+            locked = true;
+        }
+        sensors_event_t event = events[i];
+        event.sensor = handle;
+        for (auto& entry : ctx->direct_channels) {
+            entry.second->write(&event);
+        }
+    }
+    if (locked) {
+        pthread_mutex_unlock(&ctx->direct_channels_mutex);
+    }
+}
+
+void sensors_poll_context_t::dump(int fd) {
+    int64_t now = android::elapsedRealtimeNano();
+    double uptime_s = (now - this->stats->start_time_ns) / 1e9;
+    dprintf(fd, "MultiHal: %" PRIu32 " sub-HALs, up %.1f s, merge by timestamp %s\n",
+            this->stats->sub_hal_count, uptime_s, this->mergeByTimestamp ? "on" : "off");
+    if (multihal_direct_channels) {
+        pthread_mutex_lock(&this->direct_channels_mutex);
+        dprintf(fd, "  direct channels %zu\n", this->direct_channels.size());
+        pthread_mutex_unlock(&this->direct_channels_mutex);
+    }
+    for (uint32_t i = 0; i < this->stats->sub_hal_count; i++) {
+        multihal_sub_hal_stats* subHalStats = &this->stats->sub_hals[i];
+        uint64_t written = subHalStats->events_written.load(std::memory_order_relaxed);
+        dprintf(fd, "  [%" PRIu32 "] %s\n", i, subHalStats->name);
+        dprintf(fd, "    events written %" PRIu64 " (%.1f/s), delivered %" PRIu64 "\n",
+                written, uptime_s > 0 ? written / uptime_s : 0.0,
+                subHalStats->events_delivered.load(std::memory_order_relaxed));
+        dprintf(fd, "    queue high water mark %" PRIu32 "/%" PRIu32 "\n",
+                subHalStats->queue_high_water_mark.load(std::memory_order_relaxed),
+                subHalStats->queue_capacity);
+        dprintf(fd, "    producer blocked %" PRIu64 " times, %.3f ms total\n",
+                subHalStats->producer_blocked_count.load(std::memory_order_relaxed),
+                subHalStats->producer_blocked_ns.load(std::memory_order_relaxed) / 1e6);
+        dprintf(fd, "    events dropped %" PRIu64 "\n",
+                subHalStats->events_dropped.load(std::memory_order_relaxed));
+        if (this->asyncConfig) {
+            dprintf(fd, "    commands coalesced %" PRIu64 ", failed %" PRIu64 "\n",
+                    subHalStats->commands_coalesced.load(std::memory_order_relaxed),
+                    subHalStats->command_errors.load(std::memory_order_relaxed));
+        }
+        dprintf(fd, "    delivery latency (us):");
+        for (int bucket = 0; bucket < MULTIHAL_STATS_LATENCY_BUCKETS; bucket++) {
+            uint64_t count = subHalStats->delivery_latency[bucket].load(std::memory_order_relaxed);
+            if (count == 0) {
+                continue;
+            }
+            if (bucket == 0) {
+                dprintf(fd, " <1:%" PRIu64, count);
+            } else if (bucket == MULTIHAL_STATS_LATENCY_BUCKETS - 1) {
+                dprintf(fd, " >=%llu:%" PRIu64, 1ULL << (bucket - 1), count);
+            } else {
+                dprintf(fd, " %llu-%llu:%" PRIu64, 1ULL << (bucket - 1), 1ULL << bucket, count);
+            }
+        }
+        dprintf(fd, "\n");
+    }
+    multihal_sensor_stats* sensorStats = (multihal_sensor_stats*)
+            ((char*)this->stats + this->stats->sensors_offset);
+    for (uint32_t i = 0; i < this->stats->sensor_count; i++) {
+        uint64_t dropped = sensorStats[i].events_dropped.load(std::memory_order_relaxed);
+        if (dropped > 0) {
+            dprintf(fd, "  sensor %" PRId32 ": %" PRIu64 " events dropped\n",
+                    sensorStats[i].handle, dropped);
+        }
+    }
+}
+
 int sensors_poll_context_t::close() {
     ALOGV("close");
+    // Let queued configuration reach the sub-HALs before they are closed.
+    for (SubHalCommandQueue* command_queue : this->command_queues) {
+        delete command_queue;
+    }
+    this->command_queues.clear();
     for (std::vector<hw_device_t*>::iterator it = this->sub_hw_devices.begin();
             it != this->sub_hw_devices.end(); it++) {
         hw_device_t* dev = *it;
         int retval = dev->close(dev);
         ALOGV("retval %d", retval);
     }
+    if (this->stats != NULL) {
+        if (this->statsMapped) {
+            munmap(this->stats, this->statsSize);
+        } else {
+            free(this->stats);
+        }
+        this->stats = NULL;
+    }
+    if (this->statsFd >= 0) {
+        ::close(this->statsFd);
+        this->statsFd = -1;
+    }
     return 0;
 }
 
@@ -552,6 +1319,21 @@ static int device__poll(struct sensors_poll_device_t *dev, sensors_event_t* data
     return ctx->poll(data, count);
 }
 
+int multihal_poll_region(struct sensors_poll_device_t *dev, const sensors_event_t **events) {
+    sensors_poll_context_t* ctx = (sensors_poll_context_t*) dev;
+    return ctx->poll_region(events);
+}
+
+int multihal_get_stats_fd(struct sensors_poll_device_t *dev) {
+    sensors_poll_context_t* ctx = (sensors_poll_context_t*) dev;
+    return ctx->statsFd;
+}
+
+void multihal_dump(struct sensors_poll_device_t *dev, int fd) {
+    sensors_poll_context_t* ctx = (sensors_poll_context_t*) dev;
+    ctx->dump(fd);
+}
+
 static int device__batch(struct sensors_poll_device_1 *dev, int handle,
         int flags, int64_t period_ns, int64_t timeout) {
     sensors_poll_context_t* ctx = (sensors_poll_context_t*) dev;
@@ -587,6 +1369,12 @@ static int device__config_direct_report(struct sensors_poll_device_1 *dev,
 static int open_sensors(const struct hw_module_t* module, const char* name,
         struct hw_device_t** device);
 
+static std::string config_file_path_override;
+
+void multihal_set_config_file_path(const char *path) {
+    config_file_path_override = path;
+}
+
 /*
  * Adds valid paths from the config file to the vector passed in.
  * The vector must not be null.
@@ -594,8 +1382,11 @@ static int open_sensors(const struct hw_module_t* module, const char* name,
 static std::vector<std::string> get_so_paths() {
     std::vector<std::string> so_paths;
 
-    const std::vector<const char *> config_path_list(
+    std::vector<const char *> config_path_list(
             { MULTI_HAL_CONFIG_FILE_PATH, DEPRECATED_MULTI_HAL_CONFIG_FILE_PATH });
+    if (!config_file_path_override.empty()) {
+        config_path_list = { config_file_path_override.c_str() };
+    }
 
     std::ifstream stream;
     const char *path = nullptr;
@@ -626,6 +1417,55 @@ static std::vector<std::string> get_so_paths() {
     return so_paths;
 }
 
+/*
+ * Allocates the statistics block for up to sub_hal_capacity sub-HALs and for the sensors of
+ * sensors_list, in shared memory if possible. Sets *fd_out to the ashmem region, or -1, and
+ * *size_out and *mapped_out to what close() needs to release the block.
+ */
+static multihal_stats* create_stats(int sub_hal_capacity, const struct sensor_t* sensors_list,
+        int sensor_count, int* fd_out, size_t* size_out, bool* mapped_out) {
+    size_t sensors_offset = sizeof(multihal_stats) +
+            sub_hal_capacity * sizeof(multihal_sub_hal_stats);
+    sensors_offset = (sensors_offset + alignof(multihal_sensor_stats) - 1) &
+            ~(alignof(multihal_sensor_stats) - 1);
+    size_t size = sensors_offset + sensor_count * sizeof(multihal_sensor_stats);
+    void* block = MAP_FAILED;
+    int fd = ashmem_create_region("multihal_stats", size);
+    if (fd >= 0) {
+        block = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (block == MAP_FAILED) {
+            ALOGW("mmap() of stats failed: %s", strerror(errno));
+            ::close(fd);
+            fd = -1;
+        }
+    } else {
+        ALOGW("ashmem_create_region() for stats failed: %s", strerror(errno));
+    }
+    bool mapped = block != MAP_FAILED;
+    if (!mapped) {
+        block = calloc(1, size);
+    }
+
+    multihal_stats* stats = new (block) multihal_stats();
+    stats->version = MULTIHAL_STATS_VERSION;
+    stats->sub_hal_count = 0;
+    stats->start_time_ns = android::elapsedRealtimeNano();
+    for (int i = 0; i < sub_hal_capacity; i++) {
+        new (&stats->sub_hals[i]) multihal_sub_hal_stats();
+    }
+    stats->sensor_count = sensor_count;
+    stats->sensors_offset = sensors_offset;
+    multihal_sensor_stats* sensor_stats = (multihal_sensor_stats*)((char*)block + sensors_offset);
+    for (int i = 0; i < sensor_count; i++) {
+        new (&sensor_stats[i]) multihal_sensor_stats();
+        sensor_stats[i].handle = sensors_list[i].handle;
+    }
+    *fd_out = fd;
+    *size_out = size;
+    *mapped_out = mapped;
+    return stats;
+}
+
 /*
  * Ensures that the sub-module array is initialized.
  * This can be first called from get_sensors_list or from open_sensors.
@@ -638,41 +1478,36 @@ static void lazy_init_modules() {
     }
     std::vector<std::string> so_paths(get_so_paths());
 
-    // dlopen the module files and cache their module symbols in sub_hw_modules
+    // dlopen the module files and cache their module symbols in sub_hw_modules,
+    // all libraries at once but in config file order.
     sub_hw_modules = new std::vector<hw_module_t *>();
     so_handles = new std::vector<void *>();
-    dlerror(); // clear any old errors
-    const char* sym = HAL_MODULE_INFO_SYM_AS_STR;
-    for (const auto &s : so_paths) {
-        const char* path = s.c_str();
-        void* lib_handle = dlopen(path, RTLD_LAZY);
-        if (lib_handle == NULL) {
-            ALOGW("dlerror(): %s", dlerror());
-        } else {
-            ALOGI("Loaded library from %s", path);
-            ALOGV("Opening symbol \"%s\"", sym);
-            // clear old errors
-            dlerror();
-            struct hw_module_t* module = (hw_module_t*) dlsym(lib_handle, sym);
-            const char* error;
-            if ((error = dlerror()) != NULL) {
-                ALOGW("Error calling dlsym: %s", error);
-            } else if (module == NULL) {
-                ALOGW("module == NULL");
-            } else {
-                ALOGV("Loaded symbols from \"%s\"", sym);
-                sub_hw_modules->push_back(module);
-                so_handles->push_back(lib_handle);
-                lib_handle = nullptr;
-            }
-        }
-        if (lib_handle != nullptr) {
-            dlclose(lib_handle);
-        }
-    }
+    load_sub_hal_modules(so_paths, so_paths.size(), sub_hw_modules, so_handles);
     pthread_mutex_unlock(&init_modules_mutex);
 }
 
+/*
+ * Returns the direct report flags the multihal sets for a sensor when it owns the direct
+ * channels: ashmem channels, at the fastest rate level the sensor can keep up with. Only
+ * continuous sensors support direct report.
+ */
+static uint64_t get_direct_report_flags(const struct sensor_t* sensor) {
+    if ((sensor->flags & SENSOR_FLAG_MASK_REPORTING_MODE) != SENSOR_FLAG_CONTINUOUS_MODE ||
+            sensor->minDelay <= 0) {
+        return 0;
+    }
+    int rate_level = SENSOR_DIRECT_RATE_VERY_FAST;
+    while (rate_level > SENSOR_DIRECT_RATE_STOP &&
+            DirectChannel::getRatePeriodNs(rate_level) < sensor->minDelay * 1000LL) {
+        rate_level--;
+    }
+    if (rate_level == SENSOR_DIRECT_RATE_STOP) {
+        return 0;
+    }
+    return ((uint64_t)rate_level << SENSOR_FLAG_SHIFT_DIRECT_REPORT) |
+            SENSOR_FLAG_DIRECT_CHANNEL_ASHMEM;
+}
+
 /*
  * Lazy-initializes global_sensors_count, global_sensors_list, and module_sensor_handles.
  */
@@ -688,14 +1523,19 @@ static void lazy_init_sensors_list() {
 
     ALOGV("lazy_init_sensors_list needs to do work");
     lazy_init_modules();
-
-    // Count all the sensors, then allocate an array of blanks.
+    multihal_direct_channels = property_get_bool("sensor.multihal.direct_channel", false);
+    ALOGI_IF(multihal_direct_channels, "Offering direct channels for all sub-HALs");
+    multihal_lock_free_queues = property_get_bool("sensor.multihal.lock_free_queues", false);
+    ALOGI_IF(multihal_lock_free_queues, "Using sub-HAL queues without a lock");
+
+    // Query all the modules at once, count all the sensors, then allocate an array of blanks.
+    std::vector<const struct sensor_t*> subhal_sensors_lists;
+    std::vector<int> subhal_sensors_counts;
+    get_sub_hal_sensor_lists(*sub_hw_modules, sub_hw_modules->size(), &subhal_sensors_lists,
+            &subhal_sensors_counts);
     global_sensors_count = 0;
-    const struct sensor_t *subhal_sensors_list;
-    for (std::vector<hw_module_t*>::iterator it = sub_hw_modules->begin();
-            it != sub_hw_modules->end(); it++) {
-        struct sensors_module_t *module = (struct sensors_module_t*) *it;
-        global_sensors_count += module->get_sensors_list(module, &subhal_sensors_list);
+    for (int count : subhal_sensors_counts) {
+        global_sensors_count += std::max(count, 0);
         ALOGV("increased global_sensors_count to %d", global_sensors_count);
     }
 
@@ -705,15 +1545,12 @@ static void lazy_init_sensors_list() {
 
     // index of the next sensor to set in mutable_sensor_list
     int mutable_sensor_index = 0;
-    int module_index = 0;
 
-    for (std::vector<hw_module_t*>::iterator it = sub_hw_modules->begin();
-            it != sub_hw_modules->end(); it++) {
-        hw_module_t *hw_module = *it;
+    // Assign global handles in module order, as if the modules had been queried one by one.
+    for (int module_index = 0; module_index < (int)sub_hw_modules->size(); module_index++) {
         ALOGV("examine one module");
-        // Read the sub-module's sensor list.
-        struct sensors_module_t *module = (struct sensors_module_t*) hw_module;
-        int module_sensor_count = module->get_sensors_list(module, &subhal_sensors_list);
+        const struct sensor_t *subhal_sensors_list = subhal_sensors_lists[module_index];
+        int module_sensor_count = subhal_sensors_counts[module_index];
         ALOGV("the module has %d sensors", module_sensor_count);
 
         // Copy the HAL's sensor list into global_sensors_list,
@@ -725,8 +1562,14 @@ static void lazy_init_sensors_list() {
             memcpy(&mutable_sensor_list[mutable_sensor_index], local_sensor,
                 sizeof(struct sensor_t));
 
-            // sensor direct report is only for primary module
-            if (module_index != 0) {
+            if (multihal_direct_channels) {
+                // The multihal offers its own direct channels, for any sub-HAL.
+                mutable_sensor_list[mutable_sensor_index].flags =
+                    (mutable_sensor_list[mutable_sensor_index].flags &
+                            ~(SENSOR_FLAG_MASK_DIRECT_REPORT | SENSOR_FLAG_MASK_DIRECT_CHANNEL)) |
+                    get_direct_report_flags(local_sensor);
+            } else if (module_index != 0) {
+                // sensor direct report is only for primary module
                 mutable_sensor_list[mutable_sensor_index].flags &=
                     ~(SENSOR_FLAG_MASK_DIRECT_REPORT | SENSOR_FLAG_MASK_DIRECT_CHANNEL);
             }
@@ -740,7 +1583,6 @@ static void lazy_init_sensors_list() {
 
             mutable_sensor_index++;
         }
-        module_index++;
     }
     // Set the const static global_sensors_list to the mutable one allocated by this function.
     global_sensors_list = mutable_sensor_list;
@@ -749,6 +1591,31 @@ static void lazy_init_sensors_list() {
     ALOGV("end lazy_init_sensors_list");
 }
 
+/*
+ * Returns the event queue capacity for the sub-HAL device at sub_index in sub_hw_devices, sized
+ * from its sensors as described at SENSOR_EVENT_QUEUE_CAPACITY. Like get_v1_device_by_handle(),
+ * this takes the module index of a sensor handle to be the index of its device.
+ */
+static int get_queue_capacity(int sub_index) {
+    int64_t fifo_capacity = 0;
+    double events_per_stall = 0;
+    for (int i = 0; i < global_sensors_count; i++) {
+        const struct sensor_t* sensor = &global_sensors_list[i];
+        if (get_module_index(sensor->handle) != sub_index) {
+            continue;
+        }
+        fifo_capacity = std::max(fifo_capacity, (int64_t)sensor->fifoMaxEventCount);
+        // minDelay is in microseconds, and zero or negative for on-change and one-shot sensors,
+        // which are left to the default capacity.
+        if (sensor->minDelay > 0) {
+            events_per_stall += SENSOR_EVENT_QUEUE_STALL_BUDGET_NS / 1000.0 / sensor->minDelay;
+        }
+    }
+    int64_t capacity = std::max((int64_t)SENSOR_EVENT_QUEUE_CAPACITY,
+            std::max(fifo_capacity, (int64_t)ceil(events_per_stall)));
+    return (int)std::min(capacity, (int64_t)SENSOR_EVENT_QUEUE_MAX_CAPACITY);
+}
+
 static int module__get_sensors_list(__unused struct sensors_module_t* module,
         struct sensor_t const** list) {
     ALOGV("module__get_sensors_list start");
@@ -788,7 +1655,16 @@ static int open_sensors(const struct hw_module_t* hw_module, const char* name,
         struct hw_device_t** hw_device_out) {
     ALOGV("open_sensors begin...");
 
-    lazy_init_modules();
+    // The sensor list sizes the event queues and the statistics block.
+    lazy_init_sensors_list();
+
+    if (multihal_lock_free_queues && data_available_fd < 0) {
+        data_available_fd = eventfd(0, EFD_CLOEXEC);
+        if (data_available_fd < 0) {
+            ALOGE("eventfd() failed: %s", strerror(errno));
+            return -errno;
+        }
+    }
 
     // Create proxy device, to return later.
     sensors_poll_context_t *dev = new sensors_poll_context_t();
@@ -807,6 +1683,29 @@ static int open_sensors(const struct hw_module_t* hw_module, const char* name,
     dev->proxy_device.config_direct_report = device__config_direct_report;
 
     dev->nextReadIndex = 0;
+    dev->heldQueue = NULL;
+    dev->heldCount = 0;
+    dev->stats = create_stats(sub_hw_modules->size(), global_sensors_list, global_sensors_count,
+            &dev->statsFd, &dev->statsSize, &dev->statsMapped);
+    dev->mergeByTimestamp = property_get_bool("sensor.multihal.merge_by_timestamp", false);
+    ALOGI_IF(dev->mergeByTimestamp, "Merging sub-HAL events by timestamp");
+    dev->overflowPolicy = property_get_bool("sensor.multihal.overflow_drop_oldest", false) ?
+            SensorEventQueue::DROP_OLDEST : SensorEventQueue::BLOCK;
+    ALOGI_IF(dev->overflowPolicy == SensorEventQueue::DROP_OLDEST,
+            "Dropping the oldest events of full sub-HAL queues");
+    dev->asyncConfig = property_get_bool("sensor.multihal.async_config", false);
+    ALOGI_IF(dev->asyncConfig, "Configuring sub-HALs asynchronously");
+    if (multihal_direct_channels) {
+        pthread_mutex_init(&dev->direct_config_mutex, NULL);
+        pthread_mutex_init(&dev->direct_channels_mutex, NULL);
+        dev->next_direct_channel_handle = 1;
+        dev->sensor_configs.resize(global_sensors_count + 1);
+        dev->sensor_config_mutexes.resize(global_sensors_count + 1);
+        for (pthread_mutex_t& mutex : dev->sensor_config_mutexes) {
+            pthread_mutex_init(&mutex, NULL);
+        }
+        dev->direct_state = std::vector<std::atomic<uint8_t>>(global_sensors_count + 1);
+    }
 
     // Open() the subhal modules. Remember their devices in a vector parallel to sub_hw_modules.
     for (std::vector<hw_module_t*>::iterator it = sub_hw_modules->begin();
@@ -821,7 +1720,8 @@ static int open_sensors(const struct hw_module_t* hw_module, const char* name,
                         apiNumToStr(sub_hw_device->version));
                 ALOGE("Sensors belonging to this HAL will get ignored !");
             }
-            dev->addSubHwDevice(sub_hw_device);
+            dev->addSubHwDevice(sub_hw_device,
+                    get_queue_capacity(dev->sub_hw_devices.size()));
         }
     }
 
@@ -19,11 +19,103 @@
 #include <hardware/sensors.h>
 #include <hardware/hardware.h>
 
-static const char* MULTI_HAL_CONFIG_FILE_PATH = "/vendor/etc/sensors/hals.conf";
+#include <atomic>
+
+static const char* const MULTI_HAL_CONFIG_FILE_PATH = "/vendor/etc/sensors/hals.conf";
 
 // Depracated because system partition HAL config file does not satisfy treble requirements.
-static const char* DEPRECATED_MULTI_HAL_CONFIG_FILE_PATH = "/system/etc/sensors/hals.conf";
+static const char* const DEPRECATED_MULTI_HAL_CONFIG_FILE_PATH = "/system/etc/sensors/hals.conf";
 
 struct sensors_module_t *get_multi_hal_module_info(void);
 
+/*
+ * Reads the list of sub-HAL libraries from path instead of the default config file locations.
+ * For host tests and benchmarks, which cannot install a config file. Must be called before the
+ * module's get_sensors_list() or open() is first used.
+ */
+void multihal_set_config_file_path(const char *path);
+
+/*
+ * Zero-copy alternative to poll() for consumers that open the multihal in their own process.
+ *
+ * Blocks until events are available, then points *events at a run of them inside the multihal's
+ * queue for one sub-HAL, with handles already remapped to global handles, and returns the
+ * length of the run. The sub-HAL wrote the run there itself, so it is never copied.
+ *
+ * The run stays valid until the next call to multihal_poll_region() or poll() on the same
+ * device, which releases it back to the sub-HAL. Runs are always taken round-robin, even when
+ * events are merged by timestamp for poll().
+ *
+ * Returns -EINVAL if no sub-HAL was loaded, since no event could ever arrive.
+ */
+int multihal_poll_region(struct sensors_poll_device_t *dev, const sensors_event_t **events);
+
+/*
+ * Per-sub-HAL statistics, kept by the multihal in a shared memory block laid out as one
+ * multihal_stats header followed by sub_hal_count multihal_sub_hal_stats entries, in the same
+ * order as the sub-HALs in the config file, and by sensor_count multihal_sensor_stats entries
+ * at sensors_offset bytes from the start of the block, in get_sensors_list() order. Every
+ * field is updated by a single thread with relaxed atomic stores, so another process can map
+ * the block read-only and sample it at any time. Rates are the difference between two samples.
+ */
+#define MULTIHAL_STATS_VERSION 3
+#define MULTIHAL_STATS_NAME_LENGTH 64
+// Bucket i counts events delivered between 2^(i-1) and 2^i microseconds after their
+// timestamp, bucket 0 those under 1 us, and the last bucket everything slower.
+#define MULTIHAL_STATS_LATENCY_BUCKETS 24
+
+struct multihal_sub_hal_stats {
+    char name[MULTIHAL_STATS_NAME_LENGTH];
+    uint32_t queue_capacity;
+
+    // Updated by the sub-HAL's writer thread.
+    std::atomic<uint32_t> queue_high_water_mark;
+    std::atomic<uint64_t> events_written;
+    std::atomic<uint64_t> producer_blocked_count;
+    std::atomic<uint64_t> producer_blocked_ns;
+    // Events discarded to make room when the queue overflows in drop-oldest mode.
+    std::atomic<uint64_t> events_dropped;
+
+    // Updated by the sub-HAL's command thread, with sensor.multihal.async_config set.
+    // batch() and setDelay() calls replaced by a later one before they ran, counted when the
+    // later one runs, and those that failed.
+    std::atomic<uint64_t> commands_coalesced;
+    std::atomic<uint64_t> command_errors;
+
+    // Updated by the thread calling poll(). Meta-data events are counted as delivered but
+    // have no meaningful timestamp, so they are left out of the latency histogram.
+    std::atomic<uint64_t> events_delivered;
+    std::atomic<uint64_t> delivery_latency[MULTIHAL_STATS_LATENCY_BUCKETS];
+};
+
+struct multihal_stats {
+    uint32_t version;
+    uint32_t sub_hal_count;
+    // CLOCK_BOOTTIME at open(), in nanoseconds.
+    int64_t start_time_ns;
+    uint32_t sensor_count;
+    uint32_t sensors_offset;
+    struct multihal_sub_hal_stats sub_hals[0];
+};
+
+// The multihal hands out global handles from 1 up in get_sensors_list() order, so the entry of
+// the sensor with global handle h is at index h - 1.
+struct multihal_sensor_stats {
+    // Global handle, as reported by get_sensors_list().
+    int32_t handle;
+    // Updated by the writer thread of the sub-HAL that owns the sensor.
+    std::atomic<uint64_t> events_dropped;
+};
+
+/*
+ * Returns a file descriptor for the statistics block of the device, which can be mmap()ed
+ * read-only, or -1 if the block is not shareable. The multihal keeps ownership of the fd.
+ */
+int multihal_get_stats_fd(struct sensors_poll_device_t *dev);
+
+/*
+ * Writes a human-readable summary of the statistics to fd.
+ */
+void multihal_dump(struct sensors_poll_device_t *dev, int fd);
+
 #endif // HARDWARE_LIBHARDWARE_MODULES_SENSORS_MULTIHAL_H_
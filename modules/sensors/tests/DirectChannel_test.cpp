@@ -0,0 +1,217 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <hardware/sensors.h>
+#include <cutils/native_handle.h>
+
+#include "DirectChannel.h"
+
+// Unit tests for the DirectChannel, with a memfd standing in for the ashmem region that the
+// framework would register.
+
+// Run it like this:
+//
+// m sensorsdirecttests && \
+// out/host/linux-x86/nativetest64/sensorsdirecttests/sensorsdirecttests
+
+static const int RECORD_SIZE = 104;
+
+// Shared memory as registered by a direct channel client, and the client's own mapping of it.
+struct Memory {
+    int fd;
+    native_handle_t* handle;
+    sensors_direct_mem_t mem;
+    uint8_t* base;
+    // Size of the mapping, which tests may register as a different mem.size.
+    size_t mappedSize;
+
+    explicit Memory(int records) {
+        size_t size = records * RECORD_SIZE;
+        mappedSize = size;
+        fd = memfd_create("direct_channel_test", MFD_CLOEXEC);
+        if (fd < 0 || ftruncate(fd, size) < 0) {
+            printf("memfd_create() failed: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        handle = native_handle_create(1, 0);
+        handle->data[0] = fd;
+        mem.type = SENSOR_DIRECT_MEM_TYPE_ASHMEM;
+        mem.format = SENSOR_DIRECT_FMT_SENSORS_EVENT;
+        mem.size = size;
+        mem.handle = handle;
+        base = (uint8_t*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        // Garbage, which registering the channel must clear.
+        memset(base, 0xa5, size);
+    }
+
+    ~Memory() {
+        munmap(base, mappedSize);
+        native_handle_delete(handle);
+        close(fd);
+    }
+
+    // Reads record i at the offsets the SENSOR_DIRECT_FMT_SENSORS_EVENT format specifies,
+    // without going through sensors_event_t.
+    int32_t size(int i) { return read32(i, 0x0); }
+    int32_t token(int i) { return read32(i, 0x4); }
+    int32_t type(int i) { return read32(i, 0x8); }
+    uint32_t counter(int i) { return (uint32_t)read32(i, 0xc); }
+    int64_t timestamp(int i) {
+        int64_t value;
+        memcpy(&value, base + i * RECORD_SIZE + 0x10, sizeof(value));
+        return value;
+    }
+    float data(int i, int j) {
+        float value;
+        memcpy(&value, base + i * RECORD_SIZE + 0x18 + j * sizeof(float), sizeof(value));
+        return value;
+    }
+
+private:
+    int32_t read32(int i, int offset) {
+        int32_t value;
+        memcpy(&value, base + i * RECORD_SIZE + offset, sizeof(value));
+        return value;
+    }
+};
+
+bool checkInt(const char* msg, int64_t expected, int64_t actual) {
+    if (actual != expected) {
+        printf("%s; expected %lld; actual was %lld\n", msg, (long long)expected,
+                (long long)actual);
+        return false;
+    }
+    return true;
+}
+
+static void writeEvent(DirectChannel* channel, int sensor, int64_t timestamp, float value) {
+    sensors_event_t event;
+    memset(&event, 0, sizeof(event));
+    event.version = sizeof(event);
+    event.sensor = sensor;
+    event.type = SENSOR_TYPE_ACCELEROMETER;
+    event.timestamp = timestamp;
+    event.data[0] = value;
+    channel->write(&event);
+}
+
+bool testLayout() {
+    printf("testLayout\n");
+    if (!checkInt("sensors_event_t size", RECORD_SIZE, sizeof(sensors_event_t))) return false;
+    Memory memory(4);
+    DirectChannel channel(&memory.mem);
+    if (!checkInt("error", 0, channel.getError())) return false;
+    for (int i = 0; i < 4; i++) {
+        if (!checkInt("cleared counter", 0, memory.counter(i))) return false;
+    }
+    if (!checkInt("token", 7, channel.config(7, SENSOR_DIRECT_RATE_VERY_FAST))) return false;
+    writeEvent(&channel, 7, 1000, 1.5f);
+    writeEvent(&channel, 8, 2000000, 2.5f);
+    if (!checkInt("size", RECORD_SIZE, memory.size(0))) return false;
+    if (!checkInt("token", 7, memory.token(0))) return false;
+    if (!checkInt("type", SENSOR_TYPE_ACCELEROMETER, memory.type(0))) return false;
+    if (!checkInt("counter", 1, memory.counter(0))) return false;
+    if (!checkInt("timestamp", 1000, memory.timestamp(0))) return false;
+    if (memory.data(0, 0) != 1.5f) {
+        printf("data[0] was %f\n", memory.data(0, 0));
+        return false;
+    }
+    // Sensor 8 is not reported in this channel.
+    if (!checkInt("unreported counter", 0, memory.counter(1))) return false;
+    return true;
+}
+
+bool testWrap() {
+    printf("testWrap\n");
+    Memory memory(3);
+    DirectChannel channel(&memory.mem);
+    channel.config(1, SENSOR_DIRECT_RATE_VERY_FAST);
+    for (int i = 0; i < 5; i++) {
+        writeEvent(&channel, 1, (i + 1) * 2000000LL, i);
+    }
+    // Records 0 and 1 hold the 4th and 5th events, record 2 the 3rd.
+    if (!checkInt("counter 0", 4, memory.counter(0))) return false;
+    if (!checkInt("counter 1", 5, memory.counter(1))) return false;
+    if (!checkInt("counter 2", 3, memory.counter(2))) return false;
+    if (!checkInt("timestamp 2", 6000000, memory.timestamp(2))) return false;
+    return true;
+}
+
+bool testRateLimit() {
+    printf("testRateLimit\n");
+    Memory memory(300);
+    DirectChannel channel(&memory.mem);
+    channel.config(1, SENSOR_DIRECT_RATE_NORMAL);
+    channel.config(2, SENSOR_DIRECT_RATE_FAST);
+    // One second of both sensors at 1 kHz, with some jitter.
+    for (int i = 0; i < 1000; i++) {
+        int64_t timestamp = i * 1000000LL + (i % 3) * 50000;
+        writeEvent(&channel, 1, timestamp, i);
+        writeEvent(&channel, 2, timestamp, i);
+    }
+    int counts[3] = {};
+    int64_t lastTimestamp[3] = {};
+    for (int i = 0; i < 300 && memory.counter(i) != 0; i++) {
+        int token = memory.token(i);
+        if (token < 1 || token > 2) {
+            printf("unexpected token %d\n", token);
+            return false;
+        }
+        if (counts[token] > 0 &&
+                memory.timestamp(i) - lastTimestamp[token] <
+                DirectChannel::getRatePeriodNs(token == 1 ? SENSOR_DIRECT_RATE_NORMAL
+                        : SENSOR_DIRECT_RATE_FAST) * 3 / 4) {
+            printf("sensor %d sampled too fast at record %d\n", token, i);
+            return false;
+        }
+        lastTimestamp[token] = memory.timestamp(i);
+        counts[token]++;
+    }
+    // The jitter allowance can let one more event in at the end of the second.
+    if (counts[1] < 50 || counts[1] > 51 || counts[2] < 200 || counts[2] > 201) {
+        printf("wrote %d normal and %d fast rate events in one second\n", counts[1], counts[2]);
+        return false;
+    }
+
+    channel.config(1, SENSOR_DIRECT_RATE_STOP);
+    if (!checkInt("stopped period", 0, channel.getPeriodNs(1))) return false;
+    if (!checkInt("fast period", 5000000, channel.getPeriodNs(2))) return false;
+    channel.stopAll();
+    if (channel.isActive()) {
+        printf("channel still active after stopAll()\n");
+        return false;
+    }
+    return true;
+}
+
+bool testUnsupported() {
+    printf("testUnsupported\n");
+    Memory memory(4);
+    memory.mem.type = SENSOR_DIRECT_MEM_TYPE_GRALLOC;
+    DirectChannel gralloc(&memory.mem);
+    if (!checkInt("gralloc error", -EINVAL, gralloc.getError())) return false;
+    memory.mem.type = SENSOR_DIRECT_MEM_TYPE_ASHMEM;
+    memory.mem.size = RECORD_SIZE - 1;
+    DirectChannel tiny(&memory.mem);
+    if (!checkInt("tiny error", -EINVAL, tiny.getError())) return false;
+    memory.mem.size = RECORD_SIZE;
+    DirectChannel channel(&memory.mem);
+    if (!checkInt("bad rate", -EINVAL, channel.config(1, 4))) return false;
+    return true;
+}
+
+int main(int argc __attribute((unused)), char **argv __attribute((unused))) {
+    if (testLayout() &&
+            testWrap() &&
+            testRateLimit() &&
+            testUnsupported()) {
+        printf("ALL PASSED\n");
+    } else {
+        printf("SOMETHING FAILED\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
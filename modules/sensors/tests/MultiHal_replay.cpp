@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <hardware/sensors.h>
+
+#include "multihal.h"
+
+// End-to-end benchmark of the multihal, driven by recorded or synthetic event traces.
+//
+// Loads sub_hals copies of the stub sub-HAL library through a generated config file, each
+// replaying a trace, and calls poll() from the main thread the way SensorService does. Reports
+// delivered events/sec, the latency from the stub returning an event to poll() returning it,
+// CPU time per event and context switches, all for the whole process: multihal writer threads,
+// stub sub-HALs and the consumer.
+//
+// Run it like this:
+//
+// m sensorsreplay && \
+// out/host/linux-x86/bin/sensorsreplay [sub_hals] [rate_hz] [seconds] [burst] [trace]
+//
+// sub_hals: number of stub sub-HALs (default 4)
+// rate_hz:  synthetic trace rate of each of the two stub sensors (default 400)
+// seconds:  how long to poll (default 5)
+// burst:    synthetic events delivered at once, like a FIFO flush (default 1)
+// trace:    trace file to replay in every sub-HAL instead of the synthetic one, in the format
+//           described in StubSubHal.cpp
+//
+// The stub library is found in the host lib64 directory, or at $SENSORS_STUB_SUB_HAL.
+
+static const int POLL_BUFFER_SIZE = 128;
+
+static int64_t boottimeNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_BOOTTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static std::string stubSubHalPath() {
+    const char* env = getenv("SENSORS_STUB_SUB_HAL");
+    if (env != nullptr) {
+        return env;
+    }
+    char exe[PATH_MAX];
+    ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    exe[len > 0 ? len : 0] = '\0';
+    std::string dir = std::string(exe).substr(0, std::string(exe).rfind('/') + 1);
+    return dir + "../lib64/libsensors_stub_sub_hal.so";
+}
+
+static bool writeSyntheticTrace(const std::string& path, int rateHz, int burst) {
+    FILE* file = fopen(path.c_str(), "we");
+    if (file == nullptr) {
+        return false;
+    }
+    // Both sensors at rateHz, so one event every half period, delivered burst at a time.
+    int64_t delayUs = 1000000LL / rateHz / 2;
+    fprintf(file, "# delay_us handle x y z\n");
+    for (int i = 0; i < burst * 2; i++) {
+        fprintf(file, "%lld %d %f %f %f\n", (long long)(i % burst == 0 ? delayUs * burst : 0),
+                i % 2 + 1, 0.1f * i, 9.8f, 0.2f);
+    }
+    fclose(file);
+    return true;
+}
+
+// Copies the stub once per sub-HAL, since dlopen() returns the already loaded library for a path
+// it has seen, with the trace next to it, and writes the config file listing the copies.
+static std::string setUpSubHals(int subHals, int rateHz, int burst, const char* trace) {
+    std::string stub = stubSubHalPath();
+    const char* tmp = getenv("TMPDIR");
+    std::string prefix = std::string(tmp ? tmp : "/tmp") + "/sensorsreplay_" +
+            std::to_string(getpid());
+    std::string config = prefix + "_hals.conf";
+    FILE* configFile = fopen(config.c_str(), "we");
+    if (configFile == nullptr) {
+        fprintf(stderr, "Could not write %s\n", config.c_str());
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < subHals; i++) {
+        std::string path = prefix + "_" + std::to_string(i) + ".so";
+        std::string command = "cp '" + stub + "' '" + path + "'";
+        if (trace != nullptr) {
+            command += " && cp '" + std::string(trace) + "' '" + path + ".trace'";
+        }
+        if (system(command.c_str()) != 0 ||
+                (trace == nullptr && !writeSyntheticTrace(path + ".trace", rateHz, burst))) {
+            fprintf(stderr, "Could not set up %s from %s\n", path.c_str(), stub.c_str());
+            exit(EXIT_FAILURE);
+        }
+        fprintf(configFile, "%s\n", path.c_str());
+    }
+    fclose(configFile);
+    return prefix;
+}
+
+static int64_t cpuTimeUs(const struct rusage& usage) {
+    return (int64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 +
+            usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+int main(int argc, char** argv) {
+    int subHals = argc > 1 ? atoi(argv[1]) : 4;
+    int rateHz = argc > 2 ? atoi(argv[2]) : 400;
+    int seconds = argc > 3 ? atoi(argv[3]) : 5;
+    int burst = argc > 4 ? atoi(argv[4]) : 1;
+    const char* trace = argc > 5 ? argv[5] : nullptr;
+    if (subHals <= 0 || rateHz <= 0 || seconds <= 0 || burst <= 0) {
+        printf("usage: %s [sub_hals] [rate_hz] [seconds] [burst] [trace]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::string prefix = setUpSubHals(subHals, rateHz, burst, trace);
+    multihal_set_config_file_path((prefix + "_hals.conf").c_str());
+
+    sensors_module_t* module = get_multi_hal_module_info();
+    const sensor_t* list;
+    int sensorCount = module->get_sensors_list(module, &list);
+    hw_device_t* device;
+    if (module->common.methods->open(&module->common, SENSORS_HARDWARE_POLL, &device) != 0) {
+        fprintf(stderr, "Could not open the multihal\n");
+        return EXIT_FAILURE;
+    }
+    sensors_poll_device_1_t* dev = (sensors_poll_device_1_t*)device;
+    for (int i = 0; i < sensorCount; i++) {
+        dev->batch(dev, list[i].handle, 0, list[i].minDelay * 1000LL, 0);
+        dev->activate((sensors_poll_device_t*)dev, list[i].handle, 1);
+    }
+
+    std::vector<int64_t> latencies;
+    latencies.reserve((int64_t)subHals * rateHz * 2 * seconds * 11 / 10);
+    sensors_event_t data[POLL_BUFFER_SIZE];
+    struct rusage before, after;
+    getrusage(RUSAGE_SELF, &before);
+    int64_t start = boottimeNs();
+    int64_t end = start + seconds * 1000000000LL;
+    int64_t now = start;
+    while (now < end) {
+        int count = dev->poll((sensors_poll_device_t*)dev, data, POLL_BUFFER_SIZE);
+        now = boottimeNs();
+        for (int i = 0; i < count; i++) {
+            if (data[i].type != SENSOR_TYPE_META_DATA) {
+                latencies.push_back(now - data[i].timestamp);
+            }
+        }
+    }
+    getrusage(RUSAGE_SELF, &after);
+    int64_t elapsed = now - start;
+
+    int64_t total = latencies.size();
+    if (total == 0) {
+        fprintf(stderr, "No events were delivered\n");
+        return EXIT_FAILURE;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    long voluntary = after.ru_nvcsw - before.ru_nvcsw;
+    long involuntary = after.ru_nivcsw - before.ru_nivcsw;
+    printf("sub_hals %d, rate_hz %d, burst %d, trace %s\n", subHals, rateHz, burst,
+            trace ? trace : "synthetic");
+    printf("events %lld, events/sec %.0f\n", (long long)total, total * 1e9 / elapsed);
+    printf("latency us: p50 %.1f, p99 %.1f, p99.9 %.1f, max %.1f\n",
+            latencies[total / 2] / 1e3, latencies[total * 99 / 100] / 1e3,
+            latencies[total * 999 / 1000] / 1e3, latencies[total - 1] / 1e3);
+    printf("cpu us/event %.2f\n", (double)(cpuTimeUs(after) - cpuTimeUs(before)) / total);
+    printf("context switches/1000 events: voluntary %.1f, involuntary %.1f\n",
+            voluntary * 1000.0 / total, involuntary * 1000.0 / total);
+    fflush(stdout);
+    multihal_dump((sensors_poll_device_t*)dev, STDOUT_FILENO);
+
+    std::string cleanup = "rm -f '" + prefix + "'_*";
+    if (system(cleanup.c_str()) != 0) {
+        fprintf(stderr, "Could not remove %s_*\n", prefix.c_str());
+    }
+    // The multihal writer threads never exit, so do not wait for them.
+    _exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <hardware/sensors.h>
+
+#include "SensorEventMerger.h"
+#include "SensorEventQueue.h"
+
+// Cost per event of draining N full sub-HAL queues in timestamp order, against the plain
+// round-robin scan that multihal poll() uses by default.
+//
+// Run it like this:
+//
+// m sensorsmerge_benchmark && \
+// out/host/linux-x86/benchmarktest64/sensorsmerge_benchmark/sensorsmerge_benchmark
+
+static const int QUEUE_CAPACITY = 36;
+static const int POLL_BUFFER_SIZE = 128;
+
+// Fills every queue to capacity with interleaved, jittered timestamps. Once a queue has been
+// drained, refill() republishes the same slots, so the benchmark loop does not rewrite events.
+class Queues {
+public:
+    explicit Queues(int count) {
+        for (int i = 0; i < count; i++) {
+            SensorEventQueue* queue = new SensorEventQueue(QUEUE_CAPACITY);
+            sensors_event_t* buffer;
+            int size = queue->getWritableRegion(QUEUE_CAPACITY, &buffer);
+            for (int j = 0; j < size; j++) {
+                memset(&buffer[j], 0, sizeof(sensors_event_t));
+                buffer[j].sensor = i;
+                buffer[j].timestamp = (int64_t)j * count * 1000 + i * 1000 + (j * 7919 + i) % 997;
+            }
+            queue->markAsWritten(size);
+            mQueues.push_back(queue);
+        }
+    }
+
+    ~Queues() {
+        for (SensorEventQueue* queue : mQueues) {
+            delete queue;
+        }
+    }
+
+    void refill() {
+        for (SensorEventQueue* queue : mQueues) {
+            sensors_event_t* buffer;
+            queue->markAsWritten(queue->getWritableRegion(QUEUE_CAPACITY, &buffer));
+        }
+    }
+
+    std::vector<SensorEventQueue*>& get() { return mQueues; }
+
+private:
+    std::vector<SensorEventQueue*> mQueues;
+};
+
+static void BM_RoundRobin(benchmark::State& state) {
+    Queues queues(state.range(0));
+    std::vector<SensorEventQueue*>& q = queues.get();
+    sensors_event_t data[POLL_BUFFER_SIZE];
+    int queueCount = (int)q.size();
+    int nextReadIndex = 0;
+    int64_t events = 0;
+    for (auto _ : state) {
+        queues.refill();
+        int empties = 0;
+        while (empties < queueCount) {
+            int eventsRead = 0;
+            while (empties < queueCount && eventsRead < POLL_BUFFER_SIZE) {
+                SensorEventQueue* queue = q[nextReadIndex];
+                sensors_event_t* event = queue->peek();
+                if (event == NULL) {
+                    empties++;
+                } else {
+                    empties = 0;
+                    memcpy(&data[eventsRead++], event, sizeof(sensors_event_t));
+                    queue->dequeue();
+                }
+                nextReadIndex = (nextReadIndex + 1) % queueCount;
+            }
+            benchmark::DoNotOptimize(data);
+            events += eventsRead;
+        }
+    }
+    state.SetItemsProcessed(events);
+}
+BENCHMARK(BM_RoundRobin)->Arg(4)->Arg(8)->Arg(16);
+
+static void BM_Merged(benchmark::State& state) {
+    Queues queues(state.range(0));
+    std::vector<SensorEventQueue*>& q = queues.get();
+    SensorEventMerger merger;
+    sensors_event_t data[POLL_BUFFER_SIZE];
+    int64_t events = 0;
+    for (auto _ : state) {
+        queues.refill();
+        int eventsRead;
+        do {
+            int index;
+            eventsRead = 0;
+            merger.start(q);
+            while (eventsRead < POLL_BUFFER_SIZE && (index = merger.next()) >= 0) {
+                memcpy(&data[eventsRead++], q[index]->peek(), sizeof(sensors_event_t));
+                q[index]->dequeue();
+                merger.advance(index);
+            }
+            benchmark::DoNotOptimize(data);
+            events += eventsRead;
+        } while (eventsRead > 0);
+    }
+    state.SetItemsProcessed(events);
+}
+BENCHMARK(BM_Merged)->Arg(4)->Arg(8)->Arg(16);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <hardware/sensors.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "SensorEventQueue.h"
+
+// Multi-sub-HAL stress benchmark for the SensorEventQueue.
+//
+// Every writer thread stands in for one sub-HAL writerTask in multihal.cpp, and the main thread
+// drains all queues the way sensors_poll_context_t::poll() does. Reports delivered events/sec
+// and the latency from markAsWritten() to the event being read out of a poll() batch.
+//
+// Run it like this:
+//
+// m sensorsstress
+// out/host/linux-x86/bin/sensorsstress [sub_hals] [events] [period_us] [lock_free]
+//
+// sub_hals:  number of writer threads (default 4)
+// events:    events written by each writer (default 1000000)
+// period_us: sleep between writes of writer N is N * period_us, so that fast and slow
+//            sub-HALs are mixed (default 0, every writer runs flat out)
+// lock_free: 1 to use the queues without a lock and wake the reader through an eventfd, as
+//            multihal does with sensor.multihal.lock_free_queues set. 0 to serialize on one
+//            mutex and condition, as it does by default (default 0)
+
+static const int QUEUE_CAPACITY = 36;
+static const int POLL_BUFFER_SIZE = 128;
+
+static bool lockFree;
+
+// lock_free 1
+static int dataAvailableFd;
+static std::atomic<bool> waitingForData(false);
+
+// lock_free 0
+static pthread_mutex_t queueMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t dataAvailableCond = PTHREAD_COND_INITIALIZER;
+static bool waitingForDataLocked = false;
+
+struct WriterContext {
+    SensorEventQueue* queue;
+    int events;
+    int periodUs;
+    int blocked;
+};
+
+static int64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void* writerTask(void* ptr) {
+    WriterContext* ctx = (WriterContext*)ptr;
+    SensorEventQueue* queue = ctx->queue;
+    sensors_event_t* buffer;
+    int written = 0;
+    while (written < ctx->events) {
+        if (!lockFree) {
+            pthread_mutex_lock(&queueMutex);
+        }
+        if (queue->waitForSpace(lockFree ? NULL : &queueMutex)) {
+            ctx->blocked++;
+        }
+        int count = queue->getWritableRegion(
+                std::min(QUEUE_CAPACITY, ctx->events - written), &buffer);
+        if (!lockFree) {
+            pthread_mutex_unlock(&queueMutex);
+        }
+        int64_t now = nowNs();
+        for (int i = 0; i < count; i++) {
+            buffer[i].sensor = written + i;
+            buffer[i].timestamp = now;
+        }
+        if (!lockFree) {
+            pthread_mutex_lock(&queueMutex);
+            queue->markAsWritten(count);
+            if (waitingForDataLocked) {
+                pthread_cond_broadcast(&dataAvailableCond);
+            }
+            pthread_mutex_unlock(&queueMutex);
+        } else {
+            queue->markAsWritten(count);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (waitingForData.load(std::memory_order_relaxed) &&
+                    waitingForData.exchange(false, std::memory_order_relaxed)) {
+                uint64_t one = 1;
+                if (write(dataAvailableFd, &one, sizeof(one)) < 0) {
+                    perror("write");
+                }
+            }
+        }
+        written += count;
+        if (ctx->periodUs > 0) {
+            usleep(ctx->periodUs);
+        }
+    }
+    return NULL;
+}
+
+static bool hasData(std::vector<SensorEventQueue*>& queues) {
+    for (SensorEventQueue* queue : queues) {
+        if (queue->peek() != NULL) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Same scan as sensors_poll_context_t::poll(), minus the handle remapping.
+static int pollQueues(std::vector<SensorEventQueue*>& queues, int* nextReadIndex,
+        sensors_event_t* data, int maxReads) {
+    int queueCount = (int)queues.size();
+    int empties = 0;
+    int eventsRead = 0;
+    if (!lockFree) {
+        pthread_mutex_lock(&queueMutex);
+    }
+    while (eventsRead == 0) {
+        while (empties < queueCount && eventsRead < maxReads) {
+            SensorEventQueue* queue = queues[*nextReadIndex];
+            sensors_event_t* events;
+            int count = queue->getReadableRegion(maxReads - eventsRead, &events);
+            if (count == 0) {
+                empties++;
+            } else {
+                empties = 0;
+                memcpy(&data[eventsRead], events, count * sizeof(sensors_event_t));
+                queue->dequeue(count);
+                eventsRead += count;
+            }
+            *nextReadIndex = (*nextReadIndex + 1) % queueCount;
+        }
+        if (eventsRead == 0 && !lockFree) {
+            waitingForDataLocked = true;
+            pthread_cond_wait(&dataAvailableCond, &queueMutex);
+            waitingForDataLocked = false;
+            empties = 0;
+        } else if (eventsRead == 0) {
+            waitingForData.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!hasData(queues)) {
+                uint64_t count;
+                if (read(dataAvailableFd, &count, sizeof(count)) < 0) {
+                    perror("read");
+                }
+            }
+            waitingForData.store(false, std::memory_order_relaxed);
+            empties = 0;
+        }
+    }
+    if (!lockFree) {
+        pthread_mutex_unlock(&queueMutex);
+    }
+    return eventsRead;
+}
+
+int main(int argc, char** argv) {
+    int subHals = argc > 1 ? atoi(argv[1]) : 4;
+    int events = argc > 2 ? atoi(argv[2]) : 1000000;
+    int periodUs = argc > 3 ? atoi(argv[3]) : 0;
+    lockFree = argc > 4 && atoi(argv[4]) != 0;
+    if (subHals <= 0 || events <= 0 || periodUs < 0) {
+        printf("usage: %s [sub_hals] [events] [period_us] [lock_free]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    dataAvailableFd = eventfd(0, EFD_CLOEXEC);
+
+    std::vector<SensorEventQueue*> queues;
+    std::vector<WriterContext> contexts(subHals);
+    std::vector<pthread_t> threads(subHals);
+    for (int i = 0; i < subHals; i++) {
+        queues.push_back(new SensorEventQueue(QUEUE_CAPACITY));
+        contexts[i].queue = queues[i];
+        contexts[i].events = events;
+        contexts[i].periodUs = i * periodUs;
+        contexts[i].blocked = 0;
+    }
+
+    int64_t total = (int64_t)subHals * events;
+    std::vector<int64_t> latencies;
+    latencies.reserve(total);
+    sensors_event_t data[POLL_BUFFER_SIZE];
+    int nextReadIndex = 0;
+
+    int64_t start = nowNs();
+    for (int i = 0; i < subHals; i++) {
+        pthread_create(&threads[i], NULL, writerTask, &contexts[i]);
+    }
+    while ((int64_t)latencies.size() < total) {
+        int count = pollQueues(queues, &nextReadIndex, data, POLL_BUFFER_SIZE);
+        int64_t now = nowNs();
+        for (int i = 0; i < count; i++) {
+            latencies.push_back(now - data[i].timestamp);
+        }
+    }
+    int64_t elapsed = nowNs() - start;
+    int blocked = 0;
+    for (int i = 0; i < subHals; i++) {
+        pthread_join(threads[i], NULL);
+        blocked += contexts[i].blocked;
+        delete queues[i];
+    }
+    close(dataAvailableFd);
+
+    std::sort(latencies.begin(), latencies.end());
+    printf("sub_hals %d, events %lld, period_us %d, lock_free %d\n", subHals, (long long)total,
+            periodUs, lockFree);
+    printf("events/sec %.0f\n", total * 1e9 / elapsed);
+    printf("latency us: p50 %.1f, p99 %.1f, max %.1f\n",
+            latencies[total / 2] / 1e3, latencies[total * 99 / 100] / 1e3,
+            latencies[total - 1] / 1e3);
+    printf("writer waits for space %d\n", blocked);
+    return EXIT_SUCCESS;
+}
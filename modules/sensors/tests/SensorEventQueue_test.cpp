@@ -2,8 +2,13 @@
 #include <stdlib.h>
 #include <hardware/sensors.h>
 #include <pthread.h>
+#include <sched.h>
 #include <cutils/atomic.h>
 
+#include <memory>
+#include <vector>
+
+#include "SensorEventMerger.h"
 #include "SensorEventQueue.h"
 
 // Unit tests for the SensorEventQueue.
@@ -89,10 +94,98 @@ bool testWrappingWriteSizeCounts() {
 }
 
 
+bool checkReadableBufferSize(SensorEventQueue* queue, int requested, int expected) {
+    sensors_event_t* buffer;
+    int actual = queue->getReadableRegion(requested, &buffer);
+    if (actual != expected) {
+        printf("Expected readable buffer size was %d; actual was %d\n", expected, actual);
+        return false;
+    }
+    return true;
+}
+
+bool testWrappingReadSizeCounts() {
+    printf("testWrappingReadSizeCounts\n");
+    std::unique_ptr<SensorEventQueue> owned(new SensorEventQueue(10));
+    SensorEventQueue* queue = owned.get();
+    if (!checkReadableBufferSize(queue, 10, 0)) return false;
+    queue->markAsWritten(8);
+    if (!checkReadableBufferSize(queue, 100, 8)) return false;
+    if (!checkReadableBufferSize(queue, 5, 5)) return false;
+
+    queue->dequeue(6);
+    if (!checkSize(queue, 2)) return false;
+    // Write across the end of the array.
+    queue->markAsWritten(2);
+    queue->markAsWritten(3);
+    if (!checkSize(queue, 7)) return false;
+    // Only the run up to the end of the array is contiguous.
+    if (!checkReadableBufferSize(queue, 100, 4)) return false;
+    queue->dequeue(4);
+    if (!checkReadableBufferSize(queue, 100, 3)) return false;
+
+    // Dequeuing more than is readable empties the queue.
+    queue->dequeue(100);
+    if (!checkSize(queue, 0)) return false;
+
+    printf("passed\n");
+    return true;
+}
+
+void writeEvents(SensorEventQueue* queue, int firstHandle, int count, int metaIndex) {
+    sensors_event_t* buffer;
+    int size = queue->getWritableRegion(count, &buffer);
+    for (int i = 0; i < size; i++) {
+        buffer[i].sensor = firstHandle + i;
+        buffer[i].type = i == metaIndex ? SENSOR_TYPE_META_DATA : SENSOR_TYPE_ACCELEROMETER;
+    }
+    queue->markAsWritten(size);
+}
+
+// Test the writer dropping records from under the reader.
+bool testDropOldest() {
+    printf("testDropOldest\n");
+    std::unique_ptr<SensorEventQueue> owned(
+            new SensorEventQueue(5, SensorEventQueue::DROP_OLDEST));
+    SensorEventQueue* queue = owned.get();
+    int handles[5];
+    sensors_event_t* buffer;
+    writeEvents(queue, 0, 5, 3);
+
+    // The reader looks at the region, then the writer drops two records from it.
+    if (!checkReadableBufferSize(queue, 5, 5)) return false;
+    if (!checkInt("dropped", 2, queue->dropOldest(2, handles))) return false;
+    if (!checkInt("first dropped handle", 0, handles[0])) return false;
+    if (!checkInt("second dropped handle", 1, handles[1])) return false;
+    if (!checkSize(queue, 3)) return false;
+    // The reader learns that the first two records it copied are gone.
+    if (!checkInt("dropped while reading", 2, queue->dequeue(3))) return false;
+    if (!checkSize(queue, 2)) return false;
+
+    // Dropping stops before a meta-data event.
+    writeEvents(queue, 5, 3, -1);
+    if (!checkSize(queue, 5)) return false;
+    if (!checkInt("dropped before meta-data", 0, queue->dropOldest(5, handles))) return false;
+    if (!checkInt("meta-data handle", 3, queue->peek()->sensor)) return false;
+    if (!checkInt("dropped while reading", 0, queue->dequeue(1))) return false;
+
+    // Records in a pinned region are never dropped.
+    if (!checkReadableBufferSize(queue, 1, 1)) return false;
+    queue->getReadableRegion(1, &buffer, true);
+    if (!checkInt("dropped while pinned", 0, queue->dropOldest(5, handles))) return false;
+    if (!checkInt("dropped while reading", 0, queue->dequeue(1))) return false;
+    if (!checkInt("dropped after unpinning", 3, queue->dropOldest(5, handles))) return false;
+    if (!checkSize(queue, 0)) return false;
+
+    printf("passed\n");
+    return true;
+}
 
 struct TaskContext {
   bool success;
   SensorEventQueue* queue;
+  // If set, both sides only touch the queue while holding mutex, as multihal does by default.
+  bool locked;
 };
 
 static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -110,8 +203,10 @@ void *fullQueueWriterTask(void* ptr) {
     sensors_event_t* buffer;
 
     while (totalWrites < FULL_QUEUE_EVENT_COUNT) {
-        pthread_mutex_lock(&mutex);
-        if (queue->waitForSpace(&mutex)) {
+        if (ctx->locked) {
+            pthread_mutex_lock(&mutex);
+        }
+        if (queue->waitForSpace(ctx->locked ? &mutex : NULL)) {
             totalWaits++;
             printf(".");
         }
@@ -121,6 +216,9 @@ void *fullQueueWriterTask(void* ptr) {
         for (int i = 0; i < writableSize; i++) {
             printf("w");
         }
+        if (!ctx->locked) {
+            pthread_mutex_lock(&mutex);
+        }
         pthread_cond_broadcast(&dataAvailableCond);
         pthread_mutex_unlock(&mutex);
     }
@@ -151,10 +249,23 @@ void* fullQueueReaderTask(void* ptr) {
         while (!fullQueueReaderShouldRead(queue->getSize(), totalReads)) {
             pthread_cond_wait(&dataAvailableCond, &mutex);
         }
+        pthread_mutex_unlock(&mutex);
+        // Wait for the writer to block in waitForSpace() before freeing up a slot, as long as
+        // it has more to write. With the lock, it releases mutex once it is waiting.
+        if (totalReads + FULL_QUEUE_CAPACITY < FULL_QUEUE_EVENT_COUNT) {
+            while (!queue->isWriterWaiting()) {
+                sched_yield();
+            }
+        }
+        if (ctx->locked) {
+            pthread_mutex_lock(&mutex);
+        }
         queue->dequeue();
+        if (ctx->locked) {
+            pthread_mutex_unlock(&mutex);
+        }
         totalReads++;
         printf("r");
-        pthread_mutex_unlock(&mutex);
     }
     printf("\n");
     ctx->success = ctx->success && checkInt("totalreads", FULL_QUEUE_EVENT_COUNT, totalReads);
@@ -162,17 +273,19 @@ void* fullQueueReaderTask(void* ptr) {
 }
 
 // Test internal queue-full waiting and broadcasting.
-bool testFullQueueIo() {
-    printf("testFullQueueIo\n");
+bool testFullQueueIo(bool locked) {
+    printf("testFullQueueIo locked=%d\n", locked);
     SensorEventQueue* queue = new SensorEventQueue(FULL_QUEUE_CAPACITY);
 
     TaskContext readerCtx;
     readerCtx.success = true;
     readerCtx.queue = queue;
+    readerCtx.locked = locked;
 
     TaskContext writerCtx;
     writerCtx.success = true;
     writerCtx.queue = queue;
+    writerCtx.locked = locked;
 
     pthread_t writer, reader;
     pthread_create(&reader, NULL, fullQueueReaderTask, &readerCtx);
@@ -186,11 +299,64 @@ bool testFullQueueIo() {
     return true;
 }
 
+void writeTimestamps(SensorEventQueue* queue, const int64_t* timestamps, int count) {
+    sensors_event_t* buffer;
+    int size = queue->getWritableRegion(count, &buffer);
+    for (int i = 0; i < size; i++) {
+        buffer[i].timestamp = timestamps[i];
+    }
+    queue->markAsWritten(size);
+}
+
+// Test that the merger interleaves queues by timestamp, breaking ties by queue index.
+bool testMergedOrder() {
+    printf("testMergedOrder\n");
+    const int64_t first[] = {10, 40, 50};
+    const int64_t second[] = {20, 30, 60, 70};
+    const int64_t third[] = {40};
+    const int expectedIndices[] = {0, 1, 1, 0, 2, 0, 1, 1};
+    std::unique_ptr<SensorEventQueue> owned[4];
+    std::vector<SensorEventQueue*> queues;
+    for (auto& queue : owned) {
+        queue.reset(new SensorEventQueue(10));
+        queues.push_back(queue.get());
+    }
+    // The last queue stays empty.
+    writeTimestamps(queues[0], first, 3);
+    writeTimestamps(queues[1], second, 4);
+    writeTimestamps(queues[2], third, 1);
+
+    SensorEventMerger merger;
+    merger.start(queues);
+    int64_t last = 0;
+    int reads = 0;
+    int index;
+    while ((index = merger.next()) >= 0) {
+        if (reads >= 8 || !checkInt("queue index", expectedIndices[reads], index)) return false;
+        int64_t timestamp = queues[index]->peek()->timestamp;
+        if (timestamp < last) {
+            printf("timestamp %lld after %lld\n", (long long)timestamp, (long long)last);
+            return false;
+        }
+        last = timestamp;
+        queues[index]->dequeue();
+        merger.advance(index);
+        reads++;
+    }
+    if (!checkInt("reads", 8, reads)) return false;
+    printf("passed\n");
+    return true;
+}
+
 
 int main(int argc __attribute((unused)), char **argv __attribute((unused))) {
     if (testSimpleWriteSizeCounts() &&
             testWrappingWriteSizeCounts() &&
-            testFullQueueIo()) {
+            testWrappingReadSizeCounts() &&
+            testDropOldest() &&
+            testFullQueueIo(false) &&
+            testFullQueueIo(true) &&
+            testMergedOrder()) {
         printf("ALL PASSED\n");
     } else {
         printf("SOMETHING FAILED\n");
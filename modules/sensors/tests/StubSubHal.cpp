@@ -0,0 +1,271 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include <hardware/hardware.h>
+#include <hardware/sensors.h>
+
+// Stand-in for a vendor sub-HAL library, for multihal benchmarks. Like a real vendor library, it
+// does slow work in its constructor (probing hardware, loading calibration) and in
+// get_sensors_list().
+//
+// Its device replays an event trace. The trace is read from the library's own path with
+// ".trace" appended, so that each copy of the library can replay a different one:
+//
+//   # delay_us handle x y z
+//   2500 1 0.1 9.8 0.2
+//   0 2 0.01 0.02 0.03
+//
+// Each event is due delay_us after the previous one, and events with a zero delay arrive
+// together, like a FIFO flush. The trace loops forever. Only events of active sensors are
+// returned, timestamped with CLOCK_BOOTTIME when poll() returns them, so that a consumer can
+// measure the latency of the multihal. Without a trace file, poll() blocks forever.
+
+static const int LOAD_DELAY_US = 20000;
+static const int LIST_DELAY_US = 5000;
+
+__attribute__((constructor)) static void stub_sub_hal_init() {
+    usleep(LOAD_DELAY_US);
+}
+
+static const struct sensor_t stub_sensors[] = {
+    {
+        .name = "Stub Accelerometer",
+        .vendor = "AOSP",
+        .version = 1,
+        .handle = 1,
+        .type = SENSOR_TYPE_ACCELEROMETER,
+        .maxRange = 78.4f,
+        .resolution = 0.01f,
+        .power = 0.1f,
+        .minDelay = 2500,
+        .stringType = SENSOR_STRING_TYPE_ACCELEROMETER,
+        .maxDelay = 1000000,
+        .flags = SENSOR_FLAG_CONTINUOUS_MODE,
+    },
+    {
+        .name = "Stub Gyroscope",
+        .vendor = "AOSP",
+        .version = 1,
+        .handle = 2,
+        .type = SENSOR_TYPE_GYROSCOPE,
+        .maxRange = 34.9f,
+        .resolution = 0.001f,
+        .power = 0.5f,
+        .minDelay = 2500,
+        .stringType = SENSOR_STRING_TYPE_GYROSCOPE,
+        .maxDelay = 1000000,
+        .flags = SENSOR_FLAG_CONTINUOUS_MODE,
+    },
+};
+
+static int stub_get_sensors_list(struct sensors_module_t* /*module*/,
+        struct sensor_t const** list) {
+    usleep(LIST_DELAY_US);
+    *list = stub_sensors;
+    return sizeof(stub_sensors) / sizeof(stub_sensors[0]);
+}
+
+static const int STUB_SENSOR_COUNT = sizeof(stub_sensors) / sizeof(stub_sensors[0]);
+
+struct TraceEvent {
+    int64_t delay_ns;
+    int handle;
+    float values[3];
+};
+
+struct stub_device_t {
+    sensors_poll_device_1_t device; // must be first
+    std::vector<TraceEvent> trace;
+    size_t next;
+    // CLOCK_BOOTTIME at which trace[next] is due.
+    int64_t next_due_ns;
+    bool active[STUB_SENSOR_COUNT + 1];
+    pthread_mutex_t mutex;
+    // Flush completions waiting to be returned by poll().
+    std::vector<int> pending_flushes;
+};
+
+static int64_t boottime_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_BOOTTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static std::vector<TraceEvent> read_trace() {
+    std::vector<TraceEvent> trace;
+    Dl_info info;
+    if (!dladdr((void*)&read_trace, &info) || info.dli_fname == NULL) {
+        return trace;
+    }
+    std::string path = std::string(info.dli_fname) + ".trace";
+    FILE* file = fopen(path.c_str(), "re");
+    if (file == NULL) {
+        return trace;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        TraceEvent event = {};
+        long long delay_us;
+        if (line[0] == '#' || sscanf(line, "%lld %d %f %f %f", &delay_us, &event.handle,
+                &event.values[0], &event.values[1], &event.values[2]) < 2) {
+            continue;
+        }
+        if (event.handle < 1 || event.handle > STUB_SENSOR_COUNT) {
+            continue;
+        }
+        event.delay_ns = delay_us * 1000;
+        trace.push_back(event);
+    }
+    fclose(file);
+    return trace;
+}
+
+static int stub_activate(struct sensors_poll_device_t* dev, int handle, int enabled) {
+    stub_device_t* stub = (stub_device_t*)dev;
+    if (handle < 1 || handle > STUB_SENSOR_COUNT) {
+        return -EINVAL;
+    }
+    pthread_mutex_lock(&stub->mutex);
+    stub->active[handle] = enabled;
+    pthread_mutex_unlock(&stub->mutex);
+    return 0;
+}
+
+static int stub_set_delay(struct sensors_poll_device_t* /*dev*/, int handle, int64_t /*ns*/) {
+    return handle < 1 || handle > STUB_SENSOR_COUNT ? -EINVAL : 0;
+}
+
+static int stub_batch(struct sensors_poll_device_1* /*dev*/, int handle, int /*flags*/,
+        int64_t /*period_ns*/, int64_t /*timeout*/) {
+    return handle < 1 || handle > STUB_SENSOR_COUNT ? -EINVAL : 0;
+}
+
+static int stub_flush(struct sensors_poll_device_1* dev, int handle) {
+    stub_device_t* stub = (stub_device_t*)dev;
+    if (handle < 1 || handle > STUB_SENSOR_COUNT) {
+        return -EINVAL;
+    }
+    pthread_mutex_lock(&stub->mutex);
+    stub->pending_flushes.push_back(handle);
+    pthread_mutex_unlock(&stub->mutex);
+    return 0;
+}
+
+static int stub_poll(struct sensors_poll_device_t* dev, sensors_event_t* data, int count) {
+    stub_device_t* stub = (stub_device_t*)dev;
+    if (stub->trace.empty()) {
+        pause();
+        return 0;
+    }
+    // Sleep until the next event is due. A flush waits for it too, which is fine for a stub.
+    int64_t now = boottime_ns();
+    if (stub->next_due_ns > now) {
+        int64_t wait_ns = stub->next_due_ns - now;
+        struct timespec ts = { (time_t)(wait_ns / 1000000000), (long)(wait_ns % 1000000000) };
+        nanosleep(&ts, NULL);
+        now = boottime_ns();
+    }
+
+    int written = 0;
+    pthread_mutex_lock(&stub->mutex);
+    for (int handle : stub->pending_flushes) {
+        if (written == count) {
+            break;
+        }
+        sensors_event_t* event = &data[written++];
+        memset(event, 0, sizeof(*event));
+        event->version = META_DATA_VERSION;
+        event->type = SENSOR_TYPE_META_DATA;
+        event->meta_data.what = META_DATA_FLUSH_COMPLETE;
+        event->meta_data.sensor = handle;
+    }
+    stub->pending_flushes.erase(stub->pending_flushes.begin(),
+            stub->pending_flushes.begin() + written);
+    // Every event that is due, up to count.
+    while (written < count && stub->next_due_ns <= now) {
+        const TraceEvent& traced = stub->trace[stub->next];
+        if (stub->active[traced.handle]) {
+            sensors_event_t* event = &data[written++];
+            memset(event, 0, sizeof(*event));
+            event->version = sizeof(*event);
+            event->sensor = traced.handle;
+            event->type = stub_sensors[traced.handle - 1].type;
+            event->timestamp = now;
+            memcpy(event->data, traced.values, sizeof(traced.values));
+        }
+        stub->next = (stub->next + 1) % stub->trace.size();
+        stub->next_due_ns += stub->trace[stub->next].delay_ns;
+    }
+    pthread_mutex_unlock(&stub->mutex);
+    return written;
+}
+
+static int stub_close(struct hw_device_t* dev) {
+    stub_device_t* stub = (stub_device_t*)dev;
+    pthread_mutex_destroy(&stub->mutex);
+    delete stub;
+    return 0;
+}
+
+static int stub_open(const struct hw_module_t* module, const char* /*name*/,
+        struct hw_device_t** device) {
+    stub_device_t* stub = new stub_device_t();
+    stub->device.common.tag = HARDWARE_DEVICE_TAG;
+    stub->device.common.version = SENSORS_DEVICE_API_VERSION_1_4;
+    stub->device.common.module = const_cast<hw_module_t*>(module);
+    stub->device.common.close = stub_close;
+    stub->device.activate = stub_activate;
+    stub->device.setDelay = stub_set_delay;
+    stub->device.poll = stub_poll;
+    stub->device.batch = stub_batch;
+    stub->device.flush = stub_flush;
+    stub->trace = read_trace();
+    stub->next = 0;
+    stub->next_due_ns = boottime_ns() + (stub->trace.empty() ? 0 : stub->trace[0].delay_ns);
+    pthread_mutex_init(&stub->mutex, NULL);
+    *device = &stub->device.common;
+    return 0;
+}
+
+static struct hw_module_methods_t stub_module_methods = {
+    .open = stub_open,
+};
+
+__attribute__((visibility("default")))
+struct sensors_module_t HAL_MODULE_INFO_SYM = {
+    .common = {
+        .tag = HARDWARE_MODULE_TAG,
+        .version_major = 1,
+        .version_minor = 0,
+        .id = SENSORS_HARDWARE_MODULE_ID,
+        .name = "Stub Sensor Sub-HAL",
+        .author = "The Android Open Source Project",
+        .methods = &stub_module_methods,
+    },
+    .get_sensors_list = stub_get_sensors_list,
+};
@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <hardware/sensors.h>
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "SubHalCommandQueue.h"
+
+// Unit tests for the SubHalCommandQueue, against a fake sub-HAL that records the calls it gets.
+
+// Run it like this:
+//
+// m sensorscommandtests && \
+// out/host/linux-x86/nativetest64/sensorscommandtests/sensorscommandtests
+
+namespace {
+
+struct Call {
+    const char* name;
+    int handle;
+    int64_t value;
+};
+
+// Sub-HAL whose calls are recorded in order. A call for gateHandle blocks until the gate is
+// opened, which keeps the commands queued behind it waiting. Calls for failingHandle fail.
+struct FakeSubHal {
+    sensors_poll_device_1_t device;
+    pthread_mutex_t mutex;
+    pthread_cond_t gateOpened;
+    bool gateOpen;
+    int gateHandle;
+    int failingHandle;
+    std::vector<Call> calls;
+
+    FakeSubHal() : device(), gateOpen(true), gateHandle(-1), failingHandle(-1) {
+        pthread_mutex_init(&mutex, NULL);
+        pthread_cond_init(&gateOpened, NULL);
+        device.activate = activate;
+        device.setDelay = setDelay;
+        device.batch = batch;
+        device.flush = flush;
+    }
+
+    ~FakeSubHal() {
+        pthread_cond_destroy(&gateOpened);
+        pthread_mutex_destroy(&mutex);
+    }
+
+    void closeGate(int handle) {
+        pthread_mutex_lock(&mutex);
+        gateOpen = false;
+        gateHandle = handle;
+        pthread_mutex_unlock(&mutex);
+    }
+
+    void openGate() {
+        pthread_mutex_lock(&mutex);
+        gateOpen = true;
+        pthread_cond_broadcast(&gateOpened);
+        pthread_mutex_unlock(&mutex);
+    }
+
+    int record(const char* name, int handle, int64_t value) {
+        pthread_mutex_lock(&mutex);
+        while (!gateOpen && handle == gateHandle) {
+            pthread_cond_wait(&gateOpened, &mutex);
+        }
+        calls.push_back({name, handle, value});
+        pthread_mutex_unlock(&mutex);
+        return handle == failingHandle ? -EINVAL : 0;
+    }
+
+    static FakeSubHal* from(const void* dev) {
+        return (FakeSubHal*)dev;
+    }
+
+    static int activate(sensors_poll_device_t* dev, int handle, int enabled) {
+        return from(dev)->record("activate", handle, enabled);
+    }
+
+    static int setDelay(sensors_poll_device_t* dev, int handle, int64_t period_ns) {
+        return from(dev)->record("setDelay", handle, period_ns);
+    }
+
+    static int batch(sensors_poll_device_1_t* dev, int handle, int /* flags */,
+            int64_t period_ns, int64_t /* timeout */) {
+        return from(dev)->record("batch", handle, period_ns);
+    }
+
+    static int flush(sensors_poll_device_1_t* dev, int handle) {
+        return from(dev)->record("flush", handle, 0);
+    }
+};
+
+void expectCalls(const std::vector<Call>& expected, const std::vector<Call>& actual) {
+    ASSERT_EQ(expected.size(), actual.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        SCOPED_TRACE(i);
+        EXPECT_STREQ(expected[i].name, actual[i].name);
+        EXPECT_EQ(expected[i].handle, actual[i].handle);
+        EXPECT_EQ(expected[i].value, actual[i].value);
+    }
+}
+
+} // anonymous namespace
+
+TEST(SubHalCommandQueueTest, CoalescesWaitingCommands) {
+    FakeSubHal subHal;
+    multihal_sub_hal_stats stats = {};
+    SubHalCommandQueue queue(&subHal.device, &stats);
+
+    // Hold the worker on handle 9, so that the commands after it wait in the queue.
+    subHal.closeGate(9);
+    queue.batch(9, 0, 1000, 0);
+    queue.batch(1, 0, 10, 0);
+    queue.batch(1, 0, 20, 0);
+    queue.batch(1, 0, 30, 0);
+    queue.setDelay(2, 100);
+    queue.setDelay(2, 200);
+    subHal.openGate();
+    queue.drain();
+
+    expectCalls({{"batch", 9, 1000}, {"batch", 1, 30}, {"setDelay", 2, 200}}, subHal.calls);
+    EXPECT_EQ(3u, stats.commands_coalesced.load());
+    EXPECT_EQ(0u, stats.command_errors.load());
+}
+
+TEST(SubHalCommandQueueTest, KeepsOrderAcrossOtherCommands) {
+    FakeSubHal subHal;
+    multihal_sub_hal_stats stats = {};
+    SubHalCommandQueue queue(&subHal.device, &stats);
+
+    subHal.closeGate(9);
+    queue.batch(9, 0, 1000, 0);
+    queue.batch(1, 0, 10, 0);
+    // A command of another kind for the same sensor stops the next batch() from replacing the
+    // first one.
+    queue.setDelay(1, 5);
+    queue.batch(1, 0, 20, 0);
+    // Commands for other sensors don't.
+    queue.batch(2, 0, 40, 0);
+    queue.batch(1, 0, 30, 0);
+    subHal.openGate();
+    // flush() only returns once everything queued before it has run.
+    EXPECT_EQ(0, queue.flush(1));
+
+    expectCalls({{"batch", 9, 1000}, {"batch", 1, 10}, {"setDelay", 1, 5}, {"batch", 1, 30},
+                 {"batch", 2, 40}, {"flush", 1, 0}}, subHal.calls);
+    EXPECT_EQ(1u, stats.commands_coalesced.load());
+
+    // activate() also waits for the commands queued before it.
+    queue.batch(3, 0, 50, 0);
+    EXPECT_EQ(0, queue.activate(3, 1));
+    ASSERT_EQ(8u, subHal.calls.size());
+    EXPECT_STREQ("batch", subHal.calls[6].name);
+    EXPECT_STREQ("activate", subHal.calls[7].name);
+}
+
+TEST(SubHalCommandQueueTest, CountsAsynchronousFailures) {
+    FakeSubHal subHal;
+    subHal.failingHandle = 5;
+    multihal_sub_hal_stats stats = {};
+    SubHalCommandQueue queue(&subHal.device, &stats);
+
+    queue.batch(5, 0, 10, 0);
+    queue.drain();
+    queue.setDelay(5, 10);
+    queue.drain();
+    queue.batch(6, 0, 10, 0);
+    queue.drain();
+    EXPECT_EQ(2u, stats.command_errors.load());
+
+    // Errors of calls that the caller waits for are returned, not counted.
+    EXPECT_EQ(-EINVAL, queue.activate(5, 1));
+    EXPECT_EQ(-EINVAL, queue.flush(5));
+    EXPECT_EQ(2u, stats.command_errors.load());
+}
+
+TEST(SubHalCommandQueueTest, DestructorRunsQueuedCommands) {
+    FakeSubHal subHal;
+    multihal_sub_hal_stats stats = {};
+    {
+        SubHalCommandQueue queue(&subHal.device, &stats);
+        queue.batch(1, 0, 10, 0);
+        queue.setDelay(2, 20);
+    }
+    expectCalls({{"batch", 1, 10}, {"setDelay", 2, 20}}, subHal.calls);
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dlfcn.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "SubHalLoader.h"
+
+// Multihal startup time: load SUB_HAL_COUNT copies of the stub sub-HAL library and query their
+// sensor lists, with one thread (what the multihal used to do) and with one thread per library.
+//
+// Run it like this:
+//
+// m sensorsinit_benchmark && \
+// out/host/linux-x86/benchmarktest64/sensorsinit_benchmark/sensorsinit_benchmark
+//
+// The stub library is found next to the benchmark binary, or at $SENSORS_STUB_SUB_HAL.
+
+static const int SUB_HAL_COUNT = 6;
+
+// dlopen() returns the already loaded library for a path it has seen, so every sub-HAL
+// needs its own copy of the stub.
+static std::vector<std::string> copyStubSubHals() {
+    std::string stub;
+    const char* env = getenv("SENSORS_STUB_SUB_HAL");
+    if (env != nullptr) {
+        stub = env;
+    } else {
+        char exe[PATH_MAX];
+        ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+        exe[len > 0 ? len : 0] = '\0';
+        stub = std::string(exe).substr(0, std::string(exe).rfind('/') + 1) +
+                "libsensors_stub_sub_hal.so";
+    }
+
+    std::vector<std::string> paths;
+    const char* tmp = getenv("TMPDIR");
+    for (int i = 0; i < SUB_HAL_COUNT; i++) {
+        std::string path = std::string(tmp ? tmp : "/tmp") + "/sensors_stub_sub_hal_" +
+                std::to_string(getpid()) + "_" + std::to_string(i) + ".so";
+        std::string command = "cp '" + stub + "' '" + path + "'";
+        if (system(command.c_str()) != 0) {
+            fprintf(stderr, "Could not copy %s\n", stub.c_str());
+            exit(EXIT_FAILURE);
+        }
+        paths.push_back(path);
+    }
+    return paths;
+}
+
+static void BM_StartUp(benchmark::State& state) {
+    std::vector<std::string> paths = copyStubSubHals();
+    int threads = state.range(0);
+    for (auto _ : state) {
+        std::vector<hw_module_t*> modules;
+        std::vector<void*> soHandles;
+        std::vector<const sensor_t*> lists;
+        std::vector<int> counts;
+        load_sub_hal_modules(paths, threads, &modules, &soHandles);
+        get_sub_hal_sensor_lists(modules, threads, &lists, &counts);
+        if ((int)modules.size() != SUB_HAL_COUNT) {
+            state.SkipWithError("Stub sub-HAL did not load");
+        }
+
+        state.PauseTiming();
+        for (void* handle : soHandles) {
+            dlclose(handle);
+        }
+        state.ResumeTiming();
+    }
+    for (const std::string& path : paths) {
+        unlink(path.c_str());
+    }
+}
+BENCHMARK(BM_StartUp)->Arg(1)->Arg(SUB_HAL_COUNT)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+BENCHMARK_MAIN();